@@ -0,0 +1,358 @@
+#include "Analysis.h"
+#include "Cpu.h"
+#include "ImageHandler.h"
+#include "ImageKernels.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <fmt/core.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define STEGO_HAVE_AVX2 1
+#endif
+
+namespace Analysis {
+
+namespace {
+
+// Discrimination function of a run of four samples: how much it varies
+inline int smoothness(int a, int b, int c, int d) {
+    return std::abs(a - b) + std::abs(b - c) + std::abs(c - d);
+}
+
+inline int flip(int v) { return v ^ 1; }
+inline int flipShifted(int v) { return ((v + 1) ^ 1) - 1; }
+
+// RS counts of the run starting at p, masked samples are the middle two
+inline void rsScalar(const unsigned char* p, std::size_t s, std::uint64_t* rs) {
+    int a = p[0], b = p[s], c = p[2 * s], d = p[3 * s];
+    int f = smoothness(a, b, c, d);
+    int m = smoothness(a, flip(b), flip(c), d);
+    int n = smoothness(a, flipShifted(b), flipShifted(c), d);
+    int fl = smoothness(flip(a), flip(b), flip(c), flip(d));
+    int ml = smoothness(flip(a), b, c, flip(d));
+    int nl = smoothness(flip(a), flipShifted(flip(b)), flipShifted(flip(c)), flip(d));
+    rs[0] += m > f;
+    rs[1] += m < f;
+    rs[2] += n > f;
+    rs[3] += n < f;
+    rs[4] += ml > fl;
+    rs[5] += ml < fl;
+    rs[6] += nl > fl;
+    rs[7] += nl < fl;
+}
+
+#if defined(__SSE2__)
+inline __m128i smoothness8(__m128i a, __m128i b, __m128i c, __m128i d) {
+    using ImageKernels::abs16;
+    return _mm_add_epi16(_mm_add_epi16(abs16(_mm_sub_epi16(a, b)), abs16(_mm_sub_epi16(b, c))),
+                         abs16(_mm_sub_epi16(c, d)));
+}
+
+inline __m128i load8(const unsigned char* p) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+}
+
+// Lanes set in a 16-bit compare mask
+inline int lanes(__m128i mask) {
+    return std::popcount(static_cast<unsigned>(_mm_movemask_epi8(mask))) / 2;
+}
+
+// RS counts of the 8 runs starting at p .. p + 7, in 16-bit lanes so F-1 can leave 0..255
+inline void rs8(const unsigned char* p, std::size_t s, std::uint64_t* rs) {
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i a = load8(p), b = load8(p + s), c = load8(p + 2 * s), d = load8(p + 3 * s);
+    auto flip8 = [&](__m128i v) { return _mm_xor_si128(v, one); };
+    auto shifted8 = [&](__m128i v) { return _mm_sub_epi16(_mm_xor_si128(_mm_add_epi16(v, one), one), one); };
+    __m128i af = flip8(a), bf = flip8(b), cf = flip8(c), df = flip8(d);
+    __m128i f = smoothness8(a, b, c, d);
+    __m128i m = smoothness8(a, bf, cf, d);
+    __m128i n = smoothness8(a, shifted8(b), shifted8(c), d);
+    __m128i fl = smoothness8(af, bf, cf, df);
+    __m128i ml = smoothness8(af, b, c, df);
+    __m128i nl = smoothness8(af, shifted8(bf), shifted8(cf), df);
+    rs[0] += lanes(_mm_cmpgt_epi16(m, f));
+    rs[1] += lanes(_mm_cmplt_epi16(m, f));
+    rs[2] += lanes(_mm_cmpgt_epi16(n, f));
+    rs[3] += lanes(_mm_cmplt_epi16(n, f));
+    rs[4] += lanes(_mm_cmpgt_epi16(ml, fl));
+    rs[5] += lanes(_mm_cmplt_epi16(ml, fl));
+    rs[6] += lanes(_mm_cmpgt_epi16(nl, fl));
+    rs[7] += lanes(_mm_cmplt_epi16(nl, fl));
+}
+
+// Sample pair classes of the 16 pairs (p[i], p[i + s]): X, Y and K (same value pair 2i / 2i + 1)
+inline void pairs16(const unsigned char* p, std::size_t s, std::uint64_t& x, std::uint64_t& y, std::uint64_t& k) {
+    __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + s));
+    __m128i atMost = _mm_cmpeq_epi8(_mm_max_epu8(u, v), v); // u <= v
+    __m128i equal = _mm_cmpeq_epi8(u, v);
+    __m128i less = _mm_andnot_si128(equal, atMost);
+    __m128i odd = _mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8(1)), _mm_set1_epi8(1));
+    unsigned lessMask = _mm_movemask_epi8(less), greaterMask = ~_mm_movemask_epi8(atMost) & 0xFFFF;
+    unsigned oddMask = _mm_movemask_epi8(odd);
+    x += std::popcount((lessMask & ~oddMask) | (greaterMask & oddMask));
+    y += std::popcount((greaterMask & ~oddMask) | (lessMask & oddMask));
+    const __m128i upper7 = _mm_set1_epi8(0x7F);
+    __m128i uh = _mm_and_si128(_mm_srli_epi16(u, 1), upper7), vh = _mm_and_si128(_mm_srli_epi16(v, 1), upper7);
+    k += std::popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(uh, vh))));
+}
+#endif
+
+#if STEGO_HAVE_AVX2
+__attribute__((target("avx2"))) inline __m256i smoothness16(__m256i a, __m256i b, __m256i c, __m256i d) {
+    return _mm256_add_epi16(_mm256_add_epi16(_mm256_abs_epi16(_mm256_sub_epi16(a, b)),
+                                             _mm256_abs_epi16(_mm256_sub_epi16(b, c))),
+                            _mm256_abs_epi16(_mm256_sub_epi16(c, d)));
+}
+
+__attribute__((target("avx2"))) inline __m256i load16(const unsigned char* p) {
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+__attribute__((target("avx2"))) inline __m256i flip16(__m256i v) {
+    return _mm256_xor_si256(v, _mm256_set1_epi16(1));
+}
+
+__attribute__((target("avx2"))) inline __m256i shifted16(__m256i v) {
+    const __m256i one = _mm256_set1_epi16(1);
+    return _mm256_sub_epi16(_mm256_xor_si256(_mm256_add_epi16(v, one), one), one);
+}
+
+// RS counts of runs [0, count) rounded down to 16, returns how many were done. Compare masks (-1) are summed in
+// 16-bit lanes and added up before they could overflow.
+__attribute__((target("avx2"))) std::size_t rsRowAvx2(const unsigned char* p, std::size_t s, std::size_t count,
+                                                      std::uint64_t* rs) {
+    const __m256i one = _mm256_set1_epi16(1);
+    std::size_t g = 0;
+    while (g + 16 <= count) {
+        __m256i sums[8];
+        for (auto& sum : sums) sum = _mm256_setzero_si256();
+        for (int round = 0; round < 32767 && g + 16 <= count; ++round, g += 16) {
+            const unsigned char* q = p + g;
+            __m256i a = load16(q), b = load16(q + s), c = load16(q + 2 * s), d = load16(q + 3 * s);
+            __m256i af = flip16(a), bf = flip16(b), cf = flip16(c), df = flip16(d);
+            __m256i f = smoothness16(a, b, c, d);
+            __m256i m = smoothness16(a, bf, cf, d);
+            __m256i n = smoothness16(a, shifted16(b), shifted16(c), d);
+            __m256i fl = smoothness16(af, bf, cf, df);
+            __m256i ml = smoothness16(af, b, c, df);
+            __m256i nl = smoothness16(af, shifted16(bf), shifted16(cf), df);
+            sums[0] = _mm256_sub_epi16(sums[0], _mm256_cmpgt_epi16(m, f));
+            sums[1] = _mm256_sub_epi16(sums[1], _mm256_cmpgt_epi16(f, m));
+            sums[2] = _mm256_sub_epi16(sums[2], _mm256_cmpgt_epi16(n, f));
+            sums[3] = _mm256_sub_epi16(sums[3], _mm256_cmpgt_epi16(f, n));
+            sums[4] = _mm256_sub_epi16(sums[4], _mm256_cmpgt_epi16(ml, fl));
+            sums[5] = _mm256_sub_epi16(sums[5], _mm256_cmpgt_epi16(fl, ml));
+            sums[6] = _mm256_sub_epi16(sums[6], _mm256_cmpgt_epi16(nl, fl));
+            sums[7] = _mm256_sub_epi16(sums[7], _mm256_cmpgt_epi16(fl, nl));
+        }
+        for (int i = 0; i < 8; ++i) {
+            // Pairs of 16-bit lanes into 32-bit lanes, then the 8 lanes added up
+            __m256i wide = _mm256_madd_epi16(sums[i], one);
+            alignas(32) std::uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), wide);
+            for (std::uint32_t lane : lanes) rs[i] += lane;
+        }
+    }
+    return g;
+}
+#endif
+
+// Upper regularized incomplete gamma function Q(a, x), series below a + 1 and a continued fraction above
+double gammaQ(double a, double x) {
+    if (x <= 0) return 1;
+    double logPrefix = a * std::log(x) - x - std::lgamma(a);
+    if (x < a + 1) {
+        double term = 1 / a, sum = term;
+        for (int n = 1; n < 1000 && std::abs(term) > std::abs(sum) * 1e-15; ++n) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return std::max(0.0, 1 - sum * std::exp(logPrefix));
+    }
+    double b = x + 1 - a, c = 1e300, d = 1 / b, h = d;
+    for (int i = 1; i < 1000; ++i) {
+        double an = -i * (i - a);
+        b += 2;
+        d = an * d + b;
+        if (std::abs(d) < 1e-300) d = 1e-300;
+        c = b + an / c;
+        if (std::abs(c) < 1e-300) c = 1e-300;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if (std::abs(delta - 1) < 1e-15) break;
+    }
+    return std::exp(logPrefix) * h;
+}
+
+// Root of a x^2 + b x + c with the smaller magnitude, 0 without a real root
+double smallerRoot(double a, double b, double c) {
+    if (a == 0) return b == 0 ? 0 : -c / b;
+    double discriminant = b * b - 4 * a * c;
+    if (discriminant < 0) return 0;
+    double r1 = (-b + std::sqrt(discriminant)) / (2 * a), r2 = (-b - std::sqrt(discriminant)) / (2 * a);
+    return std::abs(r1) < std::abs(r2) ? r1 : r2;
+}
+
+} // namespace
+
+Counts& Counts::operator+=(const Counts& other) {
+    for (int v = 0; v < 256; ++v) histogram[v] += other.histogram[v];
+    pairs += other.pairs;
+    pairsX += other.pairsX;
+    pairsY += other.pairsY;
+    pairsK += other.pairsK;
+    groups += other.groups;
+    for (int i = 0; i < 8; ++i) rs[i] += other.rs[i];
+    return *this;
+}
+
+// Function to count a band of rows
+Counts count(const char* data, std::size_t rows, std::size_t rowBytes, std::size_t rowStride, std::size_t step) {
+    Counts counts;
+    const std::size_t s = step;
+    ImageKernels::BankedHistogram banks;
+    for (std::size_t y = 0; y < rows; ++y) {
+        const auto* row = reinterpret_cast<const unsigned char*>(data + y * rowStride);
+        banks.add(row, rowBytes);
+        banks.flush(counts.histogram);
+
+        if (rowBytes <= s) continue;
+        std::size_t pairCount = rowBytes - s;
+        counts.pairs += pairCount;
+        std::size_t x = 0;
+#if defined(__SSE2__)
+        for (; x + 16 <= pairCount; x += 16) pairs16(row + x, s, counts.pairsX, counts.pairsY, counts.pairsK);
+#endif
+        for (; x < pairCount; ++x) {
+            int u = row[x], v = row[x + s];
+            bool odd = v & 1;
+            counts.pairsX += (!odd && u < v) || (odd && u > v);
+            counts.pairsY += (!odd && u > v) || (odd && u < v);
+            counts.pairsK += (u >> 1) == (v >> 1);
+        }
+
+        if (rowBytes <= 3 * s) continue;
+        std::size_t groupCount = rowBytes - 3 * s;
+        counts.groups += groupCount;
+        std::size_t g = 0;
+#if STEGO_HAVE_AVX2
+        if (Cpu::hasAvx2()) g = rsRowAvx2(row, s, groupCount, counts.rs);
+#endif
+#if defined(__SSE2__)
+        for (; g + 8 <= groupCount; g += 8) rs8(row + g, s, counts.rs);
+#endif
+        for (; g < groupCount; ++g) rsScalar(row + g, s, counts.rs);
+    }
+    return counts;
+}
+
+// Function to turn counts into the statistics
+Result evaluate(const Counts& counts) {
+    Result result;
+
+    // Chi-square over the value pairs with enough samples for the approximation
+    double chi = 0;
+    int categories = 0;
+    for (int v = 0; v < 256; v += 2) {
+        double expected = (counts.histogram[v] + counts.histogram[v + 1]) / 2.0;
+        if (expected < 5) continue;
+        double difference = counts.histogram[v] - expected;
+        chi += difference * difference / expected;
+        ++categories;
+    }
+    result.chiSquareP = categories > 1 ? gammaQ((categories - 1) / 2.0, chi / 2) : 0;
+
+    if (counts.pairsK > 0) {
+        double n = static_cast<double>(counts.pairs);
+        double beta = smallerRoot(2.0 * counts.pairsK, 2 * (2.0 * counts.pairsX - n),
+                                  static_cast<double>(counts.pairsY) - static_cast<double>(counts.pairsX));
+        result.samplePairs = std::min(1.0, std::max(0.0, 2 * beta));
+    }
+
+    if (counts.groups > 0) {
+        double total = static_cast<double>(counts.groups);
+        double d0 = (counts.rs[0] - static_cast<double>(counts.rs[1])) / total;
+        double dn0 = (counts.rs[2] - static_cast<double>(counts.rs[3])) / total;
+        double d1 = (counts.rs[4] - static_cast<double>(counts.rs[5])) / total;
+        double dn1 = (counts.rs[6] - static_cast<double>(counts.rs[7])) / total;
+        double x = smallerRoot(2 * (d1 + d0), dn0 - dn1 - d1 - 3 * d0, d0 - dn0);
+        result.rs = x == 0.5 ? 1.0 : std::min(1.0, std::max(0.0, x / (x - 0.5)));
+    }
+    return result;
+}
+
+// Function to analyze an image file
+bool analyzeFile(const std::string& filename, int windows) {
+    ImageHandler::ImageInfo info;
+    std::vector<char> data;
+    if (!ImageHandler::readImage(filename, data, info)) {
+        fmt::println("Failed to read image for analysis.");
+        return false;
+    }
+    // Padding bytes are left out, neighbours are the same channel of the next pixel. Of a 16-bit sample only the
+    // low byte (the second, big endian) is counted, embedding never changes the high one.
+    std::size_t bytesPerSample = info.maxVal > 255 ? 2 : 1;
+    std::size_t step = static_cast<std::size_t>(info.channels);
+    std::size_t rowBytes = static_cast<std::size_t>(info.width) * step;
+    std::size_t rows = static_cast<std::size_t>(info.height);
+
+    // Bands of rows, as many as windows were asked for or enough to keep the threads busy
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t bands = std::min(rows, windows > 1 ? static_cast<std::size_t>(windows) : threads * 4);
+    std::vector<Counts> parts(bands);
+    std::atomic<bool> counted{true};
+    Parallel::forEach(bands, [&](std::size_t b) {
+        std::size_t first = rows * b / bands, last = rows * (b + 1) / bands;
+        const char* band = data.data() + first * info.rowStride;
+        if (bytesPerSample == 1) {
+            parts[b] = count(band, last - first, rowBytes, info.rowStride, step);
+            return;
+        }
+        std::vector<char> low((last - first) * rowBytes);
+        for (std::size_t y = 0; y < last - first; ++y) {
+            const char* row = band + y * info.rowStride;
+            for (std::size_t x = 0; x < rowBytes; ++x) low[y * rowBytes + x] = row[2 * x + 1];
+        }
+        parts[b] = count(low.data(), last - first, rowBytes, rowBytes, step);
+    }, [&](std::size_t, std::exception_ptr error) {
+        if (counted.exchange(false)) fmt::println("Failed to analyze '{}': {}", filename, Parallel::describe(error));
+    });
+    if (!counted) return false;
+
+    Counts total;
+    if (windows > 1) {
+        // Embedding from the start of the carrier shows as p near 1 in the first windows that drops where it ends
+        fmt::println("{:>15}  {:>8} {:>8} {:>8}   {:>8} {:>8} {:>8}", "rows", "chi p", "pairs", "RS",
+                     "chi p", "pairs", "RS");
+        fmt::println("{:>15}  {:^26}   {:^26}", "", "window", "from the top");
+    }
+    for (std::size_t b = 0; b < bands; ++b) {
+        total += parts[b];
+        if (windows <= 1) continue;
+        Result window = evaluate(parts[b]), cumulative = evaluate(total);
+        fmt::println("{:>7}-{:<7}  {:8.4f} {:8.3f} {:8.3f}   {:8.4f} {:8.3f} {:8.3f}", rows * b / bands,
+                     rows * (b + 1) / bands, window.chiSquareP, window.samplePairs, window.rs,
+                     cumulative.chiSquareP, cumulative.samplePairs, cumulative.rs);
+    }
+
+    Result result = evaluate(total);
+    fmt::println("Chi-square:   p = {:.4f} (near 1: the value pairs are as even as LSB embedding makes them)",
+                 result.chiSquareP);
+    fmt::println("Sample pairs: estimated embedding rate {:.3f}", result.samplePairs);
+    fmt::println("RS analysis:  estimated embedding rate {:.3f}", result.rs);
+    bool suspicious = result.chiSquareP > 0.9 || result.samplePairs > 0.1 || result.rs > 0.1;
+    fmt::println("Verdict:      {}", suspicious ? "likely carries an LSB payload" : "no sign of LSB embedding");
+    return true;
+}
+
+} // namespace Analysis
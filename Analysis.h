@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// LSB steganalysis (-analyze): does an image look like it already carries an LSB payload?
+//  - Chi-square attack (Westfeld and Pfitzmann): embedding evens out the counts of each value pair 2i / 2i + 1.
+//    The result is the probability that the pair counts are that even by chance, near 1 means embedding.
+//  - Sample Pairs analysis (Dumitrescu, Wu and Wang) over horizontally neighbouring samples of the same channel.
+//  - RS analysis (Fridrich, Goljan and Du) over runs of four neighbouring samples with the mask 0 1 1 0; every run
+//    is used, not only disjoint ones, which leaves the expected ratios as they are.
+// Both estimates are the fraction of carrier samples that hold a payload bit (1.0 for a carrier filled at one bit
+// per sample), around 0 for a clean image. Both models break down for a carrier filled almost completely (they fall
+// back to 0 there), the chi-square attack is the one that sees that case. All statistics are counted per band of
+// rows in one pass, band by band on threads, so windows over the image cost nothing extra.
+namespace Analysis {
+
+    // Counts one band of rows adds up to
+    struct Counts {
+        std::array<std::uint64_t, 256> histogram{};
+        std::uint64_t pairs = 0, pairsX = 0, pairsY = 0, pairsK = 0; // sample pairs
+        std::uint64_t groups = 0;
+        std::uint64_t rs[8] = {}; // R_M, S_M, R_-M, S_-M, then the same with every LSB flipped
+
+        Counts& operator+=(const Counts& other);
+    };
+
+    struct Result {
+        double chiSquareP = 0;  // probability of the even pair counts, near 1 = embedding
+        double samplePairs = 0; // estimated embedding rate
+        double rs = 0;          // estimated embedding rate
+    };
+
+    // Function to count a band of rows: `rows` rows of `rowBytes` pixel bytes every `rowStride` bytes,
+    // neighbouring samples of the same channel `step` bytes apart
+    Counts count(const char* data, std::size_t rows, std::size_t rowBytes, std::size_t rowStride, std::size_t step);
+
+    // Function to turn counts into the three statistics
+    Result evaluate(const Counts& counts);
+
+    // Function to analyze an image file and print the result, with `windows` > 1 also for that many bands of rows
+    // (each on its own and from the top of the image down to it)
+    bool analyzeFile(const std::string& filename, int windows = 0);
+
+} // namespace Analysis
@@ -0,0 +1,480 @@
+#include "Analysis.h"
+#include "BitPlanes.h"
+#include "Checksum.h"
+#include "Corpus.h"
+#include "CostMap.h"
+#include "Cpu.h"
+#include "Crypto.h"
+#include "Deflate.h"
+#include "ImageHandler.h"
+#include "Lz.h"
+#include "Quality.h"
+#include "ReedSolomon.h"
+#include "Steganography.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+
+// Microbenchmarks of the hot paths (stego_bench): LSB embed/extract for every layout (k bits per sample, matrix
+// embedding, keyed order), capacity checks, header parsing, image read/write for every format, and the kernels
+// behind the payload options. Every case is warmed up, calibrated to a number of iterations that runs for at
+// least --min-time, then timed --reps times. Cases whose kernels are picked at runtime (AVX2, SSSE3, SSE4.2) run
+// once per instruction set level the CPU reaches, by lowering Cpu::setCeiling.
+//   stego_bench [--filter=text] [--reps=N] [--min-time=ms] [--json=file] [--quick] [--list]
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Settings {
+    std::string filter;
+    std::string json;
+    int reps = 10;
+    double minTime = 0.05; // seconds per repetition
+    bool quick = false;
+    bool list = false;
+};
+
+// One benchmark: `bytes` are the bytes one call processes (0 for per-call cases like header parsing)
+struct Case {
+    std::string name;
+    std::size_t bytes = 0;
+    bool dispatched = false; // has runtime-selected kernels
+    std::function<void()> run;
+};
+
+struct Stats {
+    std::string name;
+    std::string level;
+    std::size_t bytes = 0;
+    std::size_t iterations = 0;
+    double min = 0, median = 0, mean = 0, stddev = 0; // ns per call
+
+    double megabytesPerSecond() const { return bytes && median > 0 ? bytes / median * 1e3 : 0; }
+};
+
+// Results the compiler must not drop
+volatile std::uint64_t sink = 0;
+
+using Clock = std::chrono::steady_clock;
+
+double seconds(Clock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+// The xorshift64 generator of stego_gen, one stream per input, so runs with the same seed get the same data
+using Corpus::Random;
+
+std::vector<unsigned char> noise(std::size_t size, std::uint64_t seed) {
+    std::vector<unsigned char> data(size);
+    Random random(seed);
+    for (std::size_t i = 0; i < size; ++i) data[i] = static_cast<unsigned char>(random.next() >> 56);
+    return data;
+}
+
+// Words from a small vocabulary, compresses about like the log/text messages the tool is used with
+std::string text(std::size_t size, std::uint64_t seed) {
+    static const char* words[] = {"audit", "record", "image", "carrier", "payload", "2024-06-01", "status=ok",
+                                  "user", "id", "the", "of", "and", "frame", "checksum", "batch", "node-17"};
+    std::string out;
+    out.reserve(size + 16);
+    Random random(seed);
+    while (out.size() < size) {
+        out += words[random.next() >> 60];
+        out += (random.next() >> 61) == 0 ? '\n' : ' ';
+    }
+    out.resize(size);
+    return out;
+}
+
+// Smooth gradients with light noise, like a photo: realistic for the compressed formats
+std::vector<char> photo(int width, int height, int channels, std::uint64_t seed) {
+    std::vector<char> data(static_cast<std::size_t>(width) * height * channels);
+    Random random(seed);
+    std::size_t i = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                int value = (x * (c + 1) / 16 + y / 8 + static_cast<int>(random.next() >> 62)) & 0xFF;
+                data[i++] = static_cast<char>(value);
+            }
+        }
+    }
+    return data;
+}
+
+std::string sizeName(std::size_t bytes) {
+    if (bytes >= (std::size_t{1} << 20) && bytes % (std::size_t{1} << 20) == 0) return fmt::format("{}MiB", bytes >> 20);
+    if (bytes >= 1024 && bytes % 1024 == 0) return fmt::format("{}KiB", bytes >> 10);
+    return fmt::format("{}B", bytes);
+}
+
+// Function to time one case: warm-up, calibration, then the repetitions
+Stats measure(const Case& c, const Settings& settings) {
+    Stats stats;
+    stats.name = c.name;
+    stats.bytes = c.bytes;
+    // Warm-up until caches, page tables and the branch predictors settle, and a first timing for the calibration
+    double single = 0;
+    Clock::time_point warmStart = Clock::now();
+    int warmRuns = 0;
+    do {
+        Clock::time_point start = Clock::now();
+        c.run();
+        single = seconds(Clock::now() - start);
+        ++warmRuns;
+    } while (warmRuns < 2 || seconds(Clock::now() - warmStart) < settings.minTime / 2);
+    stats.iterations = std::max<std::size_t>(1, static_cast<std::size_t>(settings.minTime / std::max(single, 1e-9)));
+
+    std::vector<double> samples;
+    for (int rep = 0; rep < settings.reps; ++rep) {
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < stats.iterations; ++i) c.run();
+        samples.push_back(seconds(Clock::now() - start) * 1e9 / stats.iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    stats.min = samples.front();
+    std::size_t n = samples.size();
+    stats.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    for (double s : samples) stats.mean += s / n;
+    for (double s : samples) stats.stddev += (s - stats.mean) * (s - stats.mean);
+    stats.stddev = n > 1 ? std::sqrt(stats.stddev / (n - 1)) : 0;
+    return stats;
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (char ch : text) {
+        if (ch == '"' || ch == '\\') out += '\\';
+        out += ch;
+    }
+    return out;
+}
+
+bool writeJson(const std::string& filename, const std::vector<Stats>& results, const Settings& settings) {
+    std::ofstream file(filename);
+    if (!file) {
+        fmt::println("Failed to open {} for writing.", filename);
+        return false;
+    }
+    file << fmt::format("{{\n  \"context\": {{\"cpu_level\": \"{}\", \"threads\": {}, \"reps\": {}, \"min_time_ms\": {}}},\n",
+                        Cpu::name(Cpu::detected()), std::thread::hardware_concurrency(), settings.reps,
+                        settings.minTime * 1e3);
+    file << "  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Stats& s = results[i];
+        file << fmt::format("    {{\"name\": \"{}\", \"simd\": \"{}\", \"bytes\": {}, \"iterations\": {}, "
+                            "\"ns_per_op\": {{\"min\": {:.1f}, \"median\": {:.1f}, \"mean\": {:.1f}, \"stddev\": {:.1f}}}, "
+                            "\"mb_per_s\": {:.1f}}}{}\n",
+                            jsonEscape(s.name), s.level, s.bytes, s.iterations, s.min, s.median, s.mean, s.stddev,
+                            s.megabytesPerSecond(), i + 1 < results.size() ? "," : "");
+    }
+    file << "  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+// ---------------------------------------- cases ----------------------------------------
+
+Crypto::Key benchKey() {
+    Crypto::Key key{};
+    for (std::size_t i = 0; i < key.size(); ++i) key[i] = static_cast<unsigned char>(i * 7 + 1);
+    return key;
+}
+
+// Embed and extract with the bit kernels, one case per layout and payload size
+void addLsbCases(std::vector<Case>& cases, const Settings& settings) {
+    std::vector<std::size_t> sizes = {4 << 10, 256 << 10};
+    if (!settings.quick) sizes.push_back(4 << 20);
+    struct Variant {
+        std::string name;
+        Steganography::EmbedOptions options;
+    };
+    std::vector<Variant> variants;
+    for (int k = 1; k <= 4; ++k) {
+        Variant v{fmt::format("k{}", k), {}};
+        v.options.bitsPerSample = k;
+        variants.push_back(v);
+    }
+    for (int p : {3, 5, 8}) {
+        Variant v{fmt::format("matrix{}", p), {}};
+        v.options.matrixBits = p;
+        variants.push_back(v);
+    }
+    Variant permuted{"permuted", {}};
+    permuted.options.permute = true;
+    permuted.options.key = benchKey();
+    variants.push_back(permuted);
+
+    for (std::size_t size : sizes) {
+        std::string message(size, '\0');
+        std::vector<unsigned char> bytes = noise(size, size);
+        std::copy(bytes.begin(), bytes.end(), message.begin());
+        for (const Variant& variant : variants) {
+            auto payload = std::make_shared<std::vector<unsigned char>>(Steganography::buildPayload(message, variant.options));
+            Steganography::Layout layout = Steganography::payloadLayout(*payload);
+            std::size_t samples = layout.samplesFor(payload->size() * 8);
+            // Matrix embedding of big payloads needs gigabytes of carrier, those add nothing
+            if (samples > (std::size_t{256} << 20)) continue;
+            auto carrier = std::make_shared<std::vector<unsigned char>>(noise(samples, samples));
+            std::shared_ptr<Permutation::Order> order;
+            if (variant.options.permute) order = std::make_shared<Permutation::Order>(samples, variant.options.key);
+            auto view = [carrier, order] {
+                Steganography::Carrier c = Steganography::Carrier::buffer(reinterpret_cast<char*>(carrier->data()), carrier->size());
+                c.order = order.get();
+                return c;
+            };
+            std::size_t bits = payload->size() * 8;
+            cases.push_back({fmt::format("embed/{}/{}", variant.name, sizeName(size)), payload->size(), false,
+                             [=] { Steganography::embedBits(view(), layout, 0, payload->data(), 0, bits); }});
+            auto out = std::make_shared<std::vector<unsigned char>>(payload->size());
+            cases.push_back({fmt::format("extract/{}/{}", variant.name, sizeName(size)), payload->size(), false, [=] {
+                                 std::fill(out->begin(), out->end(), 0);
+                                 Steganography::extractBits(view(), layout, 0, out->data(), 0, bits);
+                                 sink = sink + (*out)[out->size() / 2];
+                             }});
+        }
+    }
+
+    // The whole in-memory path: payload building (CRC-32C, optional compression / encryption) plus the kernels
+    for (std::size_t size : sizes) {
+        for (int mode = 0; mode < 3; ++mode) {
+            Steganography::EmbedOptions options;
+            options.compress = mode == 1;
+            options.encrypt = mode == 2;
+            options.key = benchKey();
+            const char* modeName = mode == 0 ? "plain" : mode == 1 ? "compress" : "encrypt";
+            std::string message = text(size, size + mode);
+            std::size_t samples = (size + 256) * 8; // one bit per sample, room for the header and the tag
+            ImageHandler::PixelView pixels;
+            pixels.width = static_cast<int>((samples + 2) / 3 / 1024 + 1);
+            pixels.height = 1024;
+            pixels.channels = 3;
+            pixels.rowStride = static_cast<std::size_t>(pixels.width) * 3;
+            auto image = std::make_shared<std::vector<unsigned char>>(noise(pixels.size(), 7));
+            pixels.data = reinterpret_cast<char*>(image->data());
+            cases.push_back({fmt::format("view/embed/{}/{}", modeName, sizeName(size)), size, true,
+                             [=] { sink = sink + Steganography::embedInView(pixels, message, options) + image->size(); }});
+            cases.push_back({fmt::format("view/extract/{}/{}", modeName, sizeName(size)), size, true,
+                             [=] { sink = sink + Steganography::extractFromView(pixels, options).size() + image->size(); }});
+        }
+    }
+}
+
+// Small files of every format, then read/write of bigger ones
+void addFileCases(std::vector<Case>& cases, const Settings& settings, const fs::path& dir) {
+    struct Format {
+        std::string name;
+        ImageHandler::ImageFormat format;
+        int channels;
+    };
+    const std::vector<Format> formats = {
+        {"bmp", ImageHandler::ImageFormat::Bmp, 3},  {"ppm", ImageHandler::ImageFormat::Ppm, 3},
+        {"pgm", ImageHandler::ImageFormat::Pgm, 1},  {"pam", ImageHandler::ImageFormat::Pam, 4},
+        {"qoi", ImageHandler::ImageFormat::Qoi, 3},  {"png", ImageHandler::ImageFormat::Png, 3},
+    };
+    std::vector<std::pair<int, int>> sizes = {{1000, 1000}};
+    if (!settings.quick) sizes.push_back({4000, 3000});
+
+    auto imageInfo = [](const Format& f, int width, int height) {
+        ImageHandler::ImageInfo info;
+        info.format = f.format;
+        info.width = width;
+        info.height = height;
+        info.channels = f.channels;
+        info.bitsPerPixel = f.channels * 8;
+        info.rowStride = static_cast<std::size_t>(width) * f.channels; // widths are multiples of 4, no BMP padding
+        if (f.format == ImageHandler::ImageFormat::Pam) info.tupleType = "RGB_ALPHA";
+        return info;
+    };
+
+    std::string message = text(1024, 1);
+    for (const Format& f : formats) {
+        // Header parsing and the -c capacity check on a small image
+        std::string small = (dir / ("small." + f.name)).string();
+        ImageHandler::ImageInfo smallInfo = imageInfo(f, 64, 64);
+        if (!ImageHandler::writeImage(small, photo(64, 64, f.channels, 1), smallInfo)) continue;
+        cases.push_back({"header/" + f.name, 0, false, [=] {
+                             ImageHandler::ImageInfo info;
+                             sink = sink + ImageHandler::readImageInfo(small, info);
+                         }});
+        std::string carrier = (dir / ("carrier." + f.name)).string();
+        ImageHandler::writeImage(carrier, photo(1000, 1000, f.channels, 2), imageInfo(f, 1000, 1000));
+        cases.push_back({"capacity/" + f.name, 0, false, [=] {
+                             // What -c does besides decoding: header, raw and compressed payloads, their layouts
+                             ImageHandler::ImageInfo info;
+                             ImageHandler::readImageInfo(carrier, info);
+                             Steganography::EmbedOptions raw, compressed;
+                             compressed.compress = true;
+                             auto a = Steganography::buildPayload(message, raw);
+                             auto b = Steganography::buildPayload(message, compressed);
+                             sink = sink + Steganography::payloadLayout(a).samplesFor(a.size() * 8) +
+                                    Steganography::payloadLayout(b).samplesFor(b.size() * 8) + info.rowStride;
+                         }});
+
+        for (auto [width, height] : sizes) {
+            std::string label = fmt::format("{}/{}x{}", f.name, width, height);
+            std::string path = (dir / fmt::format("{}x{}.{}", width, height, f.name)).string();
+            ImageHandler::ImageInfo info = imageInfo(f, width, height);
+            auto pixels = std::make_shared<std::vector<char>>(photo(width, height, f.channels, 3));
+            if (!ImageHandler::writeImage(path, *pixels, info)) continue;
+            cases.push_back({"read/" + label, pixels->size(), false, [=] {
+                                 std::vector<char> data;
+                                 ImageHandler::ImageInfo readInfo;
+                                 sink = sink + ImageHandler::readImage(path, data, readInfo) + data.size();
+                             }});
+            std::string out = (dir / fmt::format("out{}x{}.{}", width, height, f.name)).string();
+            cases.push_back({"write/" + label, pixels->size(), false,
+                             [=] { sink = sink + ImageHandler::writeImage(out, *pixels, info); }});
+        }
+    }
+
+    // Payload header parsing from extracted bytes
+    Steganography::EmbedOptions options;
+    options.fecParity = 16;
+    auto payload = std::make_shared<std::vector<unsigned char>>(Steganography::buildPayload(message, options));
+    cases.push_back({"header/payload", 0, false, [=] {
+                         Steganography::Layout layout;
+                         sink = sink + Steganography::payloadSize(payload->data(), 64) +
+                                Steganography::payloadLayout(payload->data(), 64, layout);
+                     }});
+}
+
+// The kernels behind the payload options and the analysis tools, on 4 MiB (16 MiB of pixels for the image ones)
+void addKernelCases(std::vector<Case>& cases, const Settings& settings) {
+    const std::size_t size = std::size_t{4} << 20;
+    auto data = std::make_shared<std::vector<unsigned char>>(noise(size, 11));
+    auto out = std::make_shared<std::vector<unsigned char>>(size);
+    auto words = std::make_shared<std::string>(text(size, 12));
+    auto wordBytes = [words] { return reinterpret_cast<const unsigned char*>(words->data()); };
+
+    cases.push_back({"crc32c", size, true, [=] { sink = sink + Checksum::crc32c(data->data(), size); }});
+    Crypto::Key key = benchKey();
+    Crypto::Nonce nonce{};
+    cases.push_back({"chacha20", size, true, [=] { Crypto::chacha20Xor(key, nonce, 1, data->data(), out->data(), size); }});
+    cases.push_back({"poly1305", size, false, [=] { sink = sink + Crypto::poly1305(key.data(), data->data(), size)[0]; }});
+
+    cases.push_back({"rs/mul-add", size, true, [=] { ReedSolomon::mulAdd(out->data(), data->data(), 0x53, size); }});
+    for (int parity : {8, 32}) {
+        auto encoded = std::make_shared<std::vector<unsigned char>>(ReedSolomon::encode(data->data(), size, parity));
+        cases.push_back({fmt::format("rs/encode/{}", parity), size, true,
+                         [=] { sink = sink + ReedSolomon::encode(data->data(), size, parity).size(); }});
+        // A few damaged bytes, so the syndromes are not all zero
+        auto damaged = std::make_shared<std::vector<unsigned char>>(*encoded);
+        for (std::size_t i = 0; i < damaged->size(); i += damaged->size() / 64) (*damaged)[i] ^= 0x5A;
+        cases.push_back({fmt::format("rs/decode/{}", parity), size, true, [=] {
+                             std::vector<unsigned char> decoded;
+                             sink = sink + ReedSolomon::decode(damaged->data(), damaged->size(), size, parity, decoded);
+                         }});
+    }
+
+    auto compressed = std::make_shared<std::vector<unsigned char>>(Lz::compress(wordBytes(), size));
+    cases.push_back({"lz/compress", size, false, [=] { sink = sink + Lz::compress(wordBytes(), size).size(); }});
+    cases.push_back({"lz/decompress", size, false, [=] {
+                         std::vector<unsigned char> plain;
+                         sink = sink + Lz::decompress(compressed->data(), compressed->size(), plain);
+                     }});
+    auto deflated = std::make_shared<std::vector<unsigned char>>(Deflate::deflate(wordBytes(), size));
+    cases.push_back({"deflate", size, false, [=] { sink = sink + Deflate::deflate(wordBytes(), size).size(); }});
+    cases.push_back({"inflate", size, false, [=] {
+                         std::vector<unsigned char> plain;
+                         sink = sink + Deflate::inflate(deflated->data(), deflated->size(), plain);
+                     }});
+
+    // Image kernels over a 4096-byte-wide RGB band
+    const std::size_t rowBytes = 4096 * 3, rows = settings.quick ? 128 : 512;
+    auto pixels = std::make_shared<std::vector<char>>(photo(4096, static_cast<int>(rows), 3, 13));
+    auto other = std::make_shared<std::vector<char>>(*pixels);
+    for (std::size_t i = 0; i < other->size(); i += 3) (*other)[i] ^= 1;
+    const std::size_t bytes = pixels->size();
+    cases.push_back({"costmap", bytes, false, [=] {
+                         CostMap::Histogram histogram;
+                         sink = sink + CostMap::build(pixels->data(), {rowBytes, rows, 3}, histogram).size();
+                     }});
+    cases.push_back({"analysis/count", bytes, true,
+                     [=] { sink = sink + Analysis::count(pixels->data(), rows, rowBytes, rowBytes, 3).groups; }});
+    cases.push_back({"quality/measure", bytes, false, [=] {
+                         auto a = reinterpret_cast<const unsigned char*>(pixels->data());
+                         auto b = reinterpret_cast<const unsigned char*>(other->data());
+                         sink = sink + Quality::measure(a, b, rows, rowBytes, 3, 255).changedBytes;
+                     }});
+    auto plane = std::make_shared<std::vector<unsigned char>>(bytes);
+    for (std::uint16_t mask : {std::uint16_t{1}, std::uint16_t{3}}) {
+        cases.push_back({fmt::format("bitplanes/mask{}", mask), bytes, mask == 1, [=] {
+                             BitPlanes::extract(reinterpret_cast<const unsigned char*>(pixels->data()), plane->data(),
+                                                bytes, mask, false);
+                         }});
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--filter=")) settings.filter = arg.substr(9);
+        else if (arg.starts_with("--json=")) settings.json = arg.substr(7);
+        else if (arg.starts_with("--reps=")) settings.reps = std::max(1, std::atoi(arg.c_str() + 7));
+        else if (arg.starts_with("--min-time=")) settings.minTime = std::max(1, std::atoi(arg.c_str() + 11)) / 1e3;
+        else if (arg == "--quick") settings.quick = true;
+        else if (arg == "--list") settings.list = true;
+        else {
+            fmt::println("Usage: stego_bench [--filter=text] [--reps=N] [--min-time=ms] [--json=file] [--quick] [--list]");
+            fmt::println("--filter runs the cases whose name contains the text, --quick leaves out the biggest sizes.");
+            return 1;
+        }
+    }
+
+    fs::path dir = fs::temp_directory_path() / fmt::format("stego_bench_{}", Clock::now().time_since_epoch().count());
+    std::error_code error;
+    fs::create_directories(dir, error);
+    if (error) {
+        fmt::println("Failed to create {}.", dir.string());
+        return 1;
+    }
+
+    std::vector<Case> cases;
+    addLsbCases(cases, settings);
+    addFileCases(cases, settings, dir);
+    addKernelCases(cases, settings);
+    std::erase_if(cases, [&](const Case& c) { return c.name.find(settings.filter) == std::string::npos; });
+
+    // Every level up to what the CPU has, kernels without runtime dispatch only at the top one
+    std::vector<Cpu::Level> levels;
+    for (int level = 0; level <= static_cast<int>(Cpu::detected()); ++level) levels.push_back(static_cast<Cpu::Level>(level));
+    const Cpu::Level top = levels.back();
+
+    if (settings.list) {
+        for (const Case& c : cases) fmt::println("{}{}", c.name, c.dispatched ? " (per SIMD level)" : "");
+        fs::remove_all(dir, error);
+        return 0;
+    }
+
+    fmt::println("{:<36} {:>8} {:>14} {:>10} {:>8}", "benchmark", "simd", "ns/op", "MB/s", "stddev");
+    std::vector<Stats> results;
+    for (const Case& c : cases) {
+        for (Cpu::Level level : levels) {
+            if (!c.dispatched && level != top) continue;
+            Cpu::setCeiling(level);
+            Stats stats = measure(c, settings);
+            stats.level = Cpu::name(level);
+            fmt::println("{:<36} {:>8} {:>14.1f} {:>10.1f} {:>7.1f}%", stats.name, stats.level, stats.median,
+                         stats.megabytesPerSecond(), stats.mean > 0 ? stats.stddev / stats.mean * 100 : 0);
+            std::fflush(stdout);
+            results.push_back(stats);
+        }
+    }
+    Cpu::setCeiling(top);
+    fs::remove_all(dir, error);
+
+    if (!settings.json.empty() && !writeJson(settings.json, results, settings)) return 1;
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include "BitPlanes.h"
+#include "Cpu.h"
+#include "ImageHandler.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <fmt/core.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define STEGO_HAVE_AVX2 1
+#endif
+
+namespace BitPlanes {
+
+namespace {
+
+// Target size of one band of rows
+constexpr std::size_t bandBytes = std::size_t{4} << 20;
+
+inline unsigned char stretch(unsigned v, unsigned mask) { return static_cast<unsigned char>((v & mask) * 255 / mask); }
+
+// One bit of 8-bit samples: 255 where it is set, 0 elsewhere
+std::size_t singleBit8(const unsigned char* in, unsigned char* out, std::size_t n, unsigned char bit) {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i m = _mm_set1_epi8(static_cast<char>(bit));
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), m);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_cmpeq_epi8(v, m));
+    }
+#endif
+    return i;
+}
+
+// One bit of 16-bit samples: the byte holding the bit is taken from every sample first, then the same compare
+std::size_t singleBit16(const unsigned char* in, unsigned char* out, std::size_t n, unsigned char bit, bool high) {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i m = _mm_set1_epi8(static_cast<char>(bit)), low = _mm_set1_epi16(0x00FF);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16));
+        // Big endian: the high byte of a sample is the first (lower) byte of its 16-bit lane
+        a = high ? _mm_and_si128(a, low) : _mm_srli_epi16(a, 8);
+        b = high ? _mm_and_si128(b, low) : _mm_srli_epi16(b, 8);
+        __m128i v = _mm_and_si128(_mm_packus_epi16(a, b), m);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_cmpeq_epi8(v, m));
+    }
+#endif
+    return i;
+}
+
+#ifdef STEGO_HAVE_AVX2
+__attribute__((target("avx2")))
+std::size_t singleBit8Avx2(const unsigned char* in, unsigned char* out, std::size_t n, unsigned char bit) {
+    const __m256i m = _mm256_set1_epi8(static_cast<char>(bit));
+    std::size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), m);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cmpeq_epi8(v, m));
+    }
+    return i;
+}
+#endif
+
+// Where each output channel comes from and how the output is laid out
+struct Layout {
+    std::size_t width = 0;
+    int channels = 1;
+    std::array<int, 4> order{0, 1, 2, 3};
+    bool panels = false;
+
+    std::size_t outputWidth() const { return panels ? width * channels : width; }
+};
+
+// Function to move one row of plane bytes (in sample order) into its output layout
+void arrange(const unsigned char* plane, unsigned char* out, const Layout& layout) {
+    const std::size_t width = layout.width;
+    const int channels = layout.channels;
+    if (layout.panels) {
+        for (int c = 0; c < channels; ++c) {
+            const unsigned char* src = plane + layout.order[c];
+            unsigned char* dst = out + c * width;
+            for (std::size_t x = 0; x < width; ++x) dst[x] = src[x * channels];
+        }
+    } else if (channels == 3 && layout.order[0] != 0) {
+        for (std::size_t x = 0; x < width; ++x) {
+            out[3 * x] = plane[3 * x + 2];
+            out[3 * x + 1] = plane[3 * x + 1];
+            out[3 * x + 2] = plane[3 * x];
+        }
+    } else {
+        std::copy(plane, plane + width * channels, out);
+    }
+}
+
+} // namespace
+
+// Function to parse the list of bits
+bool parseBits(const std::string& text, std::uint16_t& mask) {
+    mask = 0;
+    std::istringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        bool digits = std::all_of(item.begin(), item.end(), [](unsigned char c) { return std::isdigit(c); });
+        if (item.empty() || item.size() > 2 || !digits) return false;
+        int bit = std::stoi(item);
+        if (bit > 15) return false;
+        mask |= static_cast<std::uint16_t>(1u << bit);
+    }
+    return mask != 0;
+}
+
+// Function to extract the planes of n samples
+void extract(const unsigned char* samples, unsigned char* out, std::size_t n, std::uint16_t mask, bool wide) {
+    std::size_t i = 0;
+    if (std::has_single_bit(mask)) {
+        // One bit is a compare, 16 or 32 samples at a time
+        const bool high = mask > 0xFF;
+        const auto bit = static_cast<unsigned char>(high ? mask >> 8 : mask);
+        if (wide) {
+            i = singleBit16(samples, out, n, bit, high);
+            for (; i < n; ++i) out[i] = samples[2 * i + (high ? 0 : 1)] & bit ? 255 : 0;
+            return;
+        }
+#ifdef STEGO_HAVE_AVX2
+        if (Cpu::hasAvx2()) i = singleBit8Avx2(samples, out, n, bit);
+#endif
+        i += singleBit8(samples + i, out + i, n - i, bit);
+        for (; i < n; ++i) out[i] = samples[i] & bit ? 255 : 0;
+        return;
+    }
+    if (wide) {
+        for (; i < n; ++i) out[i] = stretch(samples[2 * i] << 8 | samples[2 * i + 1], mask);
+        return;
+    }
+    // Several bits of 8-bit samples go through a table
+    std::array<unsigned char, 256> table;
+    for (unsigned v = 0; v < 256; ++v) table[v] = stretch(v, mask);
+    for (; i < n; ++i) out[i] = table[samples[i]];
+}
+
+// Function to export the bit-planes of an image
+bool exportPlanes(const std::string& filename, const std::string& output, std::uint16_t mask) {
+    ImageHandler::RowReader reader;
+    if (!reader.open(filename)) {
+        fmt::println("Failed to read image.");
+        return false;
+    }
+    const ImageHandler::ImageInfo& info = reader.imageInfo();
+    const bool wide = reader.bytesPerSample() == 2;
+    if (!wide && mask > 0xFF) {
+        fmt::println("The image has 8-bit samples, bits 0 to 7 can be exported.");
+        return false;
+    }
+
+    Layout layout;
+    layout.width = static_cast<std::size_t>(info.width);
+    layout.channels = info.channels;
+    layout.panels = info.channels != 1 && info.channels != 3;
+    if (info.format == ImageHandler::ImageFormat::Bmp && info.channels >= 3) layout.order = {2, 1, 0, 3};
+
+    std::ofstream file(output, std::ios::binary);
+    if (!file) {
+        fmt::println("Failed to open file for writing.");
+        return false;
+    }
+    const bool colour = !layout.panels && info.channels == 3;
+    const std::size_t height = static_cast<std::size_t>(info.height), rowBytes = reader.rowBytes();
+    const std::size_t samplesPerRow = layout.width * info.channels;
+    file << (colour ? "P6" : "P5") << '\n' << layout.outputWidth() << ' ' << height << "\n255\n";
+
+    const std::size_t bandRows = std::max<std::size_t>(1, bandBytes / std::max<std::size_t>(rowBytes, 1));
+    std::vector<unsigned char> band, plane(samplesPerRow), out;
+    for (std::size_t first = 0; first < height; first += bandRows) {
+        std::size_t count = std::min(bandRows, height - first);
+        if (!reader.read(first, count, band)) return false;
+        out.resize(count * samplesPerRow);
+        for (std::size_t r = 0; r < count; ++r) {
+            // Three channels already sit in output order unless they need swapping
+            bool direct = !layout.panels && layout.order[0] == 0;
+            unsigned char* target = direct ? out.data() + r * samplesPerRow : plane.data();
+            extract(band.data() + r * rowBytes, target, samplesPerRow, mask, wide);
+            if (!direct) arrange(plane.data(), out.data() + r * samplesPerRow, layout);
+        }
+        file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    }
+    if (!file) {
+        fmt::println("Failed to write {}.", output);
+        return false;
+    }
+    fmt::println("Wrote {} ({}x{} {}, bit mask 0x{:X}).", output, layout.outputWidth(), height,
+                 colour ? "PPM" : "PGM", mask);
+    return true;
+}
+
+} // namespace BitPlanes
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Bit-plane export (-bitplanes): the selected bits of every sample as an 8-bit greyscale/colour image, for looking
+// at what sits in the low bits of a carrier. A sample becomes 255 when it has the selected bit set (one bit), with
+// several bits the selected bits are kept in place and stretched to 0-255. All channels come out of the same pass:
+//  - 1 channel   -> PGM
+//  - 3 channels  -> PPM in RGB order (BMP files are BGR and get swapped)
+//  - 2, 4        -> PGM with one panel per channel side by side (R, G, B, A for BMP files)
+// The image is streamed in bands of rows into the output file, so BMP, binary PPM/PGM and PAM files take a few
+// MiB of memory whatever their size (the other formats are decoded once, as everywhere else).
+namespace BitPlanes {
+
+    // Function to parse a comma separated list of sample bits ("0", "0,1", "7"), bit 0 being the LSB
+    bool parseBits(const std::string& text, std::uint16_t& mask);
+
+    // Function to turn n samples into plane bytes, 8-bit samples or 16-bit big endian ones
+    void extract(const unsigned char* samples, unsigned char* out, std::size_t n, std::uint16_t mask, bool wide);
+
+    // Function to write the planes of the mask of an image into a PGM/PPM file
+    bool exportPlanes(const std::string& filename, const std::string& output, std::uint16_t mask);
+
+} // namespace BitPlanes
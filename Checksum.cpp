@@ -0,0 +1,70 @@
+#include "Checksum.h"
+#include "Cpu.h"
+#include <array>
+#include <cstring>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define STEGO_HAVE_SSE42 1
+#endif
+
+namespace Checksum {
+
+namespace {
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes
+const auto tables = [] {
+    std::array<std::array<std::uint32_t, 256>, 8> result{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0x82F63B78u ^ (c >> 1) : c >> 1;
+        result[0][i] = c;
+    }
+    for (int slice = 1; slice < 8; ++slice) {
+        for (int i = 0; i < 256; ++i) {
+            result[slice][i] = (result[slice - 1][i] >> 8) ^ result[0][result[slice - 1][i] & 255];
+        }
+    }
+    return result;
+}();
+
+// Both versions work on the inverted running value
+std::uint32_t updateTables(std::uint32_t crc, const unsigned char* data, std::size_t size) {
+    const auto& t = tables;
+    while (size >= 8) {
+        std::uint32_t low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<std::uint32_t>(data[3]) << 24));
+        crc = t[7][low & 255] ^ t[6][(low >> 8) & 255] ^ t[5][(low >> 16) & 255] ^ t[4][low >> 24] ^
+              t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = t[0][(crc ^ *data++) & 255] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if STEGO_HAVE_SSE42
+__attribute__((target("sse4.2"))) std::uint32_t updateSse42(std::uint32_t crc, const unsigned char* data, std::size_t size) {
+    std::uint64_t value = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data, 8);
+        value = _mm_crc32_u64(value, word);
+    }
+    crc = static_cast<std::uint32_t>(value);
+    while (size-- > 0) crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+#endif
+
+} // namespace
+
+// Function to compute the CRC-32C of data
+std::uint32_t crc32c(const unsigned char* data, std::size_t size, std::uint32_t crc) {
+#if STEGO_HAVE_SSE42
+    if (Cpu::hasSse42()) return ~updateSse42(~crc, data, size);
+#endif
+    return ~updateTables(~crc, data, size);
+}
+
+} // namespace Checksum
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Payload integrity checksum: CRC-32C (Castagnoli, polynomial 0x82F63B78).
+// x86-64 CPUs with SSE4.2 compute it with the crc32 instruction, 8 bytes per step; others use slicing-by-8 tables.
+namespace Checksum {
+
+    // Function to compute the CRC-32C of data, pass the previous value to continue a running checksum
+    std::uint32_t crc32c(const unsigned char* data, std::size_t size, std::uint32_t crc = 0);
+
+} // namespace Checksum
@@ -0,0 +1,354 @@
+#include "Corpus.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <fmt/core.h>
+
+namespace Corpus {
+
+namespace {
+
+// Target size of one band of rows, one band per thread is in memory at a time
+constexpr std::size_t bandBytes = std::size_t{4} << 20;
+constexpr std::size_t payloadBlock = std::size_t{1} << 20;
+
+struct Geometry {
+    int channels = 3;
+    int bytesPerSample = 1;
+    std::size_t rowBytes = 0;
+    std::size_t rowStride = 0;
+    std::size_t headerBytes = 0;
+    bool bmp = false;
+};
+
+std::string netpbmHeader(const ImageSpec& spec, const Geometry& g) {
+    char magic = g.channels == 1 ? '5' : '6';
+    return fmt::format("P{}\n{} {}\n{}\n", magic, spec.width, spec.height, g.bytesPerSample == 2 ? 65535 : 255);
+}
+
+Geometry geometryOf(const ImageSpec& spec) {
+    Geometry g;
+    g.bmp = spec.format == Format::Bmp24 || spec.format == Format::Bmp32;
+    g.channels = spec.format == Format::Bmp32 ? 4 : spec.format == Format::Pgm8 || spec.format == Format::Pgm16 ? 1 : 3;
+    g.bytesPerSample = spec.format == Format::Ppm16 || spec.format == Format::Pgm16 ? 2 : 1;
+    g.rowBytes = static_cast<std::size_t>(spec.width) * g.channels * g.bytesPerSample;
+    // BMP rows are padded to 4 bytes, odd widths of 24-bit images get padding
+    g.rowStride = g.bmp ? (g.rowBytes + 3) & ~std::size_t{3} : g.rowBytes;
+    g.headerBytes = g.bmp ? 54 : netpbmHeader(spec, g).size();
+    return g;
+}
+
+void putLE32(unsigned char* p, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+// BITMAPFILEHEADER + BITMAPINFOHEADER, bottom-up rows, no compression
+std::string bmpHeader(const ImageSpec& spec, const Geometry& g) {
+    unsigned char header[54] = {'B', 'M'};
+    std::uint64_t pixelBytes = static_cast<std::uint64_t>(g.rowStride) * spec.height;
+    putLE32(header + 2, static_cast<std::uint32_t>(54 + pixelBytes));
+    putLE32(header + 10, 54);
+    putLE32(header + 14, 40);
+    putLE32(header + 18, spec.width);
+    putLE32(header + 22, spec.height);
+    header[26] = 1;
+    header[28] = static_cast<unsigned char>(g.channels * 8);
+    putLE32(header + 34, static_cast<std::uint32_t>(pixelBytes));
+    return std::string(reinterpret_cast<char*>(header), sizeof(header));
+}
+
+// Smooth ramps: red across, green down, blue (and grey) along the diagonal, alpha opaque
+struct Gradient {
+    std::vector<std::uint16_t> across, diagonal;
+    std::uint32_t height = 1;
+    unsigned maxValue = 255;
+
+    Gradient(const ImageSpec& spec, unsigned maxValue) : height(spec.height), maxValue(maxValue) {
+        across.resize(spec.width);
+        diagonal.resize(static_cast<std::size_t>(spec.width) + spec.height);
+        std::uint64_t w = std::max<std::uint32_t>(spec.width - 1, 1), d = std::max<std::uint64_t>(diagonal.size() - 2, 1);
+        for (std::size_t x = 0; x < across.size(); ++x) across[x] = static_cast<std::uint16_t>(x * maxValue / w);
+        for (std::size_t i = 0; i < diagonal.size(); ++i) {
+            diagonal[i] = static_cast<std::uint16_t>(std::min<std::uint64_t>(i * maxValue / d, maxValue));
+        }
+    }
+    unsigned down(std::uint32_t y) const {
+        return static_cast<unsigned>(static_cast<std::uint64_t>(y) * maxValue / std::max<std::uint32_t>(height - 1, 1));
+    }
+};
+
+// Function to fill one row of the file; `y` counts image rows from the top
+void fillRow(const ImageSpec& spec, const Geometry& g, const Gradient* gradient, std::uint32_t y, unsigned char* row) {
+    std::fill(row + g.rowBytes, row + g.rowStride, 0);
+    if (spec.pattern == Pattern::Noise) {
+        Random random(spec.seed, y);
+        std::size_t i = 0;
+        for (; i + 8 <= g.rowBytes; i += 8) {
+            std::uint64_t value = random.next();
+            std::memcpy(row + i, &value, 8);
+        }
+        std::uint64_t value = random.next();
+        for (; i < g.rowBytes; ++i, value >>= 8) row[i] = static_cast<unsigned char>(value);
+        return;
+    }
+    const unsigned down = gradient->down(y);
+    const std::uint16_t* diagonal = gradient->diagonal.data() + y;
+    auto put = [&](unsigned char*& p, unsigned value) {
+        if (g.bytesPerSample == 2) *p++ = static_cast<unsigned char>(value >> 8); // Netpbm is big endian
+        *p++ = static_cast<unsigned char>(value);
+    };
+    unsigned char* p = row;
+    for (std::uint32_t x = 0; x < spec.width; ++x) {
+        unsigned across = gradient->across[x], diag = diagonal[x];
+        if (g.channels == 1) {
+            put(p, diag);
+        } else if (g.bmp) {
+            put(p, diag);
+            put(p, down);
+            put(p, across);
+            if (g.channels == 4) put(p, 255);
+        } else {
+            put(p, across);
+            put(p, down);
+            put(p, diag);
+        }
+    }
+}
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    if (text.size() < suffix.size()) return false;
+    std::string tail = text.substr(text.size() - suffix.size());
+    std::transform(tail.begin(), tail.end(), tail.begin(), [](unsigned char c) { return std::tolower(c); });
+    return tail == suffix;
+}
+
+} // namespace
+
+bool parseFormat(const std::string& text, Format& format) {
+    static const std::pair<const char*, Format> names[] = {{"bmp24", Format::Bmp24}, {"bmp32", Format::Bmp32},
+                                                           {"ppm8", Format::Ppm8},   {"ppm16", Format::Ppm16},
+                                                           {"pgm8", Format::Pgm8},   {"pgm16", Format::Pgm16}};
+    for (const auto& [name, value] : names) {
+        if (text == name) {
+            format = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parsePattern(const std::string& text, Pattern& pattern) {
+    if (text == "noise") pattern = Pattern::Noise;
+    else if (text == "gradient") pattern = Pattern::Gradient;
+    else return false;
+    return true;
+}
+
+bool parseKind(const std::string& text, PayloadKind& kind) {
+    if (text == "text") kind = PayloadKind::Text;
+    else if (text == "random") kind = PayloadKind::Random;
+    else return false;
+    return true;
+}
+
+const char* name(Format format) {
+    switch (format) {
+        case Format::Bmp24: return "bmp24";
+        case Format::Bmp32: return "bmp32";
+        case Format::Ppm8: return "ppm8";
+        case Format::Ppm16: return "ppm16";
+        case Format::Pgm8: return "pgm8";
+        case Format::Pgm16: return "pgm16";
+    }
+    return "?";
+}
+
+const char* name(Pattern pattern) { return pattern == Pattern::Noise ? "noise" : "gradient"; }
+
+const char* extension(Format format) {
+    switch (format) {
+        case Format::Bmp24:
+        case Format::Bmp32: return ".bmp";
+        case Format::Ppm8:
+        case Format::Ppm16: return ".ppm";
+        case Format::Pgm8:
+        case Format::Pgm16: return ".pgm";
+    }
+    return "";
+}
+
+bool formatFromExtension(const std::string& filename, Format& format) {
+    if (endsWith(filename, ".bmp")) format = Format::Bmp24;
+    else if (endsWith(filename, ".ppm")) format = Format::Ppm8;
+    else if (endsWith(filename, ".pgm")) format = Format::Pgm8;
+    else return false;
+    return true;
+}
+
+// Function to parse a size like 4096, 64K, 3G
+bool parseSize(const std::string& text, std::uint64_t& size) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) return false;
+    std::size_t end = 0;
+    unsigned long long value = std::stoull(text, &end);
+    std::string suffix = text.substr(end);
+    int shift = suffix.empty() ? 0 : suffix == "K" || suffix == "k" ? 10 : suffix == "M" || suffix == "m" ? 20
+              : suffix == "G" || suffix == "g" ? 30 : -1;
+    if (shift < 0 || value > (std::numeric_limits<std::uint64_t>::max() >> shift)) return false;
+    size = static_cast<std::uint64_t>(value) << shift;
+    return true;
+}
+
+std::uint64_t fileSize(const ImageSpec& spec) {
+    Geometry g = geometryOf(spec);
+    return g.headerBytes + static_cast<std::uint64_t>(g.rowStride) * spec.height;
+}
+
+// Function to write an image, bands of rows generated on every core and written in order
+bool writeImage(const std::string& filename, const ImageSpec& spec) {
+    if (spec.width == 0 || spec.height == 0 || spec.width > 0x7FFFFFFF || spec.height > 0x7FFFFFFF) {
+        fmt::println("Invalid image size {}x{}.", spec.width, spec.height);
+        return false;
+    }
+    Geometry g = geometryOf(spec);
+    if (g.bmp && fileSize(spec) > std::numeric_limits<std::uint32_t>::max()) {
+        fmt::println("BMP files are limited to 4 GiB, use a PPM/PGM format for bigger images.");
+        return false;
+    }
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        fmt::println("Failed to open file for writing.");
+        return false;
+    }
+    std::string header = g.bmp ? bmpHeader(spec, g) : netpbmHeader(spec, g);
+    file.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+    std::unique_ptr<Gradient> gradient;
+    if (spec.pattern == Pattern::Gradient) gradient = std::make_unique<Gradient>(spec, g.bytesPerSample == 2 ? 65535 : 255);
+
+    const std::size_t height = spec.height;
+    const std::size_t bandRows = std::max<std::size_t>(1, bandBytes / g.rowStride);
+    const std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::vector<unsigned char>> bands(threads);
+    for (std::size_t first = 0; first < height; first += bandRows * threads) {
+        std::atomic<std::size_t> next{0};
+        auto worker = [&] {
+            for (std::size_t b; (b = next.fetch_add(1)) < threads;) {
+                std::size_t begin = first + b * bandRows;
+                if (begin >= height) {
+                    bands[b].clear();
+                    continue;
+                }
+                std::size_t count = std::min(bandRows, height - begin);
+                bands[b].resize(count * g.rowStride);
+                for (std::size_t r = 0; r < count; ++r) {
+                    std::size_t fileRow = begin + r;
+                    auto y = static_cast<std::uint32_t>(g.bmp ? height - 1 - fileRow : fileRow);
+                    fillRow(spec, g, gradient.get(), y, bands[b].data() + r * g.rowStride);
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (std::size_t t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (std::thread& thread : pool) thread.join();
+        for (const auto& band : bands) {
+            file.write(reinterpret_cast<const char*>(band.data()), static_cast<std::streamsize>(band.size()));
+        }
+    }
+    if (!file) {
+        fmt::println("Failed to write {}.", filename);
+        return false;
+    }
+    return true;
+}
+
+// Function to write a payload block by block
+bool writePayload(const std::string& filename, std::uint64_t size, PayloadKind kind, std::uint64_t seed) {
+    static const char* words[] = {"audit", "record", "image", "carrier", "payload", "2024-06-01", "status=ok",
+                                  "user", "id", "the", "of", "and", "frame", "checksum", "batch", "node-17"};
+    std::ofstream file(filename, std::ios::binary);
+    if (!file) {
+        fmt::println("Failed to open file for writing.");
+        return false;
+    }
+    std::string block;
+    for (std::uint64_t offset = 0, index = 0; offset < size; offset += payloadBlock, ++index) {
+        std::size_t count = static_cast<std::size_t>(std::min<std::uint64_t>(payloadBlock, size - offset));
+        Random random(seed, index);
+        block.clear();
+        if (kind == PayloadKind::Random) {
+            block.resize(count + 8);
+            for (std::size_t i = 0; i < count; i += 8) {
+                std::uint64_t value = random.next();
+                std::memcpy(&block[i], &value, 8);
+            }
+        } else {
+            while (block.size() < count) {
+                std::uint64_t value = random.next();
+                block += words[value >> 60];
+                block += (value & 7) == 0 ? '\n' : ' ';
+            }
+        }
+        file.write(block.data(), static_cast<std::streamsize>(count));
+    }
+    if (!file) {
+        fmt::println("Failed to write {}.", filename);
+        return false;
+    }
+    return true;
+}
+
+// Function to write the standard corpus
+std::vector<std::string> writeStandardCorpus(const std::string& directory, int scale, std::uint64_t seed) {
+    struct Image {
+        Format format;
+        Pattern pattern;
+        std::uint32_t width, height;
+    };
+    // Odd widths everywhere, so BMP rows get padding and no kernel sees a multiple of 8 or 16
+    const std::uint32_t s = static_cast<std::uint32_t>(std::max(scale, 1));
+    const Image images[] = {
+        {Format::Bmp24, Pattern::Noise, 1023 * s, 767},     {Format::Bmp24, Pattern::Gradient, 1023 * s, 767},
+        {Format::Bmp24, Pattern::Noise, 4001 * s, 2999},    {Format::Bmp32, Pattern::Noise, 1021 * s, 765},
+        {Format::Bmp32, Pattern::Gradient, 1021 * s, 765},  {Format::Ppm8, Pattern::Noise, 1921 * s, 1081},
+        {Format::Ppm8, Pattern::Gradient, 1921 * s, 1081},  {Format::Ppm16, Pattern::Noise, 1279 * s, 719},
+        {Format::Ppm16, Pattern::Gradient, 1279 * s, 719},  {Format::Pgm8, Pattern::Noise, 2047 * s, 1535},
+        {Format::Pgm8, Pattern::Gradient, 2047 * s, 1535},  {Format::Pgm16, Pattern::Noise, 1001 * s, 999},
+    };
+    struct Payload {
+        PayloadKind kind;
+        std::uint64_t size;
+    };
+    const Payload payloads[] = {{PayloadKind::Text, 1 << 10}, {PayloadKind::Text, 64 << 10},
+                                {PayloadKind::Text, 1 << 20}, {PayloadKind::Random, 64 << 10},
+                                {PayloadKind::Random, 1 << 20}};
+
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::vector<std::string> files;
+    std::uint64_t index = 0;
+    for (const Image& image : images) {
+        ImageSpec spec{image.format, image.pattern, image.width, image.height, seed + index++};
+        std::string name = fmt::format("{}_{}_{}x{}{}", Corpus::name(image.format), Corpus::name(image.pattern),
+                                       image.width, image.height, extension(image.format));
+        if (!writeImage((std::filesystem::path(directory) / name).string(), spec)) return {};
+        files.push_back(name);
+    }
+    for (const Payload& payload : payloads) {
+        std::string name = fmt::format("payload_{}_{}.txt", payload.kind == PayloadKind::Text ? "text" : "random",
+                                       payload.size);
+        if (!writePayload((std::filesystem::path(directory) / name).string(), payload.size, payload.kind, seed + index++)) {
+            return {};
+        }
+        files.push_back(name);
+    }
+    return files;
+}
+
+} // namespace Corpus
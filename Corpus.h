@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Deterministic synthetic carriers and payloads for benchmarks and load tests (stego_gen, the perf harness).
+// The same seed gives the same bytes on every machine and with any thread count: every row of an image (and every
+// block of a payload) has its own generator seeded from (seed, index). Images are generated in bands of rows on all
+// cores and streamed to the file in order, so a multi-GiB image takes a few bands of memory.
+namespace Corpus {
+
+    inline std::uint64_t splitmix(std::uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    // xorshift64, one generator per row / block seeded from (seed, index), never with 0
+    struct Random {
+        std::uint64_t state;
+        explicit Random(std::uint64_t seed, std::uint64_t index = 0) : state(splitmix(seed ^ splitmix(index)) | 1) {}
+        std::uint64_t next() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+    };
+
+    enum class Format { Bmp24, Bmp32, Ppm8, Ppm16, Pgm8, Pgm16 };
+    enum class Pattern { Noise, Gradient };
+    enum class PayloadKind { Text, Random };
+
+    struct ImageSpec {
+        Format format = Format::Bmp24;
+        Pattern pattern = Pattern::Noise;
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::uint64_t seed = 1;
+    };
+
+    bool parseFormat(const std::string& text, Format& format);
+    bool parsePattern(const std::string& text, Pattern& pattern);
+    bool parseKind(const std::string& text, PayloadKind& kind);
+    const char* name(Format format);
+    const char* name(Pattern pattern);
+    const char* extension(Format format);
+
+    // Function to pick the format from a file name (.bmp, .ppm, .pgm: the 8-bit variants)
+    bool formatFromExtension(const std::string& filename, Format& format);
+
+    // Function to parse a byte count with an optional K, M or G suffix (powers of 1024)
+    bool parseSize(const std::string& text, std::uint64_t& size);
+
+    // Total file size of an image, header included
+    std::uint64_t fileSize(const ImageSpec& spec);
+
+    // Function to write a synthetic image
+    bool writeImage(const std::string& filename, const ImageSpec& spec);
+
+    // Function to write a synthetic payload: text (words, compresses about 3x) or random bytes
+    bool writePayload(const std::string& filename, std::uint64_t size, PayloadKind kind, std::uint64_t seed);
+
+    // Function to write the standard corpus into a directory: every format at odd widths, noise and gradients,
+    // text and random payloads. Widths grow with `scale`. Returns the files written, in a fixed order.
+    std::vector<std::string> writeStandardCorpus(const std::string& directory, int scale, std::uint64_t seed);
+
+} // namespace Corpus
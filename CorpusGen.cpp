@@ -0,0 +1,97 @@
+#include "Corpus.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fmt/core.h>
+
+// Seeded synthetic carriers and payloads for benchmarks and load tests, the same seed always gives the same bytes:
+//   stego_gen image big.ppm 40000 30000 --pattern=noise      (3.6 GB, streamed)
+//   stego_gen payload msg.txt 1M --kind=text
+//   stego_gen corpus corpus/ --scale=2
+
+namespace {
+
+void printUsage() {
+    fmt::println("Usage:");
+    fmt::println("stego_gen image [file] [width] [height] [--format=bmp24|bmp32|ppm8|ppm16|pgm8|pgm16] [--pattern=noise|gradient] [--seed=N]");
+    fmt::println("stego_gen payload [file] [bytes] [--kind=text|random] [--seed=N]");
+    fmt::println("stego_gen corpus [directory] [--scale=N] [--seed=N]");
+    fmt::println("Sizes take a K, M or G suffix. The format defaults to the 8-bit one of the file extension.");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args, options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        (arg.starts_with("--") ? options : args).push_back(arg);
+    }
+    if (args.empty()) {
+        printUsage();
+        return 1;
+    }
+
+    std::uint64_t seed = 1, scale = 1;
+    bool formatGiven = false;
+    Corpus::ImageSpec spec;
+    Corpus::PayloadKind kind = Corpus::PayloadKind::Text;
+    for (const std::string& option : options) {
+        std::size_t eq = option.find('=');
+        std::string key = option.substr(0, eq), value = eq == std::string::npos ? "" : option.substr(eq + 1);
+        bool ok = true;
+        if (key == "--seed") ok = Corpus::parseSize(value, seed);
+        else if (key == "--scale") ok = Corpus::parseSize(value, scale) && scale > 0 && scale <= 64;
+        else if (key == "--format") ok = formatGiven = Corpus::parseFormat(value, spec.format);
+        else if (key == "--pattern") ok = Corpus::parsePattern(value, spec.pattern);
+        else if (key == "--kind") ok = Corpus::parseKind(value, kind);
+        else ok = false;
+        if (!ok) {
+            fmt::println("Invalid option {}.", option);
+            return 1;
+        }
+    }
+    spec.seed = seed;
+
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t written = 0;
+    const std::string& command = args[0];
+    if (command == "image" && args.size() == 4) {
+        std::uint64_t width = 0, height = 0;
+        if (!Corpus::parseSize(args[2], width) || !Corpus::parseSize(args[3], height) || width > 0x7FFFFFFF ||
+            height > 0x7FFFFFFF) {
+            fmt::println("Invalid image size.");
+            return 1;
+        }
+        if (!formatGiven && !Corpus::formatFromExtension(args[1], spec.format)) {
+            fmt::println("Give --format, the file extension is not .bmp, .ppm or .pgm.");
+            return 1;
+        }
+        spec.width = static_cast<std::uint32_t>(width);
+        spec.height = static_cast<std::uint32_t>(height);
+        if (!Corpus::writeImage(args[1], spec)) return 1;
+        written = Corpus::fileSize(spec);
+        fmt::println("Wrote {} ({} {} {}x{}, seed {}).", args[1], Corpus::name(spec.format), Corpus::name(spec.pattern),
+                     spec.width, spec.height, seed);
+    } else if (command == "payload" && args.size() == 3) {
+        if (!Corpus::parseSize(args[2], written)) {
+            fmt::println("Invalid payload size.");
+            return 1;
+        }
+        if (!Corpus::writePayload(args[1], written, kind, seed)) return 1;
+        fmt::println("Wrote {} ({} bytes of {}, seed {}).", args[1], written,
+                     kind == Corpus::PayloadKind::Text ? "text" : "random bytes", seed);
+    } else if (command == "corpus" && args.size() == 2) {
+        std::vector<std::string> files = Corpus::writeStandardCorpus(args[1], static_cast<int>(scale), seed);
+        if (files.empty()) return 1;
+        for (const std::string& file : files) fmt::println("{}", file);
+        fmt::println("Wrote {} files into {}.", files.size(), args[1]);
+    } else {
+        printUsage();
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (written > (std::uint64_t{64} << 20)) fmt::println("{:.0f} MB/s", written / seconds / 1e6);
+    return 0;
+}
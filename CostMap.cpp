@@ -0,0 +1,153 @@
+#include "CostMap.h"
+#include "ImageKernels.h"
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <thread>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace CostMap {
+
+namespace {
+
+// (|Gx| + |Gy|) / 2 of the Sobel kernels over v >> 1, saturated to a byte. a, b, c are the rows above, at and
+// below the byte, s the distance to the horizontal neighbours.
+inline std::uint8_t gradient(const unsigned char* a, const unsigned char* b, const unsigned char* c, std::size_t s) {
+    auto v = [](const unsigned char* p) { return static_cast<int>(*p >> 1); };
+    int gx = (v(a + s) + 2 * v(b + s) + v(c + s)) - (v(a - s) + 2 * v(b - s) + v(c - s));
+    int gy = (v(c - s) + 2 * v(c) + v(c + s)) - (v(a - s) + 2 * v(a) + v(a + s));
+    return static_cast<std::uint8_t>(std::min(255, (std::abs(gx) + std::abs(gy)) >> 1));
+}
+
+#if defined(__SSE2__)
+// The 16 bytes at p as two vectors of 16-bit lanes holding byte >> 1
+inline void loadHalves(const unsigned char* p, __m128i& low, __m128i& high) {
+    const __m128i upper7 = _mm_set1_epi8(0x7F);
+    __m128i bytes = _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), 1), upper7);
+    low = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+    high = _mm_unpackhi_epi8(bytes, _mm_setzero_si128());
+}
+
+// 16 gradient values at once: 9 unaligned loads, the Sobel sums in 16-bit lanes, one saturating pack
+inline __m128i gradient16(const unsigned char* a, const unsigned char* b, const unsigned char* c, std::size_t s) {
+    __m128i al[3], ah[3], bl[2], bh[2], cl[3], ch[3];
+    loadHalves(a - s, al[0], ah[0]);
+    loadHalves(a, al[1], ah[1]);
+    loadHalves(a + s, al[2], ah[2]);
+    loadHalves(b - s, bl[0], bh[0]);
+    loadHalves(b + s, bl[1], bh[1]);
+    loadHalves(c - s, cl[0], ch[0]);
+    loadHalves(c, cl[1], ch[1]);
+    loadHalves(c + s, cl[2], ch[2]);
+    auto half = [](const __m128i* above, const __m128i* side, const __m128i* below) {
+        __m128i gx = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(above[2], below[2]), _mm_add_epi16(side[1], side[1])),
+                                   _mm_add_epi16(_mm_add_epi16(above[0], below[0]), _mm_add_epi16(side[0], side[0])));
+        __m128i gy = _mm_sub_epi16(_mm_add_epi16(_mm_add_epi16(below[0], below[2]), _mm_add_epi16(below[1], below[1])),
+                                   _mm_add_epi16(_mm_add_epi16(above[0], above[2]), _mm_add_epi16(above[1], above[1])));
+        return _mm_srli_epi16(_mm_add_epi16(ImageKernels::abs16(gx), ImageKernels::abs16(gy)), 1);
+    };
+    return _mm_packus_epi16(half(al, bl, cl), half(ah, bh, ch));
+}
+#endif
+
+// Rows [rowFirst, rowLast) of the map and the histogram of their values
+void buildRows(const unsigned char* data, const Geometry& geometry, std::size_t rowFirst, std::size_t rowLast,
+               std::uint8_t* map, Histogram& histogram) {
+    const std::size_t stride = geometry.rowStride, s = geometry.step;
+    ImageKernels::BankedHistogram banks;
+    std::size_t borderCount = 0;
+    for (std::size_t y = rowFirst; y < rowLast; ++y) {
+        std::uint8_t* out = map + y * stride;
+        if (y == 0 || y + 1 >= geometry.rows || stride <= 2 * s) {
+            std::fill(out, out + stride, 0);
+            borderCount += stride;
+            continue;
+        }
+        const unsigned char* a = data + (y - 1) * stride;
+        const unsigned char* b = a + stride;
+        const unsigned char* c = b + stride;
+        std::fill(out, out + s, 0);
+        std::fill(out + stride - s, out + stride, 0);
+        borderCount += 2 * s;
+        std::size_t x = s;
+#if defined(__SSE2__)
+        for (; x + 16 + s <= stride; x += 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), gradient16(a + x, b + x, c + x, s));
+        }
+#endif
+        for (; x + s < stride; ++x) out[x] = gradient(a + x, b + x, c + x, s);
+
+        banks.add(out + s, stride - 2 * s);
+        banks.flush(histogram);
+    }
+    histogram[0] += borderCount;
+}
+
+} // namespace
+
+// Function to compute the gradient map and its histogram, row bands on separate threads
+std::vector<std::uint8_t> build(const char* data, const Geometry& geometry, Histogram& histogram) {
+    std::vector<std::uint8_t> map(geometry.rowStride * geometry.rows);
+    histogram.fill(0);
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+
+    std::size_t threads = 1;
+    if (map.size() >= (std::size_t{1} << 22)) {
+        threads = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), geometry.rows);
+    }
+    if (threads == 1) {
+        buildRows(bytes, geometry, 0, geometry.rows, map.data(), histogram);
+        return map;
+    }
+    // Every band reads one row above and below itself, but only writes its own rows
+    std::vector<Histogram> parts(threads, Histogram{});
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < threads; ++t) {
+        pool.emplace_back(buildRows, bytes, std::cref(geometry), geometry.rows * t / threads,
+                          geometry.rows * (t + 1) / threads, map.data(), std::ref(parts[t]));
+    }
+    for (auto& thread : pool) thread.join();
+    for (const auto& part : parts) {
+        for (int v = 0; v < 256; ++v) histogram[v] += part[v];
+    }
+    return map;
+}
+
+// Function to pick the highest threshold that leaves enough bytes
+int threshold(const Histogram& histogram, std::size_t needed) {
+    std::size_t count = 0;
+    for (int v = 255; v >= 0; --v) {
+        count += histogram[v];
+        if (count >= needed) return v;
+    }
+    return -1;
+}
+
+// Function to list the selected positions
+std::vector<std::uint32_t> select(const std::vector<std::uint8_t>& map, std::size_t first, int threshold,
+                                  std::size_t count) {
+    std::vector<std::uint32_t> positions;
+    positions.reserve(count);
+    std::size_t i = first;
+    const auto limit = static_cast<std::uint8_t>(threshold);
+#if defined(__SSE2__)
+    // Bytes >= limit are the ones max(byte, limit) leaves unchanged, the mask bits are walked lowest first
+    const __m128i bound = _mm_set1_epi8(static_cast<char>(limit));
+    for (; i + 16 <= map.size() && positions.size() < count; i += 16) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(map.data() + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(values, bound), values));
+        while (mask && positions.size() < count) {
+            positions.push_back(static_cast<std::uint32_t>(i + std::countr_zero(mask)));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < map.size() && positions.size() < count; ++i) {
+        if (map[i] >= limit) positions.push_back(static_cast<std::uint32_t>(i));
+    }
+    return positions;
+}
+
+} // namespace CostMap
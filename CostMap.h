@@ -0,0 +1,34 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Content-adaptive carrier selection behind --adaptive.
+// Every carrier byte gets a cost value from a Sobel gradient over its neighbours of the same channel, using only
+// their upper 7 bits. Textured regions get high values, flat ones low values, and payload samples go to the bytes
+// whose value reaches a threshold, in scan order. LSB changes never move the map, so the extractor rebuilds the
+// same selection from the carrier it is given.
+namespace CostMap {
+
+    // Bytes are `rows` rows of `rowStride` bytes, horizontal neighbours of the same channel are `step` bytes apart
+    struct Geometry {
+        std::size_t rowStride = 0;
+        std::size_t rows = 0;
+        std::size_t step = 1;
+    };
+
+    using Histogram = std::array<std::size_t, 256>;
+
+    // Function to compute the gradient value (0..255) of every byte and their histogram in one pass over the data.
+    // Border bytes get 0, the map is rowStride * rows bytes.
+    std::vector<std::uint8_t> build(const char* data, const Geometry& geometry, Histogram& histogram);
+
+    // Function to pick the highest threshold that leaves at least `needed` bytes at or above it, -1 if none does
+    int threshold(const Histogram& histogram, std::size_t needed);
+
+    // Function to list up to `count` positions from `first` on whose value reaches the threshold, in increasing order
+    std::vector<std::uint32_t> select(const std::vector<std::uint8_t>& map, std::size_t first, int threshold,
+                                      std::size_t count);
+
+} // namespace CostMap
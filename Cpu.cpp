@@ -0,0 +1,73 @@
+#include "Cpu.h"
+#include <atomic>
+#include <cstdlib>
+
+namespace Cpu {
+
+namespace {
+
+// What the CPU has, asked once
+struct Features {
+    bool ssse3 = false, sse42 = false, avx2 = false;
+};
+
+const Features& features() {
+    static const Features cpu = [] {
+        Features f;
+#if defined(__GNUC__) && defined(__x86_64__)
+        f.ssse3 = __builtin_cpu_supports("ssse3");
+        f.sse42 = __builtin_cpu_supports("sse4.2");
+        f.avx2 = __builtin_cpu_supports("avx2");
+#endif
+        return f;
+    }();
+    return cpu;
+}
+
+std::atomic<int>& current() {
+    static std::atomic<int> level = [] {
+        Level start = Level::Avx2;
+        const char* text = std::getenv("STEGO_SIMD");
+        if (text) parseLevel(text, start);
+        return static_cast<int>(start);
+    }();
+    return level;
+}
+
+bool allowed(Level level) { return current().load(std::memory_order_relaxed) >= static_cast<int>(level); }
+
+} // namespace
+
+Level ceiling() { return static_cast<Level>(current().load(std::memory_order_relaxed)); }
+
+void setCeiling(Level level) { current().store(static_cast<int>(level), std::memory_order_relaxed); }
+
+// Function to parse a level name
+bool parseLevel(const std::string& text, Level& level) {
+    if (text == "baseline") level = Level::Baseline;
+    else if (text == "sse4") level = Level::Sse4;
+    else if (text == "avx2") level = Level::Avx2;
+    else return false;
+    return true;
+}
+
+const char* name(Level level) {
+    switch (level) {
+        case Level::Baseline: return "baseline";
+        case Level::Sse4: return "sse4";
+        case Level::Avx2: return "avx2";
+    }
+    return "?";
+}
+
+Level detected() {
+    if (features().avx2) return Level::Avx2;
+    if (features().ssse3 && features().sse42) return Level::Sse4;
+    return Level::Baseline;
+}
+
+bool hasSsse3() { return features().ssse3 && allowed(Level::Sse4); }
+bool hasSse42() { return features().sse42 && allowed(Level::Sse4); }
+bool hasAvx2() { return features().avx2 && allowed(Level::Avx2); }
+
+} // namespace Cpu
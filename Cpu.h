@@ -0,0 +1,25 @@
+#pragma once
+#include <string>
+
+// Instruction sets picked at runtime. Kernels built for the compiler's baseline (SSE2 on x86-64) always run,
+// the SSSE3/SSE4.2 and AVX2 ones only when the CPU has them and the ceiling allows them. The ceiling starts at
+// STEGO_SIMD=baseline|sse4|avx2 (everything the CPU has when unset), benchmarks lower it to compare the variants.
+namespace Cpu {
+
+    enum class Level { Baseline, Sse4, Avx2 };
+
+    Level ceiling();
+    void setCeiling(Level level);
+
+    // Function to parse "baseline", "sse4" or "avx2"
+    bool parseLevel(const std::string& text, Level& level);
+    const char* name(Level level);
+
+    // Highest level this CPU reaches
+    Level detected();
+
+    bool hasSsse3();
+    bool hasSse42();
+    bool hasAvx2();
+
+} // namespace Cpu
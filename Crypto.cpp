@@ -0,0 +1,358 @@
+#include "Crypto.h"
+#include "Cpu.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <fmt/core.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define STEGO_HAVE_AVX2 1
+#endif
+
+namespace Crypto {
+
+namespace {
+
+std::uint32_t load32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+void store32(unsigned char* p, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+std::uint32_t rotl(std::uint32_t value, int shift) {
+    return (value << shift) | (value >> (32 - shift));
+}
+
+void initState(std::uint32_t state[16], const Key& key, const Nonce& nonce, std::uint32_t counter) {
+    state[0] = 0x61707865; // "expand 32-byte k"
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    for (int i = 0; i < 8; ++i) state[4 + i] = load32(key.data() + 4 * i);
+    state[12] = counter;
+    for (int i = 0; i < 3; ++i) state[13 + i] = load32(nonce.data() + 4 * i);
+}
+
+#define CHACHA_QUARTER(a, b, c, d, ADD, XOR, ROT) \
+    a = ADD(a, b); d = XOR(d, a); d = ROT(d, 16);  \
+    c = ADD(c, d); b = XOR(b, c); b = ROT(b, 12);  \
+    a = ADD(a, b); d = XOR(d, a); d = ROT(d, 8);   \
+    c = ADD(c, d); b = XOR(b, c); b = ROT(b, 7);
+
+// Ten double rounds: four column quarter rounds, then four diagonal ones
+#define CHACHA_ROUNDS(x, ADD, XOR, ROT)                                 \
+    for (int round = 0; round < 10; ++round) {                          \
+        CHACHA_QUARTER(x[0], x[4], x[8], x[12], ADD, XOR, ROT)          \
+        CHACHA_QUARTER(x[1], x[5], x[9], x[13], ADD, XOR, ROT)          \
+        CHACHA_QUARTER(x[2], x[6], x[10], x[14], ADD, XOR, ROT)         \
+        CHACHA_QUARTER(x[3], x[7], x[11], x[15], ADD, XOR, ROT)         \
+        CHACHA_QUARTER(x[0], x[5], x[10], x[15], ADD, XOR, ROT)         \
+        CHACHA_QUARTER(x[1], x[6], x[11], x[12], ADD, XOR, ROT)         \
+        CHACHA_QUARTER(x[2], x[7], x[8], x[13], ADD, XOR, ROT)          \
+        CHACHA_QUARTER(x[3], x[4], x[9], x[14], ADD, XOR, ROT)          \
+    }
+
+std::uint32_t add32(std::uint32_t a, std::uint32_t b) { return a + b; }
+std::uint32_t xor32(std::uint32_t a, std::uint32_t b) { return a ^ b; }
+
+void keystreamBlock(std::uint32_t state[16], unsigned char out[64]) {
+    std::uint32_t x[16];
+    std::memcpy(x, state, sizeof(x));
+    CHACHA_ROUNDS(x, add32, xor32, rotl)
+    for (int i = 0; i < 16; ++i) store32(out + 4 * i, x[i] + state[i]);
+    ++state[12];
+}
+
+#if defined(__SSE2__)
+__m128i add128(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+__m128i xor128(__m128i a, __m128i b) { return _mm_xor_si128(a, b); }
+__m128i rot128(__m128i v, int shift) { return _mm_or_si128(_mm_slli_epi32(v, shift), _mm_srli_epi32(v, 32 - shift)); }
+
+// Four blocks at once, vector i holds word i of the four blocks
+void xor4Blocks(std::uint32_t state[16], const unsigned char* in, unsigned char* out) {
+    __m128i x[16], start[16];
+    for (int i = 0; i < 16; ++i) x[i] = _mm_set1_epi32(static_cast<int>(state[i]));
+    x[12] = _mm_add_epi32(x[12], _mm_set_epi32(3, 2, 1, 0));
+    std::memcpy(start, x, sizeof(x));
+    CHACHA_ROUNDS(x, add128, xor128, rot128)
+
+    // Transpose each group of four words back into per-block order
+    for (int group = 0; group < 4; ++group) {
+        __m128i a = add128(x[4 * group], start[4 * group]);
+        __m128i b = add128(x[4 * group + 1], start[4 * group + 1]);
+        __m128i c = add128(x[4 * group + 2], start[4 * group + 2]);
+        __m128i d = add128(x[4 * group + 3], start[4 * group + 3]);
+        __m128i ab0 = _mm_unpacklo_epi32(a, b), cd0 = _mm_unpacklo_epi32(c, d);
+        __m128i ab1 = _mm_unpackhi_epi32(a, b), cd1 = _mm_unpackhi_epi32(c, d);
+        __m128i blocks[4] = {_mm_unpacklo_epi64(ab0, cd0), _mm_unpackhi_epi64(ab0, cd0),
+                             _mm_unpacklo_epi64(ab1, cd1), _mm_unpackhi_epi64(ab1, cd1)};
+        for (int block = 0; block < 4; ++block) {
+            std::size_t offset = block * 64 + group * 16;
+            __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + offset));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + offset), _mm_xor_si128(data, blocks[block]));
+        }
+    }
+    state[12] += 4;
+}
+#endif
+
+#if STEGO_HAVE_AVX2
+__attribute__((target("avx2"))) inline __m256i add256(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+__attribute__((target("avx2"))) inline __m256i xor256(__m256i a, __m256i b) { return _mm256_xor_si256(a, b); }
+__attribute__((target("avx2"))) inline __m256i rot256(__m256i v, int shift) {
+    // 16 and 8 are whole-byte rotations, one shuffle instead of two shifts and an OR
+    if (shift == 16) {
+        return _mm256_shuffle_epi8(v, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                                       2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13));
+    }
+    if (shift == 8) {
+        return _mm256_shuffle_epi8(v, _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                                       3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14));
+    }
+    return _mm256_or_si256(_mm256_slli_epi32(v, shift), _mm256_srli_epi32(v, 32 - shift));
+}
+
+// Eight blocks at once, the low 128-bit lane holds blocks 0-3 and the high lane blocks 4-7
+__attribute__((target("avx2"))) void xor8Blocks(std::uint32_t state[16], const unsigned char* in, unsigned char* out) {
+    __m256i x[16], start[16];
+    for (int i = 0; i < 16; ++i) x[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+    x[12] = _mm256_add_epi32(x[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    std::memcpy(start, x, sizeof(x));
+    CHACHA_ROUNDS(x, add256, xor256, rot256)
+
+    // Per-lane 4x4 transposes, then the lanes are paired into whole 64-byte blocks
+    __m256i words[4][4];
+    for (int group = 0; group < 4; ++group) {
+        __m256i a = add256(x[4 * group], start[4 * group]);
+        __m256i b = add256(x[4 * group + 1], start[4 * group + 1]);
+        __m256i c = add256(x[4 * group + 2], start[4 * group + 2]);
+        __m256i d = add256(x[4 * group + 3], start[4 * group + 3]);
+        __m256i ab0 = _mm256_unpacklo_epi32(a, b), cd0 = _mm256_unpacklo_epi32(c, d);
+        __m256i ab1 = _mm256_unpackhi_epi32(a, b), cd1 = _mm256_unpackhi_epi32(c, d);
+        words[group][0] = _mm256_unpacklo_epi64(ab0, cd0);
+        words[group][1] = _mm256_unpackhi_epi64(ab0, cd0);
+        words[group][2] = _mm256_unpacklo_epi64(ab1, cd1);
+        words[group][3] = _mm256_unpackhi_epi64(ab1, cd1);
+    }
+    for (int block = 0; block < 4; ++block) {
+        __m256i parts[4] = {_mm256_permute2x128_si256(words[0][block], words[1][block], 0x20),
+                            _mm256_permute2x128_si256(words[2][block], words[3][block], 0x20),
+                            _mm256_permute2x128_si256(words[0][block], words[1][block], 0x31),
+                            _mm256_permute2x128_si256(words[2][block], words[3][block], 0x31)};
+        for (int part = 0; part < 4; ++part) {
+            // parts 0-1 are block `block`, parts 2-3 are block `block + 4`
+            std::size_t offset = (part < 2 ? block : block + 4) * 64 + (part & 1) * 32;
+            __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + offset));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + offset), _mm256_xor_si256(data, parts[part]));
+        }
+    }
+    state[12] += 8;
+}
+#endif
+
+void padTo16(std::vector<unsigned char>& data) {
+    data.resize((data.size() + 15) / 16 * 16, 0);
+}
+
+// Poly1305 input of the AEAD: aad, ciphertext, both zero padded, then both lengths
+Tag aeadTag(const Key& key, const Nonce& nonce, const unsigned char* aad, std::size_t aadSize,
+            const unsigned char* ciphertext, std::size_t size) {
+    std::uint32_t state[16];
+    initState(state, key, nonce, 0);
+    unsigned char oneTimeKey[64];
+    keystreamBlock(state, oneTimeKey);
+
+    std::vector<unsigned char> mac(aad, aad + aadSize);
+    padTo16(mac);
+    mac.insert(mac.end(), ciphertext, ciphertext + size);
+    padTo16(mac);
+    unsigned char lengths[16];
+    for (int i = 0; i < 8; ++i) {
+        lengths[i] = static_cast<unsigned char>(static_cast<std::uint64_t>(aadSize) >> (8 * i));
+        lengths[8 + i] = static_cast<unsigned char>(static_cast<std::uint64_t>(size) >> (8 * i));
+    }
+    mac.insert(mac.end(), lengths, lengths + 16);
+    return poly1305(oneTimeKey, mac.data(), mac.size());
+}
+
+bool parseHexKey(const std::string& text, Key& key) {
+    std::string hex;
+    for (char ch : text) {
+        if (!std::isspace(static_cast<unsigned char>(ch))) hex.push_back(ch);
+    }
+    if (hex.size() != 64) return false;
+    for (std::size_t i = 0; i < 32; ++i) {
+        char* end;
+        std::string byte = hex.substr(2 * i, 2);
+        key[i] = static_cast<unsigned char>(std::strtoul(byte.c_str(), &end, 16));
+        if (end != byte.c_str() + 2) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// Function to XOR data with the ChaCha20 keystream
+void chacha20Xor(const Key& key, const Nonce& nonce, std::uint32_t counter,
+                 const unsigned char* in, unsigned char* out, std::size_t size) {
+    std::uint32_t state[16];
+    initState(state, key, nonce, counter);
+
+#if STEGO_HAVE_AVX2
+    if (Cpu::hasAvx2()) {
+        for (; size >= 512; size -= 512, in += 512, out += 512) xor8Blocks(state, in, out);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; size >= 256; size -= 256, in += 256, out += 256) xor4Blocks(state, in, out);
+#endif
+    unsigned char block[64];
+    while (size > 0) {
+        keystreamBlock(state, block);
+        std::size_t count = size < 64 ? size : 64;
+        for (std::size_t i = 0; i < count; ++i) out[i] = in[i] ^ block[i];
+        size -= count;
+        in += count;
+        out += count;
+    }
+}
+
+// Function to compute a Poly1305 tag, 26-bit limbs so every product fits in 64 bits
+Tag poly1305(const unsigned char* oneTimeKey, const unsigned char* data, std::size_t size) {
+    const std::uint32_t mask = 0x3ffffff;
+    // r is clamped as the RFC requires
+    const std::uint32_t r0 = load32(oneTimeKey) & 0x3ffffff;
+    const std::uint32_t r1 = (load32(oneTimeKey + 3) >> 2) & 0x3ffff03;
+    const std::uint32_t r2 = (load32(oneTimeKey + 6) >> 4) & 0x3ffc0ff;
+    const std::uint32_t r3 = (load32(oneTimeKey + 9) >> 6) & 0x3f03fff;
+    const std::uint32_t r4 = (load32(oneTimeKey + 12) >> 8) & 0x00fffff;
+    const std::uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    std::uint32_t h0 = 0, h1 = 0, h2 = 0, h3 = 0, h4 = 0;
+
+    auto block = [&](const unsigned char* m, std::uint32_t highBit) {
+        h0 += load32(m) & mask;
+        h1 += (load32(m + 3) >> 2) & mask;
+        h2 += (load32(m + 6) >> 4) & mask;
+        h3 += (load32(m + 9) >> 6) & mask;
+        h4 += (load32(m + 12) >> 8) | highBit;
+        using u64 = std::uint64_t;
+        u64 d0 = u64(h0) * r0 + u64(h1) * s4 + u64(h2) * s3 + u64(h3) * s2 + u64(h4) * s1;
+        u64 d1 = u64(h0) * r1 + u64(h1) * r0 + u64(h2) * s4 + u64(h3) * s3 + u64(h4) * s2;
+        u64 d2 = u64(h0) * r2 + u64(h1) * r1 + u64(h2) * r0 + u64(h3) * s4 + u64(h4) * s3;
+        u64 d3 = u64(h0) * r3 + u64(h1) * r2 + u64(h2) * r1 + u64(h3) * r0 + u64(h4) * s4;
+        u64 d4 = u64(h0) * r4 + u64(h1) * r3 + u64(h2) * r2 + u64(h3) * r1 + u64(h4) * r0;
+        d1 += d0 >> 26; h0 = d0 & mask;
+        d2 += d1 >> 26; h1 = d1 & mask;
+        d3 += d2 >> 26; h2 = d2 & mask;
+        d4 += d3 >> 26; h3 = d3 & mask;
+        h0 += static_cast<std::uint32_t>(d4 >> 26) * 5; h4 = d4 & mask;
+        h1 += h0 >> 26; h0 &= mask;
+    };
+
+    for (; size >= 16; size -= 16, data += 16) block(data, 1u << 24);
+    if (size > 0) {
+        // Last partial block gets a 1 byte appended instead of the high bit
+        unsigned char last[16] = {};
+        std::memcpy(last, data, size);
+        last[size] = 1;
+        block(last, 0);
+    }
+
+    // Full carry, then subtract p = 2^130 - 5 if h >= p (without branching on h)
+    std::uint32_t c;
+    c = h1 >> 26; h1 &= mask; h2 += c;
+    c = h2 >> 26; h2 &= mask; h3 += c;
+    c = h3 >> 26; h3 &= mask; h4 += c;
+    c = h4 >> 26; h4 &= mask; h0 += c * 5;
+    c = h0 >> 26; h0 &= mask; h1 += c;
+    std::uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= mask;
+    std::uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= mask;
+    std::uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= mask;
+    std::uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= mask;
+    std::uint32_t g4 = h4 + c - (1u << 26);
+    std::uint32_t select = (g4 >> 31) - 1; // all ones when h >= p
+    h0 = (h0 & ~select) | (g0 & select);
+    h1 = (h1 & ~select) | (g1 & select);
+    h2 = (h2 & ~select) | (g2 & select);
+    h3 = (h3 & ~select) | (g3 & select);
+    h4 = (h4 & ~select) | (g4 & select);
+
+    // h + s mod 2^128
+    std::uint32_t words[4] = {h0 | (h1 << 26), (h1 >> 6) | (h2 << 20), (h2 >> 12) | (h3 << 14), (h3 >> 18) | (h4 << 8)};
+    Tag tag;
+    std::uint64_t carry = 0;
+    for (int i = 0; i < 4; ++i) {
+        carry += static_cast<std::uint64_t>(words[i]) + load32(oneTimeKey + 16 + 4 * i);
+        store32(tag.data() + 4 * i, static_cast<std::uint32_t>(carry));
+        carry >>= 32;
+    }
+    return tag;
+}
+
+// Function to encrypt data in place and return the tag
+Tag seal(const Key& key, const Nonce& nonce, const unsigned char* aad, std::size_t aadSize,
+         unsigned char* data, std::size_t size) {
+    chacha20Xor(key, nonce, 1, data, data, size);
+    return aeadTag(key, nonce, aad, aadSize, data, size);
+}
+
+// Function to check the tag and decrypt data in place
+bool open(const Key& key, const Nonce& nonce, const unsigned char* aad, std::size_t aadSize,
+          unsigned char* data, std::size_t size, const Tag& tag) {
+    Tag expected = aeadTag(key, nonce, aad, aadSize, data, size);
+    unsigned char difference = 0; // compare every byte, no early exit
+    for (std::size_t i = 0; i < tag.size(); ++i) difference |= expected[i] ^ tag[i];
+    if (difference != 0) return false;
+    chacha20Xor(key, nonce, 1, data, data, size);
+    return true;
+}
+
+// Function to make a fresh random nonce
+Nonce randomNonce() {
+    std::random_device device;
+    Nonce nonce;
+    for (std::size_t i = 0; i < nonce.size(); i += 4) store32(nonce.data() + i, device());
+    return nonce;
+}
+
+// Function to read a key file
+bool readKeyFile(const std::string& path, Key& key) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fmt::println("Cannot open key file '{}'.", path);
+        return false;
+    }
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (content.size() == key.size()) {
+        std::memcpy(key.data(), content.data(), key.size());
+        return true;
+    }
+    if (!parseHexKey(content, key)) {
+        fmt::println("Key file must hold 32 raw bytes or 64 hex digits.");
+        return false;
+    }
+    return true;
+}
+
+// Function to read a key from an environment variable
+bool readKeyEnv(const std::string& name, Key& key) {
+    const char* value = std::getenv(name.c_str());
+    if (!value) {
+        fmt::println("Environment variable {} is not set.", name);
+        return false;
+    }
+    if (!parseHexKey(value, key)) {
+        fmt::println("{} must hold 64 hex digits.", name);
+        return false;
+    }
+    return true;
+}
+
+} // namespace Crypto
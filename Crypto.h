@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// In-tree ChaCha20-Poly1305 (RFC 8439) for payload confidentiality.
+// The keystream is generated 8 blocks at a time with AVX2 when the CPU has it, 4 blocks with SSE2 otherwise.
+namespace Crypto {
+
+    using Key = std::array<unsigned char, 32>;
+    using Nonce = std::array<unsigned char, 12>;
+    using Tag = std::array<unsigned char, 16>;
+
+    // Function to XOR data with the ChaCha20 keystream starting at block `counter`, in and out may be the same buffer
+    void chacha20Xor(const Key& key, const Nonce& nonce, std::uint32_t counter,
+                     const unsigned char* in, unsigned char* out, std::size_t size);
+
+    // Function to compute a Poly1305 tag with a one-time key
+    Tag poly1305(const unsigned char* oneTimeKey, const unsigned char* data, std::size_t size);
+
+    // Function to encrypt data in place and return the tag that also covers `aad`
+    Tag seal(const Key& key, const Nonce& nonce, const unsigned char* aad, std::size_t aadSize,
+             unsigned char* data, std::size_t size);
+
+    // Function to check the tag and decrypt data in place, false (data untouched) if the tag does not match
+    bool open(const Key& key, const Nonce& nonce, const unsigned char* aad, std::size_t aadSize,
+              unsigned char* data, std::size_t size, const Tag& tag);
+
+    // Function to make a fresh random nonce
+    Nonce randomNonce();
+
+    // Function to read a key file: 32 raw bytes or 64 hex digits
+    bool readKeyFile(const std::string& path, Key& key);
+
+    // Function to read a key (64 hex digits) from an environment variable
+    bool readKeyEnv(const std::string& name, Key& key);
+
+} // namespace Crypto
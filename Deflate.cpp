@@ -0,0 +1,698 @@
+#include "Deflate.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+namespace Deflate {
+
+namespace {
+
+// Length symbols 257..285 and distance symbols 0..29: base value and number of extra bits (RFC 1951, 3.2.5)
+constexpr unsigned short lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+                                           67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr unsigned char lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr unsigned short distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                         1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr unsigned char distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order in which code length code lengths are stored in a dynamic block header
+constexpr unsigned char codeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+constexpr int maxCodeBits = 15;
+
+// Slicing-by-8 CRC tables: table[k][b] is the CRC of byte b followed by k zero bytes
+const auto crcTables = [] {
+    std::array<std::array<std::uint32_t, 256>, 8> tables{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        std::uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        tables[0][i] = c;
+    }
+    for (int slice = 1; slice < 8; ++slice) {
+        for (int i = 0; i < 256; ++i) {
+            tables[slice][i] = (tables[slice - 1][i] >> 8) ^ tables[0][tables[slice - 1][i] & 255];
+        }
+    }
+    return tables;
+}();
+
+std::uint32_t reverseBits(std::uint32_t code, int length) {
+    std::uint32_t result = 0;
+    for (int i = 0; i < length; ++i) {
+        result = (result << 1) | (code & 1);
+        code >>= 1;
+    }
+    return result;
+}
+
+// ---------------------------------------- Decoding ----------------------------------------
+
+// Reads bits LSB-first with a 64-bit buffer, so one refill covers a whole length/distance pair.
+// Reading past the end feeds zero bytes, `padding` counts them so corrupt streams are detected.
+struct BitReader {
+    const unsigned char* p;
+    const unsigned char* end;
+    std::uint64_t bits = 0;
+    int count = 0;
+    int padding = 0;
+
+    void refill() {
+        if (end - p >= 8) {
+            // Branch-free refill: load 8 bytes, keep as many whole bytes as fit
+            std::uint64_t word = 0;
+            for (int i = 0; i < 8; ++i) word |= static_cast<std::uint64_t>(p[i]) << (8 * i);
+            bits |= word << count;
+            p += (63 - count) >> 3;
+            count |= 56;
+            return;
+        }
+        while (count <= 56) {
+            if (p < end) {
+                bits |= static_cast<std::uint64_t>(*p++) << count;
+            } else {
+                ++padding;
+            }
+            count += 8;
+        }
+    }
+
+    std::uint32_t take(int n) {
+        std::uint32_t value = static_cast<std::uint32_t>(bits & ((std::uint64_t(1) << n) - 1));
+        bits >>= n;
+        count -= n;
+        return value;
+    }
+
+    // True when bits that were never in the input have been consumed
+    bool overrun() const { return padding * 8 > count; }
+};
+
+// Two-level decoding table. The first `primaryBits` bits index the primary table directly;
+// codes that are longer link to a 32-entry subtable indexed by the next 5 bits.
+// Entry layout: bits 0-15 symbol (or subtable offset), bits 16-23 code length, bit 31 subtable link.
+constexpr int primaryBits = 10;
+constexpr std::uint32_t linkFlag = 0x80000000u;
+
+struct HuffmanTable {
+    std::vector<std::uint32_t> entries;
+
+    bool build(const unsigned char* lengths, int n) {
+        int count[maxCodeBits + 1] = {};
+        for (int i = 0; i < n; ++i) count[lengths[i]]++;
+        count[0] = 0;
+
+        // Reject over-subscribed codes (incomplete ones are allowed, unused entries stay 0 and fail on decode)
+        int left = 1;
+        for (int bits = 1; bits <= maxCodeBits; ++bits) {
+            left = (left << 1) - count[bits];
+            if (left < 0) return false;
+        }
+
+        // Canonical codes, RFC 1951 3.2.2
+        std::uint32_t next[maxCodeBits + 2] = {};
+        std::uint32_t code = 0;
+        for (int bits = 1; bits <= maxCodeBits; ++bits) {
+            code = (code + count[bits - 1]) << 1;
+            next[bits] = code;
+        }
+
+        entries.assign(1u << primaryBits, 0);
+        for (int symbol = 0; symbol < n; ++symbol) {
+            int length = lengths[symbol];
+            if (length == 0) continue;
+            std::uint32_t reversed = reverseBits(next[length]++, length);
+            std::uint32_t entry = static_cast<std::uint32_t>(symbol) | (static_cast<std::uint32_t>(length) << 16);
+
+            if (length <= primaryBits) {
+                for (std::uint32_t i = reversed; i < (1u << primaryBits); i += 1u << length) entries[i] = entry;
+            } else {
+                std::uint32_t prefix = reversed & ((1u << primaryBits) - 1);
+                if (!(entries[prefix] & linkFlag)) {
+                    entries[prefix] = linkFlag | static_cast<std::uint32_t>(entries.size());
+                    entries.resize(entries.size() + (1u << (maxCodeBits - primaryBits)), 0);
+                }
+                std::uint32_t offset = entries[prefix] & 0xFFFF;
+                for (std::uint32_t i = reversed >> primaryBits; i < (1u << (maxCodeBits - primaryBits));
+                     i += 1u << (length - primaryBits)) {
+                    entries[offset + i] = entry;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Returns the symbol, or -1 for a code that is not in the table
+    int decode(BitReader& in) const {
+        std::uint32_t entry = entries[in.bits & ((1u << primaryBits) - 1)];
+        if (entry & linkFlag) {
+            entry = entries[(entry & 0xFFFF) + ((in.bits >> primaryBits) & ((1u << (maxCodeBits - primaryBits)) - 1))];
+        }
+        int length = (entry >> 16) & 0xFF;
+        if (length == 0) return -1;
+        in.bits >>= length;
+        in.count -= length;
+        return static_cast<int>(entry & 0xFFFF);
+    }
+};
+
+struct FixedTables {
+    HuffmanTable literal;
+    HuffmanTable distance;
+
+    FixedTables() {
+        unsigned char lengths[288];
+        std::fill(lengths, lengths + 144, 8);
+        std::fill(lengths + 144, lengths + 256, 9);
+        std::fill(lengths + 256, lengths + 280, 7);
+        std::fill(lengths + 280, lengths + 288, 8);
+        literal.build(lengths, 288);
+        std::fill(lengths, lengths + 30, 5);
+        distance.build(lengths, 30);
+    }
+};
+
+bool readDynamicTables(BitReader& in, HuffmanTable& literal, HuffmanTable& distance) {
+    in.refill();
+    int hlit = static_cast<int>(in.take(5)) + 257;
+    int hdist = static_cast<int>(in.take(5)) + 1;
+    int hclen = static_cast<int>(in.take(4)) + 4;
+    if (hlit > 286 || hdist > 30) return false;
+
+    unsigned char codeLengthLengths[19] = {};
+    for (int i = 0; i < hclen; ++i) {
+        in.refill();
+        codeLengthLengths[codeLengthOrder[i]] = static_cast<unsigned char>(in.take(3));
+    }
+    HuffmanTable codeLengths;
+    if (!codeLengths.build(codeLengthLengths, 19)) return false;
+
+    // Literal/length and distance code lengths are one run-length coded sequence
+    unsigned char lengths[286 + 30] = {};
+    int total = hlit + hdist;
+    for (int i = 0; i < total;) {
+        in.refill();
+        int symbol = codeLengths.decode(in);
+        if (symbol < 0) return false;
+        if (symbol < 16) {
+            lengths[i++] = static_cast<unsigned char>(symbol);
+            continue;
+        }
+        int repeat;
+        unsigned char value = 0;
+        if (symbol == 16) {
+            if (i == 0) return false;
+            value = lengths[i - 1];
+            repeat = 3 + static_cast<int>(in.take(2));
+        } else if (symbol == 17) {
+            repeat = 3 + static_cast<int>(in.take(3));
+        } else {
+            repeat = 11 + static_cast<int>(in.take(7));
+        }
+        if (i + repeat > total) return false;
+        std::fill(lengths + i, lengths + i + repeat, value);
+        i += repeat;
+    }
+    if (lengths[256] == 0) return false; // end-of-block must be codable
+    return literal.build(lengths, hlit) && distance.build(lengths + hlit, hdist) && !in.overrun();
+}
+
+// ---------------------------------------- Encoding ----------------------------------------
+
+struct BitWriter {
+    std::vector<unsigned char>& out;
+    std::uint64_t bits = 0;
+    int count = 0;
+
+    void put(std::uint32_t value, int n) {
+        bits |= static_cast<std::uint64_t>(value) << count;
+        count += n;
+        if (count >= 32) {
+            unsigned char bytes[4] = {static_cast<unsigned char>(bits), static_cast<unsigned char>(bits >> 8),
+                                      static_cast<unsigned char>(bits >> 16), static_cast<unsigned char>(bits >> 24)};
+            out.insert(out.end(), bytes, bytes + 4);
+            bits >>= 32;
+            count -= 32;
+        }
+    }
+
+    void alignToByte() {
+        while (count > 0) {
+            out.push_back(static_cast<unsigned char>(bits));
+            bits >>= 8;
+            count = count > 8 ? count - 8 : 0;
+        }
+        bits = 0;
+    }
+};
+
+// Huffman code lengths no longer than maxBits. Built with the two-queue method over sorted leaves;
+// if the tree is too deep the frequencies are flattened and the tree is rebuilt.
+void buildLengths(const std::uint32_t* freq, int n, int maxBits, unsigned char* lengths) {
+    std::fill(lengths, lengths + n, 0);
+    std::vector<std::uint32_t> f(freq, freq + n);
+    std::vector<int> symbols;
+    for (int i = 0; i < n; ++i) {
+        if (f[i] > 0) symbols.push_back(i);
+    }
+    if (symbols.empty()) return;
+    if (symbols.size() == 1) {
+        lengths[symbols[0]] = 1;
+        return;
+    }
+
+    int m = static_cast<int>(symbols.size());
+    std::vector<std::uint64_t> weight(2 * m - 1);
+    std::vector<int> parent(2 * m - 1);
+    std::vector<int> depth(2 * m - 1);
+    for (;;) {
+        std::sort(symbols.begin(), symbols.end(), [&](int a, int b) { return f[a] != f[b] ? f[a] < f[b] : a < b; });
+        for (int i = 0; i < m; ++i) weight[i] = f[symbols[i]];
+
+        int leaf = 0, internal = m, next = m;
+        auto pick = [&] {
+            if (leaf < m && (internal >= next || weight[leaf] <= weight[internal])) return leaf++;
+            return internal++;
+        };
+        for (; next < 2 * m - 1; ++next) {
+            int a = pick();
+            int b = pick();
+            weight[next] = weight[a] + weight[b];
+            parent[a] = parent[b] = next;
+        }
+
+        // Parents always have a higher index than their children
+        depth[2 * m - 2] = 0;
+        int maxDepth = 0;
+        for (int i = 2 * m - 3; i >= 0; --i) {
+            depth[i] = depth[parent[i]] + 1;
+            if (i < m) maxDepth = std::max(maxDepth, depth[i]);
+        }
+        if (maxDepth <= maxBits) {
+            for (int i = 0; i < m; ++i) lengths[symbols[i]] = static_cast<unsigned char>(depth[i]);
+            return;
+        }
+        for (int symbol : symbols) f[symbol] = (f[symbol] >> 1) | 1;
+    }
+}
+
+// Canonical codes for the given lengths, already bit-reversed for LSB-first output
+void buildCodes(const unsigned char* lengths, int n, std::uint32_t* codes) {
+    int count[maxCodeBits + 1] = {};
+    for (int i = 0; i < n; ++i) count[lengths[i]]++;
+    count[0] = 0;
+    std::uint32_t next[maxCodeBits + 2] = {};
+    std::uint32_t code = 0;
+    for (int bits = 1; bits <= maxCodeBits; ++bits) {
+        code = (code + count[bits - 1]) << 1;
+        next[bits] = code;
+    }
+    for (int i = 0; i < n; ++i) {
+        codes[i] = lengths[i] ? reverseBits(next[lengths[i]]++, lengths[i]) : 0;
+    }
+}
+
+const auto lengthSymbol = [] {
+    std::array<unsigned char, 259> table{};
+    for (int code = 0; code < 29; ++code) {
+        for (int length = lengthBase[code]; length < lengthBase[code] + (1 << lengthExtra[code]) && length <= 258; ++length) {
+            table[length] = static_cast<unsigned char>(code);
+        }
+    }
+    table[258] = 28; // 258 has its own symbol (285), not code 27 + 31
+    return table;
+}();
+
+int distanceSymbol(int distance) {
+    int d = distance - 1;
+    if (d < 4) return d;
+    int e = std::bit_width(static_cast<unsigned>(d)) - 1;
+    return 2 * e + ((d >> (e - 1)) & 1);
+}
+
+// One LZ77 token: a literal (distance 0) or a length/distance pair
+struct Token {
+    std::uint16_t value;
+    std::uint16_t distance;
+};
+
+void writeStored(BitWriter& writer, const unsigned char* data, std::size_t size, bool final) {
+    do {
+        std::size_t chunk = std::min<std::size_t>(size, 65535);
+        size -= chunk;
+        writer.put(final && size == 0 ? 1 : 0, 1);
+        writer.put(0, 2);
+        writer.alignToByte();
+        auto length = static_cast<std::uint16_t>(chunk);
+        auto inverse = static_cast<std::uint16_t>(~length);
+        unsigned char header[4] = {static_cast<unsigned char>(length), static_cast<unsigned char>(length >> 8),
+                                   static_cast<unsigned char>(inverse), static_cast<unsigned char>(inverse >> 8)};
+        writer.out.insert(writer.out.end(), header, header + 4);
+        writer.out.insert(writer.out.end(), data, data + chunk);
+        data += chunk;
+    } while (size > 0);
+}
+
+// Emits one block with dynamic Huffman codes, or stored if that would be smaller
+void writeBlock(BitWriter& writer, const std::vector<Token>& tokens, const unsigned char* raw, std::size_t rawSize,
+                bool final) {
+    std::uint32_t literalFreq[286] = {};
+    std::uint32_t distanceFreq[30] = {};
+    for (const Token& token : tokens) {
+        if (token.distance == 0) {
+            literalFreq[token.value]++;
+        } else {
+            literalFreq[257 + lengthSymbol[token.value]]++;
+            distanceFreq[distanceSymbol(token.distance)]++;
+        }
+    }
+    literalFreq[256] = 1;
+    // Give both trees at least two codes, so every decoder sees complete codes
+    if (std::count_if(std::begin(literalFreq), std::end(literalFreq), [](std::uint32_t f) { return f > 0; }) < 2) literalFreq[0]++;
+    int usedDistances = static_cast<int>(std::count_if(std::begin(distanceFreq), std::end(distanceFreq), [](std::uint32_t f) { return f > 0; }));
+    if (usedDistances < 2) {
+        distanceFreq[0] = std::max<std::uint32_t>(distanceFreq[0], 1);
+        distanceFreq[1] = std::max<std::uint32_t>(distanceFreq[1], 1);
+    }
+
+    unsigned char lengths[286 + 30];
+    buildLengths(literalFreq, 286, maxCodeBits, lengths);
+    buildLengths(distanceFreq, 30, maxCodeBits, lengths + 286);
+    int hlit = 286;
+    while (hlit > 257 && lengths[hlit - 1] == 0) --hlit;
+    int hdist = 30;
+    while (hdist > 1 && lengths[286 + hdist - 1] == 0) --hdist;
+
+    // Run-length code the combined length sequence with symbols 16 (repeat previous), 17 and 18 (zeros)
+    unsigned char combined[286 + 30];
+    std::copy(lengths, lengths + hlit, combined);
+    std::copy(lengths + 286, lengths + 286 + hdist, combined + hlit);
+    int total = hlit + hdist;
+    std::vector<std::pair<unsigned char, unsigned char>> rle; // symbol, extra bits value
+    for (int i = 0; i < total;) {
+        unsigned char length = combined[i];
+        int run = 1;
+        while (i + run < total && combined[i + run] == length) ++run;
+        i += run;
+        if (length == 0) {
+            while (run >= 11) {
+                int r = std::min(run, 138);
+                rle.emplace_back(18, r - 11);
+                run -= r;
+            }
+            if (run >= 3) {
+                rle.emplace_back(17, run - 3);
+                run = 0;
+            }
+        } else {
+            rle.emplace_back(length, 0);
+            --run;
+            while (run >= 3) {
+                int r = std::min(run, 6);
+                rle.emplace_back(16, r - 3);
+                run -= r;
+            }
+        }
+        while (run-- > 0) rle.emplace_back(length, 0);
+    }
+
+    std::uint32_t codeLengthFreq[19] = {};
+    for (auto [symbol, extra] : rle) codeLengthFreq[symbol]++;
+    unsigned char codeLengthLengths[19];
+    buildLengths(codeLengthFreq, 19, 7, codeLengthLengths);
+    int hclen = 19;
+    while (hclen > 4 && codeLengthLengths[codeLengthOrder[hclen - 1]] == 0) --hclen;
+
+    // Cost in bits, to decide between this block and a stored one
+    std::uint64_t cost = 3 + 5 + 5 + 4 + 3 * hclen;
+    for (auto [symbol, extra] : rle) {
+        cost += codeLengthLengths[symbol] + (symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0);
+    }
+    for (int i = 0; i < 286; ++i) cost += static_cast<std::uint64_t>(literalFreq[i]) * lengths[i];
+    for (int i = 0; i < 29; ++i) cost += static_cast<std::uint64_t>(literalFreq[257 + i]) * lengthExtra[i];
+    for (int i = 0; i < 30; ++i) cost += static_cast<std::uint64_t>(distanceFreq[i]) * (lengths[286 + i] + distExtra[i]);
+    if (cost > (rawSize + 5 * (rawSize / 65535 + 1)) * 8) {
+        writeStored(writer, raw, rawSize, final);
+        return;
+    }
+
+    std::uint32_t literalCodes[286], distanceCodes[30], codeLengthCodes[19];
+    buildCodes(lengths, 286, literalCodes);
+    buildCodes(lengths + 286, 30, distanceCodes);
+    buildCodes(codeLengthLengths, 19, codeLengthCodes);
+
+    writer.put(final ? 1 : 0, 1);
+    writer.put(2, 2);
+    writer.put(hlit - 257, 5);
+    writer.put(hdist - 1, 5);
+    writer.put(hclen - 4, 4);
+    for (int i = 0; i < hclen; ++i) writer.put(codeLengthLengths[codeLengthOrder[i]], 3);
+    for (auto [symbol, extra] : rle) {
+        writer.put(codeLengthCodes[symbol], codeLengthLengths[symbol]);
+        if (symbol == 16) writer.put(extra, 2);
+        else if (symbol == 17) writer.put(extra, 3);
+        else if (symbol == 18) writer.put(extra, 7);
+    }
+
+    for (const Token& token : tokens) {
+        if (token.distance == 0) {
+            writer.put(literalCodes[token.value], lengths[token.value]);
+            continue;
+        }
+        int lengthCode = lengthSymbol[token.value];
+        writer.put(literalCodes[257 + lengthCode], lengths[257 + lengthCode]);
+        writer.put(token.value - lengthBase[lengthCode], lengthExtra[lengthCode]);
+        int distanceCode = distanceSymbol(token.distance);
+        writer.put(distanceCodes[distanceCode], lengths[286 + distanceCode]);
+        writer.put(token.distance - distBase[distanceCode], distExtra[distanceCode]);
+    }
+    writer.put(literalCodes[256], lengths[256]);
+}
+
+} // namespace
+
+// Function to compute the zlib Adler-32 checksum
+std::uint32_t adler32(const unsigned char* data, std::size_t size, std::uint32_t adler) {
+    std::uint32_t a = adler & 0xFFFF;
+    std::uint32_t b = adler >> 16;
+    // 5552 is the largest block for which the sums cannot overflow 32 bits before the modulo
+    while (size > 0) {
+        std::size_t block = std::min<std::size_t>(size, 5552);
+        size -= block;
+        for (std::size_t i = 0; i < block; ++i) {
+            a += data[i];
+            b += a;
+        }
+        data += block;
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Function to compute the CRC-32 used by PNG chunks
+std::uint32_t crc32(const unsigned char* data, std::size_t size, std::uint32_t crc) {
+    const auto& t = crcTables;
+    crc = ~crc;
+    while (size >= 8) {
+        std::uint32_t low = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<std::uint32_t>(data[3]) << 24));
+        crc = t[7][low & 255] ^ t[6][(low >> 8) & 255] ^ t[5][(low >> 16) & 255] ^ t[4][low >> 24] ^
+              t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = t[0][(crc ^ *data++) & 255] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Function to decompress a raw DEFLATE stream
+bool inflate(const unsigned char* data, std::size_t size, std::vector<unsigned char>& out, std::size_t limit) {
+    static const FixedTables fixed;
+    BitReader in{data, data + size};
+    std::size_t start = out.size();
+    std::size_t pos = start;
+    HuffmanTable dynamicLiteral, dynamicDistance;
+
+    bool final = false;
+    while (!final) {
+        in.refill();
+        final = in.take(1) == 1;
+        int type = static_cast<int>(in.take(2));
+
+        if (type == 0) {
+            // Stored block: drop to a byte boundary and copy LEN bytes
+            in.take(in.count % 8);
+            int buffered = in.count / 8 - in.padding; // whole input bytes still sitting in the bit buffer
+            if (buffered < 0) return false;
+            const unsigned char* p = in.p - buffered;
+            in.bits = 0;
+            in.count = 0;
+            in.padding = 0;
+            if (in.end - p < 4) return false;
+            unsigned length = p[0] | (p[1] << 8);
+            unsigned inverse = p[2] | (p[3] << 8);
+            p += 4;
+            if ((length ^ 0xFFFF) != inverse || static_cast<std::size_t>(in.end - p) < length) return false;
+            out.resize(pos + length);
+            std::memcpy(out.data() + pos, p, length);
+            pos += length;
+            in.p = p + length;
+        } else if (type == 1 || type == 2) {
+            const HuffmanTable* literal = &fixed.literal;
+            const HuffmanTable* distance = &fixed.distance;
+            if (type == 2) {
+                if (!readDynamicTables(in, dynamicLiteral, dynamicDistance)) return false;
+                literal = &dynamicLiteral;
+                distance = &dynamicDistance;
+            }
+
+            for (;;) {
+                in.refill();
+                if (in.overrun()) return false;
+                int symbol = literal->decode(in);
+                if (symbol < 0) return false;
+                if (pos + 258 > out.size()) out.resize(std::max<std::size_t>(out.size() * 2, pos + 65536));
+                if (symbol < 256) {
+                    out[pos++] = static_cast<unsigned char>(symbol);
+                    continue;
+                }
+                if (symbol == 256) break;
+
+                symbol -= 257;
+                if (symbol >= 29) return false;
+                int length = lengthBase[symbol] + static_cast<int>(in.take(lengthExtra[symbol]));
+                int distanceCode = distance->decode(in);
+                if (distanceCode < 0 || distanceCode >= 30) return false;
+                std::size_t dist = distBase[distanceCode] + in.take(distExtra[distanceCode]);
+                if (dist > pos) return false;
+
+                unsigned char* target = out.data() + pos;
+                const unsigned char* source = target - dist;
+                if (dist >= static_cast<std::size_t>(length)) {
+                    std::memcpy(target, source, length);
+                } else {
+                    // Overlapping copy repeats the last `dist` bytes
+                    for (int i = 0; i < length; ++i) target[i] = source[i];
+                }
+                pos += length;
+                if (pos - start >= limit) break;
+            }
+        } else {
+            return false;
+        }
+
+        if (pos - start >= limit) break;
+    }
+
+    out.resize(pos);
+    return !in.overrun();
+}
+
+// Function to compress data into a raw DEFLATE stream.
+// Greedy matching with a 4-byte hash and a short hash chain (8 candidates), which is a good speed/ratio point
+// for image rows. Blocks are flushed every 64K tokens with their own dynamic Huffman codes.
+std::vector<unsigned char> deflate(const unsigned char* data, std::size_t size) {
+    constexpr int hashBits = 15;
+    constexpr std::size_t windowSize = 32768;
+    constexpr int maxChain = 8;
+    constexpr std::size_t tokensPerBlock = 65536;
+
+    std::vector<unsigned char> out;
+    out.reserve(size / 2 + 64);
+    BitWriter writer{out};
+    std::vector<std::int32_t> head(1u << hashBits, -1);
+    std::vector<std::int32_t> previous(windowSize, -1);
+    std::vector<Token> tokens;
+    tokens.reserve(tokensPerBlock);
+
+    auto hashAt = [&](std::size_t i) {
+        std::uint32_t v = data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | (static_cast<std::uint32_t>(data[i + 3]) << 24);
+        return (v * 2654435761u) >> (32 - hashBits);
+    };
+    auto insert = [&](std::size_t i) {
+        std::uint32_t h = hashAt(i);
+        previous[i & (windowSize - 1)] = head[h];
+        head[h] = static_cast<std::int32_t>(i);
+    };
+
+    std::size_t blockStart = 0;
+    std::size_t i = 0;
+    while (i < size) {
+        int bestLength = 0;
+        std::size_t bestDistance = 0;
+        if (i + 4 <= size) {
+            std::int32_t candidate = head[hashAt(i)];
+            std::size_t maxLength = std::min<std::size_t>(258, size - i);
+            for (int chain = 0; chain < maxChain && candidate >= 0 && i - candidate <= windowSize - 1; ++chain) {
+                const unsigned char* a = data + candidate;
+                const unsigned char* b = data + i;
+                if (a[bestLength] == b[bestLength]) {
+                    std::size_t length = 0;
+                    while (length < maxLength && a[length] == b[length]) ++length;
+                    if (static_cast<int>(length) > bestLength) {
+                        bestLength = static_cast<int>(length);
+                        bestDistance = i - candidate;
+                        if (length == maxLength) break;
+                    }
+                }
+                std::int32_t next = previous[candidate & (windowSize - 1)];
+                if (next >= candidate) break; // slot was reused by a newer position
+                candidate = next;
+            }
+        }
+
+        if (bestLength >= 4) {
+            tokens.push_back({static_cast<std::uint16_t>(bestLength), static_cast<std::uint16_t>(bestDistance)});
+            std::size_t end = i + bestLength;
+            for (; i < end; ++i) {
+                if (i + 4 <= size) insert(i);
+            }
+        } else {
+            tokens.push_back({data[i], 0});
+            if (i + 4 <= size) insert(i);
+            ++i;
+        }
+
+        if (tokens.size() == tokensPerBlock) {
+            writeBlock(writer, tokens, data + blockStart, i - blockStart, i == size);
+            tokens.clear();
+            blockStart = i;
+        }
+    }
+    if (!tokens.empty() || size == 0) {
+        writeBlock(writer, tokens, data + blockStart, i - blockStart, true);
+    }
+    writer.alignToByte();
+    return out;
+}
+
+// Function to decompress a zlib stream
+bool zlibDecompress(const unsigned char* data, std::size_t size, std::vector<unsigned char>& out, std::size_t limit) {
+    if (size < 6) return false;
+    // CMF: method 8 (deflate), window <= 32K; FLG: check bits, no preset dictionary
+    if ((data[0] & 0x0F) != 8 || (data[0] >> 4) > 7 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20)) {
+        return false;
+    }
+    std::size_t start = out.size();
+    if (!inflate(data + 2, size - 2, out, limit)) return false;
+    if (out.size() - start >= limit) return true; // stopped early, the checksum covers the full stream
+
+    const unsigned char* tail = data + size - 4;
+    std::uint32_t expected = (static_cast<std::uint32_t>(tail[0]) << 24) | (tail[1] << 16) | (tail[2] << 8) | tail[3];
+    return adler32(out.data() + start, out.size() - start) == expected;
+}
+
+// Function to compress data into a zlib stream
+std::vector<unsigned char> zlibCompress(const unsigned char* data, std::size_t size) {
+    std::vector<unsigned char> out = {0x78, 0x01};
+    std::vector<unsigned char> body = deflate(data, size);
+    out.insert(out.end(), body.begin(), body.end());
+    std::uint32_t adler = adler32(data, size);
+    unsigned char tail[4] = {static_cast<unsigned char>(adler >> 24), static_cast<unsigned char>(adler >> 16),
+                             static_cast<unsigned char>(adler >> 8), static_cast<unsigned char>(adler)};
+    out.insert(out.end(), tail, tail + 4);
+    return out;
+}
+
+} // namespace Deflate
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//In-tree DEFLATE (RFC 1951) and zlib wrapper (RFC 1950), only what the PNG format needs.
+namespace Deflate {
+
+    // Function to compute the zlib Adler-32 checksum, pass the previous value to continue a running checksum
+    std::uint32_t adler32(const unsigned char* data, std::size_t size, std::uint32_t adler = 1);
+
+    // Function to compute the CRC-32 used by PNG chunks and gzip (polynomial 0xEDB88320)
+    std::uint32_t crc32(const unsigned char* data, std::size_t size, std::uint32_t crc = 0);
+
+    // Function to decompress a raw DEFLATE stream. Decoding stops early once `limit` bytes were produced
+    // (used when only the start of the data is needed). Returns false on corrupt input.
+    bool inflate(const unsigned char* data, std::size_t size, std::vector<unsigned char>& out,
+                 std::size_t limit = SIZE_MAX);
+
+    // Function to compress data into a raw DEFLATE stream (greedy LZ77 + dynamic Huffman blocks)
+    std::vector<unsigned char> deflate(const unsigned char* data, std::size_t size);
+
+    // Function to decompress a zlib stream (2-byte header, DEFLATE data, Adler-32)
+    bool zlibDecompress(const unsigned char* data, std::size_t size, std::vector<unsigned char>& out,
+                        std::size_t limit = SIZE_MAX);
+
+    // Function to compress data into a zlib stream
+    std::vector<unsigned char> zlibCompress(const unsigned char* data, std::size_t size);
+
+} // namespace Deflate
@@ -0,0 +1,573 @@
+#include "ImageFormats.h"
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <fmt/core.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ImageHandler {
+
+    namespace {
+
+        //Little-endian helpers for BMP headers, memcpy instead of reinterpret_cast so unaligned offsets are fine
+        std::int32_t readLE32(const char *p) {
+            std::uint32_t value = static_cast<unsigned char>(p[0]) | (static_cast<unsigned char>(p[1]) << 8) |
+                                  (static_cast<unsigned char>(p[2]) << 16) |
+                                  (static_cast<std::uint32_t>(static_cast<unsigned char>(p[3])) << 24);
+            std::int32_t result;
+            std::memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        int readLE16(const char *p) {
+            return (p[0] & 255) | ((p[1] & 255) << 8);
+        }
+
+        void writeLE32(char *p, std::int32_t value) {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (int i = 0; i < 4; ++i) {
+                p[i] = static_cast<char>((bits >> (8 * i)) & 255);
+            }
+        }
+
+        //Reads the next number of a Netpbm header, skipping whitespace and '#' comments (they can appear between any two tokens)
+        bool readHeaderNumber(std::istream &file, int &value) {
+            int ch = file.get();
+            while (ch != EOF && (std::isspace(ch) || ch == '#')) {
+                if (ch == '#') {
+                    while (ch != EOF && ch != '\n' && ch != '\r') ch = file.get();
+                }
+                ch = file.get();
+            }
+            if (ch == EOF || !std::isdigit(ch)) return false;
+
+            long long number = 0;
+            while (ch != EOF && std::isdigit(ch)) {
+                number = number * 10 + (ch - '0');
+                if (number > 0x7FFFFFFF) return false;
+                ch = file.get();
+            }
+            //The character after the number is whitespace, after maxval it is the single separator before pixel data
+            if (ch != EOF && !std::isspace(ch)) return false;
+            value = static_cast<int>(number);
+            return true;
+        }
+
+    } //namespace
+
+    //---------------------------------------- BMP ----------------------------------------
+
+    bool BmpFormat::probe(std::string_view head) {
+        return head.size() >= 2 && head[0] == 'B' && head[1] == 'M';
+    }
+
+    bool BmpFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        //BMP file header (14 bytes) + at least a BITMAPINFOHEADER (40 bytes)
+        //width 18-21, height 22-25, bits per pixel 28-29, compression 30-33, pixel data offset 10-13
+        std::vector<char> header(54);
+        file.read(header.data(), header.size());
+        if (!file) {
+            fmt::print("Failed to read BMP header.\n");
+            return false;
+        }
+
+        int pixelDataOffset = readLE32(&header[10]);
+        int dibHeaderSize = readLE32(&header[14]);
+        if (dibHeaderSize < 40 || pixelDataOffset < 54) {
+            fmt::print("Invalid BMP pixel data offset.\n");
+            return false;
+        }
+        int compression = readLE32(&header[30]);
+        //0 = BI_RGB, 3 = BI_BITFIELDS (used by 32bpp images, pixels are still stored uncompressed)
+        if (compression != 0 && compression != 3) {
+            fmt::print("Compressed BMP files are not supported.\n");
+            return false;
+        }
+
+        info.format = id;
+        info.width = readLE32(&header[18]);
+        int height = readLE32(&header[22]);
+        info.topDown = height < 0;
+        info.height = std::abs(height);
+        info.bitsPerPixel = readLE16(&header[28]);
+        if (info.width <= 0 || info.height <= 0 || info.bitsPerPixel < 8 || info.bitsPerPixel % 8 != 0) {
+            fmt::print("Unsupported BMP geometry or bit depth.\n");
+            return false;
+        }
+        //Divide by 8 to convert bits per pixel to bytes (color channels)
+        info.channels = info.bitsPerPixel / 8;
+        info.maxVal = 255; //BMP default max color value
+        info.pixelDataOffset = pixelDataOffset;
+        //Every row is padded to a multiple of 4 bytes
+        info.rowStride = ((static_cast<std::size_t>(info.width) * info.bitsPerPixel + 31) / 32) * 4;
+
+        //Keep the whole header (it can be bigger than 54 bytes) so it can be copied when writing
+        header.resize(pixelDataOffset);
+        file.read(header.data() + 54, pixelDataOffset - 54);
+        if (!file) {
+            fmt::print("Failed to read BMP header.\n");
+            return false;
+        }
+        info.header = std::move(header);
+        return true;
+    }
+
+    PixelView BmpFormat::pixelView(const ImageInfo &info, std::vector<char> &data) {
+        return {data.data(), info.width, info.height, info.channels, 1, info.rowStride};
+    }
+
+    bool BmpFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        //Rows are read with their padding, so writing the same bytes back gives a valid file
+        data.resize(info.rowStride * info.height);
+        file.read(data.data(), data.size());
+        if (!file) {
+            fmt::print("BMP pixel data is truncated.\n");
+            return false;
+        }
+        return true;
+    }
+
+    bool BmpFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        std::vector<char> header = info.header;
+        if (header.size() < 54) {
+            //No source header to copy, build a minimal BITMAPINFOHEADER one
+            header.assign(54, 0);
+            header[0] = 'B';
+            header[1] = 'M';
+            writeLE32(&header[10], 54); //Pixel data offset
+            writeLE32(&header[14], 40); //Header size
+            writeLE32(&header[18], info.width);
+            writeLE32(&header[22], info.topDown ? -info.height : info.height);
+            header[26] = 1; //Number of planes
+            header[28] = static_cast<char>(info.channels * 8);
+            writeLE32(&header[34], static_cast<std::int32_t>(data.size())); //Image size
+        }
+        //Bytes 2..5 = total file size
+        writeLE32(&header[2], static_cast<std::int32_t>(header.size() + data.size()));
+
+        file.write(header.data(), header.size());
+        file.write(data.data(), data.size());
+        return static_cast<bool>(file);
+    }
+
+    //---------------------------------------- Netpbm ----------------------------------------
+
+    namespace {
+
+        //Netpbm magic is 'P', a digit and whitespace
+        bool probeNetpbm(std::string_view head, char digit) {
+            return head.size() >= 3 && head[0] == 'P' && head[1] == digit && std::isspace(static_cast<unsigned char>(head[2]));
+        }
+
+        int netpbmBytesPerSample(const ImageInfo &info) {
+            return info.maxVal > 255 ? 2 : 1;
+        }
+
+        //Shared by P2, P3, P5 and P6: magic, width, height, maxval
+        bool parseNetpbmHeader(std::istream &file, ImageInfo &info, char digit, int channels, ImageFormat id) {
+            char magic[2];
+            file.read(magic, 2);
+            if (!file || magic[0] != 'P' || magic[1] != digit) {
+                fmt::print("Invalid Netpbm file format.\n");
+                return false;
+            }
+
+            //After the magic number (and optional comments) there are values for: width, height and maximum color value
+            if (!readHeaderNumber(file, info.width) || !readHeaderNumber(file, info.height) ||
+                !readHeaderNumber(file, info.maxVal)) {
+                fmt::print("Invalid Netpbm header.\n");
+                return false;
+            }
+            if (info.width <= 0 || info.height <= 0 || info.maxVal <= 0 || info.maxVal > 65535) {
+                fmt::print("Unsupported Netpbm geometry or max color value.\n");
+                return false;
+            }
+
+            info.format = id;
+            info.channels = channels;
+            info.bitsPerPixel = channels * netpbmBytesPerSample(info) * 8;
+            info.topDown = true;
+            info.pixelDataOffset = static_cast<std::size_t>(file.tellg());
+            info.rowStride = static_cast<std::size_t>(info.width) * channels * netpbmBytesPerSample(info);
+            info.header.clear(); //Header is textual, the writer regenerates it
+            return true;
+        }
+
+        PixelView netpbmPixelView(const ImageInfo &info, std::vector<char> &data) {
+            return {data.data(), info.width, info.height, info.channels, netpbmBytesPerSample(info), info.rowStride};
+        }
+
+        //Binary rasters (P5, P6, P7) are stored exactly as we keep them in memory, 16-bit samples big-endian
+        bool readBinaryRaster(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+            data.resize(info.rowStride * info.height);
+            file.read(data.data(), data.size());
+            if (!file) {
+                fmt::print("{} pixel data is truncated.\n", Formats::name(info.format));
+                return false;
+            }
+            return true;
+        }
+
+        bool writeBinaryNetpbm(std::ostream &file, const ImageInfo &info, const std::vector<char> &data, char digit) {
+            std::string header = fmt::format("P{}\n{} {}\n{}\n", digit, info.width, info.height, info.maxVal);
+            file.write(header.data(), header.size());
+            file.write(data.data(), data.size());
+            return static_cast<bool>(file);
+        }
+
+        //Stores one decoded sample the same way a binary raster would hold it
+        inline void storeSample(char *&out, unsigned value, int bytesPerSample) {
+            if (bytesPerSample == 2) {
+                *out++ = static_cast<char>(value >> 8);
+            }
+            *out++ = static_cast<char>(value & 255);
+        }
+
+        inline bool isNetpbmSpace(char c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+        }
+
+        //Scalar ASCII sample parser, handles comments too. Used for the tail of the buffer, non-SSE2 builds,
+        //and whenever the SIMD path sees something that is neither a digit nor whitespace.
+        bool parseAsciiScalar(const char *&p, const char *end, char *&out, std::size_t &remaining,
+                              unsigned maxVal, int bytesPerSample) {
+            while (remaining > 0) {
+                while (p < end && (isNetpbmSpace(*p) || *p == '#')) {
+                    if (*p == '#') {
+                        while (p < end && *p != '\n' && *p != '\r') ++p;
+                    } else {
+                        ++p;
+                    }
+                }
+                if (p == end || *p < '0' || *p > '9') return false;
+
+                unsigned value = 0;
+                while (p < end && *p >= '0' && *p <= '9') {
+                    value = value * 10 + (*p - '0');
+                    if (value > maxVal) return false;
+                    ++p;
+                }
+                storeSample(out, value, bytesPerSample);
+                --remaining;
+            }
+            return true;
+        }
+
+        //Parses `count` whitespace separated decimal samples.
+        //SSE2 classifies 16 characters at a time into a digit bitmask, then every number is walked with
+        //count-trailing-zeros over that mask instead of testing characters one by one. The digit values
+        //are computed for the whole block at once, so building a number is just multiply-adds.
+        bool parseAsciiSamples(const char *p, const char *end, std::size_t count, unsigned maxVal,
+                               int bytesPerSample, char *out) {
+            std::size_t remaining = count;
+#if defined(__SSE2__)
+            const char *begin = p;
+            const __m128i zero = _mm_set1_epi8('0');
+            const __m128i nine = _mm_set1_epi8(9);
+            unsigned pending = 0;     //value of a number that continues into the next block
+            bool inNumber = false;
+            alignas(16) unsigned char digits[16];
+
+            while (remaining > 0 && end - p >= 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                __m128i value = _mm_sub_epi8(chunk, zero);
+                //Unsigned trick: (c - '0') <= 9 only for digits
+                unsigned digitMask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(value, nine), value));
+                __m128i spaces = _mm_or_si128(
+                        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+                        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+                unsigned spaceMask = _mm_movemask_epi8(spaces);
+                if ((digitMask | spaceMask) != 0xFFFF) {
+                    break; //Comment or unusual whitespace, finish with the scalar parser
+                }
+                _mm_store_si128(reinterpret_cast<__m128i *>(digits), value);
+
+                unsigned position = 0;
+                while (position < 16) {
+                    unsigned rest = digitMask >> position;
+                    if (inNumber) {
+                        //Continue the number from the previous block, it runs until the first non-digit
+                        unsigned run = std::countr_one(rest);
+                        for (unsigned i = 0; i < run; ++i) {
+                            pending = pending * 10 + digits[position + i];
+                            if (pending > maxVal) return false;
+                        }
+                        position += run;
+                        if (position == 16) break;
+                        storeSample(out, pending, bytesPerSample);
+                        inNumber = false;
+                        if (--remaining == 0) break;
+                        continue;
+                    }
+                    if (rest == 0) break;
+                    position += std::countr_zero(rest);
+                    pending = 0;
+                    inNumber = true;
+                }
+                p += position < 16 && remaining == 0 ? position : 16;
+            }
+            if (inNumber) {
+                //Unwind the number that was cut at a block edge and let the scalar code parse it again
+                while (p > begin && p[-1] >= '0' && p[-1] <= '9') --p;
+            }
+#endif
+            return parseAsciiScalar(p, end, out, remaining, maxVal, bytesPerSample);
+        }
+
+        //Reads the remainder of the stream into memory with a single read
+        bool readRemaining(std::istream &file, std::vector<char> &text) {
+            auto start = file.tellg();
+            file.seekg(0, std::ios::end);
+            auto end = file.tellg();
+            file.seekg(start);
+            if (start < 0 || end < start) return false;
+            text.resize(static_cast<std::size_t>(end - start));
+            file.read(text.data(), text.size());
+            return static_cast<bool>(file);
+        }
+
+        bool readAsciiRaster(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+            std::vector<char> text;
+            if (!readRemaining(file, text)) {
+                fmt::print("Failed to read ASCII pixel data.\n");
+                return false;
+            }
+            std::size_t count = static_cast<std::size_t>(info.width) * info.height * info.channels;
+            data.resize(info.rowStride * info.height);
+            //Values are only limited by the sample width, not by maxval: flipping the LSB of a sample equal to an
+            //even maxval gives maxval + 1, and such an image must still read back
+            unsigned limit = netpbmBytesPerSample(info) == 2 ? 65535 : 255;
+            if (!parseAsciiSamples(text.data(), text.data() + text.size(), count, limit,
+                                   netpbmBytesPerSample(info), data.data())) {
+                fmt::print("Invalid or truncated ASCII pixel data.\n");
+                return false;
+            }
+            return true;
+        }
+
+        //Writes samples as decimal text, one image row per line and never more than 70 characters per line.
+        //Numbers 0..255 come from a small table, the output is buffered and written in large blocks.
+        bool writeAsciiRaster(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+            static const auto smallNumbers = [] {
+                std::array<std::array<char, 4>, 256> table{}; //3 digits + length
+                for (int i = 0; i < 256; ++i) {
+                    auto text = std::to_string(i);
+                    std::memcpy(table[i].data(), text.data(), text.size());
+                    table[i][3] = static_cast<char>(text.size());
+                }
+                return table;
+            }();
+
+            int bytesPerSample = netpbmBytesPerSample(info);
+            std::size_t samplesPerRow = static_cast<std::size_t>(info.width) * info.channels;
+            std::string buffer;
+            buffer.reserve(1 << 16);
+            const unsigned char *in = reinterpret_cast<const unsigned char *>(data.data());
+
+            for (int y = 0; y < info.height; ++y) {
+                std::size_t lineLength = 0;
+                for (std::size_t i = 0; i < samplesPerRow; ++i) {
+                    char digits[6];
+                    std::size_t length;
+                    if (bytesPerSample == 1) {
+                        const auto &entry = smallNumbers[*in++];
+                        std::memcpy(digits, entry.data(), 3);
+                        length = static_cast<std::size_t>(entry[3]);
+                    } else {
+                        unsigned value = (in[0] << 8) | in[1];
+                        in += 2;
+                        auto text = std::to_string(value);
+                        std::memcpy(digits, text.data(), text.size());
+                        length = text.size();
+                    }
+                    if (lineLength > 0) {
+                        if (lineLength + 1 + length > 70) {
+                            buffer.push_back('\n');
+                            lineLength = 0;
+                        } else {
+                            buffer.push_back(' ');
+                            ++lineLength;
+                        }
+                    }
+                    buffer.append(digits, length);
+                    lineLength += length;
+                }
+                buffer.push_back('\n');
+                if (buffer.size() >= (1 << 16) - 512) {
+                    file.write(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            }
+            file.write(buffer.data(), buffer.size());
+            return static_cast<bool>(file);
+        }
+
+        bool writeAsciiNetpbm(std::ostream &file, const ImageInfo &info, const std::vector<char> &data, char digit) {
+            std::string header = fmt::format("P{}\n{} {}\n{}\n", digit, info.width, info.height, info.maxVal);
+            file.write(header.data(), header.size());
+            return writeAsciiRaster(file, info, data);
+        }
+
+    } //namespace
+
+    //PPM (P6)
+    bool PpmFormat::probe(std::string_view head) { return probeNetpbm(head, '6'); }
+
+    bool PpmFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        return parseNetpbmHeader(file, info, '6', 3, id); //PPM format uses 3 channels (RGB)
+    }
+
+    PixelView PpmFormat::pixelView(const ImageInfo &info, std::vector<char> &data) { return netpbmPixelView(info, data); }
+
+    bool PpmFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        return readBinaryRaster(file, info, data);
+    }
+
+    bool PpmFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        return writeBinaryNetpbm(file, info, data, '6');
+    }
+
+    //PGM (P5)
+    bool PgmFormat::probe(std::string_view head) { return probeNetpbm(head, '5'); }
+
+    bool PgmFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        return parseNetpbmHeader(file, info, '5', 1, id); //PGM is grayscale, 1 channel
+    }
+
+    PixelView PgmFormat::pixelView(const ImageInfo &info, std::vector<char> &data) { return netpbmPixelView(info, data); }
+
+    bool PgmFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        return readBinaryRaster(file, info, data);
+    }
+
+    bool PgmFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        return writeBinaryNetpbm(file, info, data, '5');
+    }
+
+    //Plain PPM (P3)
+    bool PlainPpmFormat::probe(std::string_view head) { return probeNetpbm(head, '3'); }
+
+    bool PlainPpmFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        return parseNetpbmHeader(file, info, '3', 3, id);
+    }
+
+    PixelView PlainPpmFormat::pixelView(const ImageInfo &info, std::vector<char> &data) { return netpbmPixelView(info, data); }
+
+    bool PlainPpmFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        return readAsciiRaster(file, info, data);
+    }
+
+    bool PlainPpmFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        return writeAsciiNetpbm(file, info, data, '3');
+    }
+
+    //Plain PGM (P2)
+    bool PlainPgmFormat::probe(std::string_view head) { return probeNetpbm(head, '2'); }
+
+    bool PlainPgmFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        return parseNetpbmHeader(file, info, '2', 1, id);
+    }
+
+    PixelView PlainPgmFormat::pixelView(const ImageInfo &info, std::vector<char> &data) { return netpbmPixelView(info, data); }
+
+    bool PlainPgmFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        return readAsciiRaster(file, info, data);
+    }
+
+    bool PlainPgmFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        return writeAsciiNetpbm(file, info, data, '2');
+    }
+
+    //PAM (P7). The header is a list of "KEY value" lines ending with ENDHDR:
+    //P7 / WIDTH w / HEIGHT h / DEPTH d / MAXVAL m / TUPLTYPE t / ENDHDR
+    bool PamFormat::probe(std::string_view head) {
+        return head.size() >= 3 && head[0] == 'P' && head[1] == '7' && (head[2] == '\n' || head[2] == '\r');
+    }
+
+    bool PamFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        std::string line;
+        std::getline(file, line);
+        if (line.empty() || line.substr(0, 2) != "P7") {
+            fmt::print("Invalid PAM file format.\n");
+            return false;
+        }
+
+        int width = -1, height = -1, depth = -1, maxVal = -1;
+        std::string tupleType;
+        bool ended = false;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            std::size_t keyStart = line.find_first_not_of(" \t");
+            if (keyStart == std::string::npos || line[keyStart] == '#') continue;
+            std::size_t keyEnd = line.find_first_of(" \t", keyStart);
+            std::string key = line.substr(keyStart, keyEnd - keyStart);
+            std::string value;
+            if (keyEnd != std::string::npos) {
+                std::size_t valueStart = line.find_first_not_of(" \t", keyEnd);
+                if (valueStart != std::string::npos) {
+                    value = line.substr(valueStart);
+                    value.erase(value.find_last_not_of(" \t") + 1);
+                }
+            }
+
+            if (key == "ENDHDR") {
+                ended = true;
+                break;
+            }
+            if (key == "TUPLTYPE") {
+                //Multiple TUPLTYPE lines are concatenated with a space
+                if (!tupleType.empty()) tupleType += ' ';
+                tupleType += value;
+                continue;
+            }
+            int number = std::atoi(value.c_str());
+            if (key == "WIDTH") width = number;
+            else if (key == "HEIGHT") height = number;
+            else if (key == "DEPTH") depth = number;
+            else if (key == "MAXVAL") maxVal = number;
+        }
+
+        if (!ended || width <= 0 || height <= 0 || depth <= 0 || maxVal <= 0 || maxVal > 65535) {
+            fmt::print("Invalid PAM header.\n");
+            return false;
+        }
+
+        info.format = id;
+        info.width = width;
+        info.height = height;
+        info.channels = depth;
+        info.maxVal = maxVal;
+        info.tupleType = tupleType;
+        info.bitsPerPixel = depth * netpbmBytesPerSample(info) * 8;
+        info.topDown = true;
+        info.pixelDataOffset = static_cast<std::size_t>(file.tellg());
+        info.rowStride = static_cast<std::size_t>(width) * depth * netpbmBytesPerSample(info);
+        info.header.clear();
+        return true;
+    }
+
+    PixelView PamFormat::pixelView(const ImageInfo &info, std::vector<char> &data) { return netpbmPixelView(info, data); }
+
+    bool PamFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        return readBinaryRaster(file, info, data);
+    }
+
+    bool PamFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        std::string header = fmt::format("P7\nWIDTH {}\nHEIGHT {}\nDEPTH {}\nMAXVAL {}\n", info.width, info.height,
+                                         info.channels, info.maxVal);
+        if (!info.tupleType.empty()) {
+            header += fmt::format("TUPLTYPE {}\n", info.tupleType);
+        }
+        header += "ENDHDR\n";
+        file.write(header.data(), header.size());
+        file.write(data.data(), data.size());
+        return static_cast<bool>(file);
+    }
+
+} //namespace ImageHandler
@@ -0,0 +1,213 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace ImageHandler {
+
+    //Every image format the registry knows about
+    enum class ImageFormat { Unknown, Bmp, Ppm, Pgm, Pam, PlainPpm, PlainPgm, Qoi, Png };
+
+    //Metadata parsed from an image header. Filled by a format's parseHeader and handed back to its writer,
+    //so a read -> modify -> write round trip keeps the original header where the format allows it.
+    struct ImageInfo {
+        ImageFormat format = ImageFormat::Unknown;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        int maxVal = 255;
+        int bitsPerPixel = 0;
+        bool topDown = false;              //BMP rows are stored bottom-up unless the height is negative
+        std::size_t pixelDataOffset = 0;   //where pixel data starts in the file
+        std::size_t rowStride = 0;         //bytes per row of pixel data, including any padding
+        std::vector<char> header;          //raw header bytes, copied verbatim when the image is written back
+        std::string tupleType;             //PAM TUPLTYPE (e.g. RGB_ALPHA), empty for other formats
+    };
+
+    //Non-owning view over the pixel bytes of an image, this is what the LSB code works on
+    struct PixelView {
+        char *data = nullptr;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        int bytesPerSample = 1;
+        std::size_t rowStride = 0;
+
+        //Total number of bytes covered by the view (padding included)
+        std::size_t size() const { return rowStride * static_cast<std::size_t>(height); }
+    };
+
+    //Format traits. Each format supplies the same static interface:
+    //  probe       - does the start of the file carry this format's magic bytes?
+    //  parseHeader - read the header from the stream, fill ImageInfo and leave the stream at the pixel data
+    //  pixelView   - describe the pixel bytes returned by readPixels
+    //  readPixels  - read pixel data into a byte vector
+    //  write       - write header + pixel data
+    //The registry below picks a format at runtime once, every call after that is resolved at compile time.
+
+    //BMP, https://en.wikipedia.org/wiki/BMP_file_format
+    struct BmpFormat {
+        static constexpr ImageFormat id = ImageFormat::Bmp;
+        static constexpr std::string_view name = "BMP";
+        static constexpr std::string_view extension = ".bmp";
+        static constexpr std::size_t probeSize = 2;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //Binary PPM (P6), https://netpbm.sourceforge.net/doc/ppm.html
+    struct PpmFormat {
+        static constexpr ImageFormat id = ImageFormat::Ppm;
+        static constexpr std::string_view name = "PPM";
+        static constexpr std::string_view extension = ".ppm";
+        static constexpr std::size_t probeSize = 3;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //Binary PGM (P5), https://netpbm.sourceforge.net/doc/pgm.html
+    struct PgmFormat {
+        static constexpr ImageFormat id = ImageFormat::Pgm;
+        static constexpr std::string_view name = "PGM";
+        static constexpr std::string_view extension = ".pgm";
+        static constexpr std::size_t probeSize = 3;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //PAM (P7) with any DEPTH and TUPLTYPE, https://netpbm.sourceforge.net/doc/pam.html
+    struct PamFormat {
+        static constexpr ImageFormat id = ImageFormat::Pam;
+        static constexpr std::string_view name = "PAM";
+        static constexpr std::string_view extension = ".pam";
+        static constexpr std::size_t probeSize = 3;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //ASCII ("plain") PPM (P3). Samples are decoded to the same byte layout as P6, so the LSB code does not care.
+    struct PlainPpmFormat {
+        static constexpr ImageFormat id = ImageFormat::PlainPpm;
+        static constexpr std::string_view name = "PPM (plain)";
+        static constexpr std::string_view extension = ".ppm";
+        static constexpr std::size_t probeSize = 3;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //ASCII ("plain") PGM (P2)
+    struct PlainPgmFormat {
+        static constexpr ImageFormat id = ImageFormat::PlainPgm;
+        static constexpr std::string_view name = "PGM (plain)";
+        static constexpr std::string_view extension = ".pgm";
+        static constexpr std::size_t probeSize = 3;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //QOI, lossless and much smaller than BMP/PPM while still cheap to decode. The codec lives in Qoi.h/.cpp.
+    struct QoiFormat {
+        static constexpr ImageFormat id = ImageFormat::Qoi;
+        static constexpr std::string_view name = "QOI";
+        static constexpr std::string_view extension = ".qoi";
+        static constexpr std::size_t probeSize = 4;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //PNG, 8 and 16 bit gray/gray+alpha/RGB/RGBA, https://www.w3.org/TR/png/
+    //Palette and interlaced images are rejected. Inflate/deflate live in Deflate.h/.cpp, the rest in Png.cpp.
+    struct PngFormat {
+        static constexpr ImageFormat id = ImageFormat::Png;
+        static constexpr std::string_view name = "PNG";
+        static constexpr std::string_view extension = ".png";
+        static constexpr std::size_t probeSize = 8;
+
+        static bool probe(std::string_view head);
+        static bool parseHeader(std::istream &file, ImageInfo &info);
+        static PixelView pixelView(const ImageInfo &info, std::vector<char> &data);
+        static bool readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data);
+        static bool write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data);
+    };
+
+    //Compile-time list of formats. The dispatch functions find the matching format and call
+    //fn(std::type_identity<Format>{}), so the code inside fn is instantiated once per format.
+    template<typename... Formats>
+    struct FormatRegistry {
+        //How many bytes from the start of a file are needed to probe every format
+        static constexpr std::size_t probeSize = std::max({Formats::probeSize...});
+
+        //Pick the format by magic bytes
+        template<typename Fn>
+        static bool dispatchProbe(std::string_view head, Fn &&fn) {
+            bool result = false;
+            bool matched = ((Formats::probe(head) && (result = fn(std::type_identity<Formats>{}), true)) || ...);
+            return matched && result;
+        }
+
+        //Pick the format by an id stored in ImageInfo
+        template<typename Fn>
+        static bool dispatchId(ImageFormat id, Fn &&fn) {
+            bool result = false;
+            bool matched = ((Formats::id == id && (result = fn(std::type_identity<Formats>{}), true)) || ...);
+            return matched && result;
+        }
+
+        static ImageFormat probe(std::string_view head) {
+            ImageFormat found = ImageFormat::Unknown;
+            ((Formats::probe(head) && (found = Formats::id, true)) || ...);
+            return found;
+        }
+
+        //Only used to choose the format of a file that does not exist yet
+        static ImageFormat fromExtension(std::string_view filename) {
+            ImageFormat found = ImageFormat::Unknown;
+            ((filename.ends_with(Formats::extension) && (found = Formats::id, true)) || ...);
+            return found;
+        }
+
+        static std::string_view name(ImageFormat id) {
+            std::string_view found = "unknown";
+            ((Formats::id == id && (found = Formats::name, true)) || ...);
+            return found;
+        }
+    };
+
+    using Formats = FormatRegistry<BmpFormat, PpmFormat, PgmFormat, PamFormat, PlainPpmFormat, PlainPgmFormat,
+                                   QoiFormat, PngFormat>;
+
+} //namespace ImageHandler
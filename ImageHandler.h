@@ -1,18 +1,54 @@
 #pragma once
+#include <fstream>
 #include <string>
 #include <vector>
+#include "ImageFormats.h"
 
 namespace ImageHandler {
 
+    // Function to detect the format of an existing file from its magic bytes
+    ImageFormat detectFormat(const std::string& filename);
+
     // Function to print information about the image file
     void printFileInfo(const std::string& filename);
 
+    // Function to read only the header of an image file
+    bool readImageInfo(const std::string& filename, ImageInfo& info);
+
+    // Function to read image data from a file, info keeps everything needed to write it back
+    bool readImage(const std::string& filename, std::vector<char>& data, ImageInfo& info);
+
+    // Function to write image data to a file in the format stored in info
+    bool writeImage(const std::string& filename, const std::vector<char>& data, const ImageInfo& info);
+
     // Function to read image data from a file
     bool readImage(const std::string& filename, std::vector<char>& data, int& width, int& height, int& channels, int& maxVal);
 
     // Function to write image data to a file
     bool writeImage(const std::string& filename, const std::vector<char>& data, int width, int height, int channels, int maxVal);
 
-} // namespace ImageHandler
+    // Function to write image data to a file, copying the header of another image
+    bool writeImage(const std::string& outFilename, const std::string& sourceBmpForHeader, const std::vector<char>& data, int width, int height, int channels, int maxVal);
 
+    // Rows of an image top to bottom without row padding, for tools that stream over an image band by band.
+    // BMP, binary PPM/PGM and PAM are read from the file as the rows are asked for (bottom-up BMP rows included),
+    // the other formats are decoded once when the image is opened.
+    class RowReader {
+    public:
+        bool open(const std::string& filename);
 
+        const ImageInfo& imageInfo() const { return info; }
+        int bytesPerSample() const { return info.maxVal > 255 ? 2 : 1; }
+        std::size_t rowBytes() const { return static_cast<std::size_t>(info.width) * info.channels * bytesPerSample(); }
+
+        // Function to read rows [first, first + count) packed into out
+        bool read(std::size_t first, std::size_t count, std::vector<unsigned char>& out);
+
+    private:
+        ImageInfo info;
+        std::ifstream file;
+        std::vector<char> data, scratch;
+        bool raw = false;
+    };
+
+} // namespace ImageHandler
@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Small kernels shared by the image code: the --adaptive cost map, the -analyze steganalysis and the PNG filters.
+namespace ImageKernels {
+
+    // Byte histogram counted into 4 banks in turn, so runs of equal values (flat regions) do not wait on the
+    // previous increment of the same counter. The 32-bit banks are added into a wider histogram by flush(),
+    // callers flush every row, long before a bank could overflow.
+    class BankedHistogram {
+    public:
+        void add(const unsigned char* p, std::size_t size) {
+            std::size_t i = 0;
+            for (; i + 4 <= size; i += 4) {
+                ++banks[0][p[i]];
+                ++banks[1][p[i + 1]];
+                ++banks[2][p[i + 2]];
+                ++banks[3][p[i + 3]];
+            }
+            for (; i < size; ++i) ++banks[0][p[i]];
+        }
+
+        template<typename Count>
+        void flush(std::array<Count, 256>& histogram) {
+            for (auto& bank : banks) {
+                for (int v = 0; v < 256; ++v) histogram[v] += bank[v];
+                bank.fill(0);
+            }
+        }
+
+    private:
+        std::array<std::array<std::uint32_t, 256>, 4> banks{};
+    };
+
+#if defined(__SSE2__)
+    // |x| of 16-bit lanes (SSE2 has no pabsw)
+    inline __m128i abs16(__m128i x) {
+        return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+    }
+#endif
+
+} // namespace ImageKernels
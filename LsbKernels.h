@@ -0,0 +1,142 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Bit-level kernels shared by every carrier (images, video frames).
+// Carrier byte i holds payload bit i in its least significant bit, payload bytes are read MSB first,
+// exactly like the original '0'/'1' string version but without building the string.
+namespace LsbKernels {
+
+    // spread[b] has payload bit (7 - i) of b in the LSB of byte i, so 8 carrier bytes are updated with one 64-bit AND/OR
+    inline const std::array<std::uint64_t, 256> spread = [] {
+        std::array<std::uint64_t, 256> table{};
+        for (int b = 0; b < 256; ++b) {
+            for (int i = 0; i < 8; ++i) {
+                table[b] |= static_cast<std::uint64_t>((b >> (7 - i)) & 1) << (8 * i);
+            }
+        }
+        return table;
+    }();
+
+    constexpr std::uint64_t lsbMask = 0x0101010101010101ull;
+
+    inline std::uint64_t load64(const char* p) {
+        std::uint64_t value;
+        std::memcpy(&value, p, 8);
+        return value;
+    }
+
+    inline void store64(char* p, std::uint64_t value) {
+        std::memcpy(p, &value, 8);
+    }
+
+    // LSBs of 8 carrier bytes -> one payload byte (first carrier byte becomes the MSB).
+    // The multiply moves bit 8*i to bit 63-i without carries, see https://graphics.stanford.edu/~seander/bithacks.html
+    inline unsigned char gather8(const char* carrier) {
+        return static_cast<unsigned char>(((load64(carrier) & lsbMask) * 0x8040201008040201ull) >> 56);
+    }
+
+    inline void scatter8(char* carrier, unsigned char byte) {
+        store64(carrier, (load64(carrier) & ~lsbMask) | spread[byte]);
+    }
+
+    inline int payloadBit(const unsigned char* payload, std::size_t bit) {
+        return (payload[bit >> 3] >> (7 - (bit & 7))) & 1;
+    }
+
+    // Function to write payload bits [firstBit, firstBit + bitCount) into carrier[0 .. bitCount)
+    inline void embedBits(char* carrier, const unsigned char* payload, std::size_t firstBit, std::size_t bitCount) {
+        std::size_t i = 0;
+        // Single bits until the payload position is byte aligned, then 8 carrier bytes per payload byte
+        for (; i < bitCount && ((firstBit + i) & 7) != 0; ++i) {
+            carrier[i] = static_cast<char>((carrier[i] & 0xFE) | payloadBit(payload, firstBit + i));
+        }
+        for (; i + 8 <= bitCount; i += 8) {
+            scatter8(carrier + i, payload[(firstBit + i) >> 3]);
+        }
+        for (; i < bitCount; ++i) {
+            carrier[i] = static_cast<char>((carrier[i] & 0xFE) | payloadBit(payload, firstBit + i));
+        }
+    }
+
+    // Function to read carrier[0 .. bitCount) LSBs into payload bits [firstBit, firstBit + bitCount).
+    // payload must be zero where partial bytes are filled.
+    inline void extractBits(const char* carrier, unsigned char* payload, std::size_t firstBit, std::size_t bitCount) {
+        std::size_t i = 0;
+        for (; i < bitCount && ((firstBit + i) & 7) != 0; ++i) {
+            std::size_t bit = firstBit + i;
+            payload[bit >> 3] |= static_cast<unsigned char>((carrier[i] & 1) << (7 - (bit & 7)));
+        }
+        for (; i + 8 <= bitCount; i += 8) {
+            payload[(firstBit + i) >> 3] = gather8(carrier + i);
+        }
+        for (; i < bitCount; ++i) {
+            std::size_t bit = firstBit + i;
+            payload[bit >> 3] |= static_cast<unsigned char>((carrier[i] & 1) << (7 - (bit & 7)));
+        }
+    }
+
+    // k bits per sample: sample i keeps K payload bits (MSB first) in its low bits, so 8 samples carry
+    // exactly K payload bytes. K is a template parameter, every shift and mask below is a constant.
+    template <int K>
+    constexpr std::uint64_t lowBits = lsbMask * ((1u << K) - 1);
+
+    template <int K>
+    inline void scatterGroup(char* carrier, const unsigned char* bytes) {
+        std::uint64_t bits = 0;
+        for (int i = 0; i < K; ++i) bits = (bits << 8) | bytes[i];
+        std::uint64_t spreadBits = 0;
+        for (int i = 0; i < 8; ++i) spreadBits |= ((bits >> (K * (7 - i))) & ((1u << K) - 1)) << (8 * i);
+        store64(carrier, (load64(carrier) & ~lowBits<K>) | spreadBits);
+    }
+
+    template <int K>
+    inline void gatherGroup(const char* carrier, unsigned char* bytes) {
+        std::uint64_t value = load64(carrier) & lowBits<K>;
+        std::uint64_t bits = 0;
+        for (int i = 0; i < 8; ++i) bits = (bits << K) | ((value >> (8 * i)) & ((1u << K) - 1));
+        for (int i = 0; i < K; ++i) bytes[i] = static_cast<unsigned char>(bits >> (8 * (K - 1 - i)));
+    }
+
+    // One bit per sample keeps the lookup table version
+    template <>
+    inline void scatterGroup<1>(char* carrier, const unsigned char* bytes) { scatter8(carrier, bytes[0]); }
+
+    template <>
+    inline void gatherGroup<1>(const char* carrier, unsigned char* bytes) { bytes[0] = gather8(carrier); }
+
+    // Matrix embedding with the Hamming code (1, 2^P - 1, P): a block of n = 2^P - 1 samples carries P bits as the
+    // syndrome, the XOR of the labels of all samples whose LSB is 1. Sample i has label i, except sample 0 which
+    // has label n, so groups of 8 samples start at multiples of 8 and one table lookup covers a whole group.
+
+    // xorLabels[b] = XOR of j over the set bits of a gathered byte, where bit 7 - j is sample j of the group
+    inline const std::array<std::uint8_t, 256> xorLabels = [] {
+        std::array<std::uint8_t, 256> table{};
+        for (int b = 0; b < 256; ++b) {
+            for (int j = 0; j < 8; ++j) {
+                if ((b >> (7 - j)) & 1) table[b] ^= static_cast<std::uint8_t>(j);
+            }
+        }
+        return table;
+    }();
+
+    // Syndrome of one block, P >= 3 so the block is whole groups of 8. Reads one byte past the block.
+    template <int P>
+    inline unsigned blockSyndrome(const char* block) {
+        constexpr unsigned n = (1u << P) - 1;
+        constexpr int groups = (n + 1) / 8;
+        unsigned syndrome = 0;
+        for (int g = 0; g < groups; ++g) {
+            unsigned bits = gather8(block + 8 * g);
+            if (g == groups - 1) bits &= 0xFE; // the 8th byte of the last group is the next block's
+            // Labels in group g are 8g + j: the 8g part survives only for an odd number of set bits
+            syndrome ^= xorLabels[bits] ^ ((std::popcount(bits) & 1) ? 8u * g : 0u);
+        }
+        if (block[0] & 1) syndrome ^= n;
+        return syndrome;
+    }
+
+} // namespace LsbKernels
@@ -0,0 +1,232 @@
+#include "Lz.h"
+#include <algorithm>
+#include <cstring>
+
+namespace Lz {
+
+namespace {
+
+constexpr std::size_t blockSize = 64 * 1024;
+constexpr std::size_t maxOffset = 65535;
+constexpr int hashBits = 14;
+constexpr std::size_t minMatch = 4;
+constexpr std::size_t lastLiterals = 5; // the last bytes of a block are always literals (LZ4 rule)
+constexpr std::size_t matchLimit = 12;  // no match starts in the last 12 bytes of a block
+constexpr std::uint32_t storedFlag = 0x80000000u;
+// Worst case of a compressed block: literals plus one length byte per 255 literals plus the token
+constexpr std::size_t maxBlockBytes = blockSize + blockSize / 255 + 16;
+
+std::uint32_t read32(const unsigned char* p) {
+    std::uint32_t value;
+    std::memcpy(&value, p, 4);
+    return value;
+}
+
+std::uint32_t hash(std::uint32_t value) {
+    return (value * 2654435761u) >> (32 - hashBits);
+}
+
+void putLE32(std::vector<unsigned char>& out, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+void writeLength(std::vector<unsigned char>& out, std::size_t length) {
+    for (; length >= 255; length -= 255) out.push_back(255);
+    out.push_back(static_cast<unsigned char>(length));
+}
+
+void writeSequence(std::vector<unsigned char>& out, const unsigned char* literals, std::size_t literalLength,
+                   std::size_t offset, std::size_t matchLength) {
+    std::size_t extra = matchLength - minMatch;
+    out.push_back(static_cast<unsigned char>((std::min<std::size_t>(literalLength, 15) << 4) | std::min<std::size_t>(extra, 15)));
+    if (literalLength >= 15) writeLength(out, literalLength - 15);
+    out.insert(out.end(), literals, literals + literalLength);
+    out.push_back(static_cast<unsigned char>(offset));
+    out.push_back(static_cast<unsigned char>(offset >> 8));
+    if (extra >= 15) writeLength(out, extra - 15);
+}
+
+void writeLastLiterals(std::vector<unsigned char>& out, const unsigned char* literals, std::size_t literalLength) {
+    out.push_back(static_cast<unsigned char>(std::min<std::size_t>(literalLength, 15) << 4));
+    if (literalLength >= 15) writeLength(out, literalLength - 15);
+    out.insert(out.end(), literals, literals + literalLength);
+}
+
+// Greedy single-probe LZ77 over window[start, end), window[0, start) is history the block may reference
+void compressBlock(const unsigned char* window, std::size_t start, std::size_t end, std::int32_t* table,
+                   std::vector<unsigned char>& out) {
+    std::size_t anchor = start;
+    std::size_t pos = start;
+    if (end - start > matchLimit) {
+        const std::size_t limit = end - matchLimit;
+        while (pos < limit) {
+            std::uint32_t value = read32(window + pos);
+            std::int32_t& slot = table[hash(value)];
+            std::int64_t candidate = slot;
+            slot = static_cast<std::int32_t>(pos);
+            if (candidate < 0 || pos - candidate > maxOffset || read32(window + candidate) != value) {
+                // Step faster the longer nothing matched, incompressible data costs little this way
+                pos += 1 + ((pos - anchor) >> 6);
+                continue;
+            }
+
+            std::size_t match = static_cast<std::size_t>(candidate);
+            while (pos > anchor && match > 0 && window[pos - 1] == window[match - 1]) {
+                --pos;
+                --match;
+            }
+            std::size_t length = minMatch;
+            const std::size_t maxLength = end - lastLiterals - pos;
+            while (length < maxLength && window[pos + length] == window[match + length]) ++length;
+
+            writeSequence(out, window + anchor, pos - anchor, pos - match, length);
+            pos += length;
+            anchor = pos;
+            // Remember a position inside the match too, repeated structures are found again sooner
+            if (pos - 2 >= start && pos < limit) table[hash(read32(window + pos - 2))] = static_cast<std::int32_t>(pos - 2);
+        }
+    }
+    writeLastLiterals(out, window + anchor, end - anchor);
+}
+
+// Decodes one block and appends it to window, matches may reach into what window already holds
+bool decodeBlock(const unsigned char* p, std::size_t size, std::vector<unsigned char>& window) {
+    const unsigned char* end = p + size;
+    const std::size_t blockBegin = window.size();
+    auto readLength = [&](std::size_t& length) {
+        unsigned char byte;
+        do {
+            if (p == end) return false;
+            byte = *p++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    for (;;) {
+        if (p == end) return false;
+        unsigned char token = *p++;
+        std::size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(literalLength)) return false;
+        if (literalLength > static_cast<std::size_t>(end - p) || window.size() - blockBegin + literalLength > blockSize) return false;
+        window.insert(window.end(), p, p + literalLength);
+        p += literalLength;
+        if (p == end) return true; // the last sequence has no match
+
+        if (end - p < 2) return false;
+        std::size_t offset = p[0] | (p[1] << 8);
+        p += 2;
+        std::size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(matchLength)) return false;
+        matchLength += minMatch;
+        if (offset == 0 || offset > window.size() || window.size() - blockBegin + matchLength > blockSize) return false;
+
+        // Byte by byte on purpose, overlapping matches (offset < length) repeat the pattern
+        std::size_t from = window.size() - offset;
+        window.resize(window.size() + matchLength);
+        unsigned char* dst = window.data() + window.size() - matchLength;
+        const unsigned char* src = window.data() + from;
+        for (std::size_t i = 0; i < matchLength; ++i) dst[i] = src[i];
+    }
+}
+
+} // namespace
+
+Compressor::Compressor(std::vector<unsigned char>& out) : out(out), table(std::size_t{1} << hashBits, -1) {
+    window.reserve(maxOffset + blockSize);
+}
+
+void Compressor::write(const unsigned char* data, std::size_t size) {
+    while (size > 0) {
+        std::size_t take = std::min(size, blockSize - (window.size() - blockStart));
+        window.insert(window.end(), data, data + take);
+        data += take;
+        size -= take;
+        if (window.size() - blockStart == blockSize) flushBlock();
+    }
+}
+
+void Compressor::flushBlock() {
+    std::size_t rawSize = window.size() - blockStart;
+    if (rawSize == 0) return;
+
+    std::size_t sizePos = out.size();
+    putLE32(out, 0);
+    compressBlock(window.data(), blockStart, window.size(), table.data(), out);
+    std::size_t packed = out.size() - sizePos - 4;
+    if (packed >= rawSize) {
+        // Did not shrink, store the block as it is
+        out.resize(sizePos + 4);
+        out.insert(out.end(), window.begin() + blockStart, window.end());
+        packed = rawSize | storedFlag;
+    }
+    for (int i = 0; i < 4; ++i) out[sizePos + i] = static_cast<unsigned char>(packed >> (8 * i));
+
+    // Keep the last 64 KiB as history and move the hash table along with it
+    if (window.size() > maxOffset) {
+        std::size_t shift = window.size() - maxOffset;
+        window.erase(window.begin(), window.begin() + shift);
+        for (auto& position : table) {
+            position = position >= static_cast<std::int64_t>(shift) ? position - static_cast<std::int32_t>(shift) : -1;
+        }
+    }
+    blockStart = window.size();
+}
+
+void Compressor::finish() {
+    flushBlock();
+    putLE32(out, 0);
+}
+
+Decompressor::Decompressor(std::vector<unsigned char>& out, std::size_t limit) : out(out), limit(limit) {}
+
+bool Decompressor::write(const unsigned char* data, std::size_t size) {
+    if (done) return true;
+    pending.insert(pending.end(), data, data + size);
+
+    std::size_t consumed = 0;
+    while (!done && pending.size() - consumed >= 4) {
+        const unsigned char* p = pending.data() + consumed;
+        std::uint32_t header = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+        if (header == 0) {
+            done = true;
+            consumed += 4;
+            break;
+        }
+        std::size_t blockBytes = header & ~storedFlag;
+        if ((header & storedFlag) ? blockBytes > blockSize : blockBytes > maxBlockBytes) return false;
+        if (pending.size() - consumed - 4 < blockBytes) break; // wait for the rest of the block
+
+        std::size_t before = window.size();
+        if (header & storedFlag) {
+            window.insert(window.end(), p + 4, p + 4 + blockBytes);
+        } else if (!decodeBlock(p + 4, blockBytes, window)) {
+            return false;
+        }
+        consumed += 4 + blockBytes;
+
+        std::size_t produce = std::min(window.size() - before, limit - produced);
+        out.insert(out.end(), window.begin() + before, window.begin() + before + produce);
+        produced += produce;
+        if (produced == limit) done = true;
+
+        if (window.size() > maxOffset) window.erase(window.begin(), window.end() - maxOffset);
+    }
+    pending.erase(pending.begin(), pending.begin() + consumed);
+    return true;
+}
+
+std::vector<unsigned char> compress(const unsigned char* data, std::size_t size) {
+    std::vector<unsigned char> out;
+    Compressor compressor(out);
+    compressor.write(data, size);
+    compressor.finish();
+    return out;
+}
+
+bool decompress(const unsigned char* data, std::size_t size, std::vector<unsigned char>& out, std::size_t limit) {
+    Decompressor decompressor(out, limit);
+    return decompressor.write(data, size) && decompressor.finished();
+}
+
+} // namespace Lz
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// In-tree LZ77 compressor in the LZ4 block style (token byte, literals, 16-bit offset, 255-extended lengths).
+// Data is cut into 64 KiB blocks and each block may reference the previous 64 KiB, so both sides work
+// as streams with bounded memory. Stream layout: blocks as [u32le size][bytes], size bit 31 marks a block
+// stored uncompressed, a zero size ends the stream.
+namespace Lz {
+
+    // Streaming compressor, appends compressed bytes to `out` as blocks fill up
+    class Compressor {
+    public:
+        explicit Compressor(std::vector<unsigned char>& out);
+
+        void write(const unsigned char* data, std::size_t size);
+        // Function to flush the last block and write the end marker
+        void finish();
+
+    private:
+        void flushBlock();
+
+        std::vector<unsigned char>& out;
+        std::vector<unsigned char> window; // up to 64 KiB of history followed by the pending block
+        std::size_t blockStart = 0;
+        std::vector<std::int32_t> table;   // hash of 4 bytes -> last position in window
+    };
+
+    // Streaming decompressor, appends decompressed bytes to `out`. Decoding stops once `limit` bytes were produced.
+    class Decompressor {
+    public:
+        explicit Decompressor(std::vector<unsigned char>& out, std::size_t limit = SIZE_MAX);
+
+        // Function to feed compressed bytes, returns false on corrupt input
+        bool write(const unsigned char* data, std::size_t size);
+        // True after the end marker (or the limit) was reached
+        bool finished() const { return done; }
+
+    private:
+        std::vector<unsigned char>& out;
+        std::size_t limit;
+        std::size_t produced = 0;
+        std::vector<unsigned char> pending; // input of a block that is not complete yet
+        std::vector<unsigned char> window;  // last 64 KiB of output, matches reach back into it
+        bool done = false;
+    };
+
+    // Function to compress a whole buffer into a stream
+    std::vector<unsigned char> compress(const unsigned char* data, std::size_t size);
+
+    // Function to decompress a whole stream, false on corrupt or unterminated input
+    bool decompress(const unsigned char* data, std::size_t size, std::vector<unsigned char>& out,
+                    std::size_t limit = SIZE_MAX);
+
+} // namespace Lz
@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The worker pool of the multi-file commands: indices are handed out from one atomic counter, so a slow item
+// (a big image) does not hold up a fixed share of the others. The calling thread is one of the workers.
+// An exception thrown for one index never leaves a worker thread (that would end the process): the other
+// indices still run, and the failed one is handed to the caller.
+namespace Parallel {
+
+    // Function to run fn(i) for i in [0, count) on up to hardware_concurrency threads, returns when all are done.
+    // failed(i, error) runs on the worker thread for every index whose fn threw, with the std::exception_ptr.
+    template<typename Fn, typename Failed>
+    void forEach(std::size_t count, Fn fn, Failed failed) {
+        std::size_t threads = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+        std::atomic<std::size_t> next{0};
+        auto worker = [&] {
+            for (std::size_t i = next++; i < count; i = next++) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    failed(i, std::current_exception());
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (std::size_t t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& thread : pool) thread.join();
+    }
+
+    // Function to run fn(i) the same way, the first exception thrown is rethrown once all indices are done
+    template<typename Fn>
+    void forEach(std::size_t count, Fn fn) {
+        std::mutex mutex;
+        std::exception_ptr first;
+        forEach(count, fn, [&](std::size_t, std::exception_ptr error) {
+            std::lock_guard lock(mutex);
+            if (!first) first = error;
+        });
+        if (first) std::rethrow_exception(first);
+    }
+
+    // Function to get the message of a caught exception, for reporting the item that failed
+    inline const char* describe(const std::exception_ptr& error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::exception& e) {
+            return e.what();
+        } catch (...) {
+            return "unknown error";
+        }
+    }
+
+} // namespace Parallel
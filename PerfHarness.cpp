@@ -0,0 +1,459 @@
+#include "Corpus.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fmt/core.h>
+
+// End-to-end performance regression harness (stego_perf, Linux): runs the real command line (-i, -c, -e, -d, -plan,
+// -batch) over the synthetic corpus and measures every run from the outside:
+//  - wall and CPU time (user + system), peak RSS, from wait4
+//  - bytes read and written through read/write calls, from /proc/<pid>/io (taken while the child is a zombie)
+//  - system calls, counted in one extra untimed run under ptrace
+// Times are the best of --runs runs, the other metrics their median. A metric regresses when it is over the committed
+// baseline by more than its relative threshold and an absolute floor (so a 1 ms case does not fail on 0.3 ms of
+// noise); a case that looks slower is measured again before it is reported. Exit code 1 when something regressed.
+//   stego_perf [--tool=path] [--baseline=file] [--update-baseline] [--runs=N] [--threshold=pct] [--filter=text] [--keep]
+
+namespace fs = std::filesystem;
+
+namespace {
+
+#ifndef STEGO_SOURCE_DIR
+#define STEGO_SOURCE_DIR "."
+#endif
+
+enum Metric { WallMs, CpuMs, PeakRssKb, Syscalls, ReadBytes, WriteBytes, MetricCount };
+
+// Relative threshold and absolute floor per metric. Time is the noisy one, the others barely move between runs.
+struct Tolerance {
+    const char* name;
+    double relative;
+    double floor;
+};
+
+std::array<Tolerance, MetricCount> tolerances = {{
+    {"wall_ms", 0.25, 5.0},
+    {"cpu_ms", 0.25, 5.0},
+    {"peak_rss_kb", 0.10, 1024},
+    {"syscalls", 0.05, 16},
+    {"read_bytes", 0.02, 8192},
+    {"write_bytes", 0.02, 8192},
+}};
+
+using Metrics = std::array<double, MetricCount>;
+
+struct Settings {
+    std::string tool;
+    std::string baseline = STEGO_SOURCE_DIR "/perf_baseline.tsv";
+    std::string filter;
+    bool update = false;
+    bool keep = false;
+    int runs = 5;
+};
+
+// A command line run: `prepare` once before the measurements, `reset` before every single run (both untimed)
+struct Case {
+    std::string name;
+    std::vector<std::string> args;
+    std::function<bool()> prepare;
+    std::function<bool()> reset;
+};
+
+// ---------------------------------------- running a child ----------------------------------------
+
+// Function to start the tool with stdout/stderr going to the log, optionally stopped for ptrace before exec
+pid_t spawn(const std::vector<std::string>& args, const std::string& log, bool traced) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    std::vector<char*> argv;
+    for (const std::string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    if (traced) {
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        raise(SIGSTOP);
+    }
+    execv(argv[0], argv.data());
+    _exit(127);
+}
+
+// I/O counters of a child that exited but is not reaped yet
+void readProcIo(pid_t pid, Metrics& metrics) {
+    std::ifstream file("/proc/" + std::to_string(pid) + "/io");
+    std::string key;
+    std::uint64_t value;
+    while (file >> key >> value) {
+        if (key == "rchar:") metrics[ReadBytes] = static_cast<double>(value);
+        else if (key == "wchar:") metrics[WriteBytes] = static_cast<double>(value);
+    }
+}
+
+double milliseconds(const timeval& t) { return t.tv_sec * 1e3 + t.tv_usec / 1e3; }
+
+// Function to run the tool once and measure it, false if it could not run or exited with an error
+bool runTimed(const std::vector<std::string>& args, const std::string& log, Metrics& metrics) {
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = spawn(args, log, false);
+    if (pid < 0) return false;
+    siginfo_t info{};
+    // WNOWAIT keeps the zombie, so /proc/<pid>/io can still be read
+    if (waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT) != 0) return false;
+    metrics[WallMs] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    readProcIo(pid, metrics);
+    int status = 0;
+    rusage usage{};
+    if (wait4(pid, &status, 0, &usage) != pid) return false;
+    metrics[CpuMs] = milliseconds(usage.ru_utime) + milliseconds(usage.ru_stime);
+    metrics[PeakRssKb] = static_cast<double>(usage.ru_maxrss);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Function to count the system calls of one run: every thread stops at syscall entry and exit, entries are counted
+long countSyscalls(const std::vector<std::string>& args, const std::string& log) {
+    pid_t pid = spawn(args, log, true);
+    if (pid < 0) return -1;
+    int status = 0;
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) return -1;
+    long options = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL;
+    if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, options) != 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+        return -1;
+    }
+    std::map<pid_t, bool> inSyscall;
+    long count = 0;
+    ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr);
+    for (;;) {
+        pid_t tid = waitpid(-1, &status, __WALL);
+        if (tid < 0) break;
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            inSyscall.erase(tid);
+            if (tid == pid) break;
+            continue;
+        }
+        if (!WIFSTOPPED(status)) continue;
+        int signal = WSTOPSIG(status);
+        int deliver = 0;
+        if (signal == (SIGTRAP | 0x80)) {
+            bool& inside = inSyscall[tid];
+            if (!inside) ++count;
+            inside = !inside;
+        } else if (signal == SIGTRAP || signal == SIGSTOP) {
+            // Clone events and the initial stop of new threads, nothing to deliver
+        } else {
+            deliver = signal;
+        }
+        ptrace(PTRACE_SYSCALL, tid, nullptr, deliver);
+    }
+    // The main thread is gone, reap the zombie if the loop left it
+    waitpid(pid, &status, __WALL | WNOHANG);
+    return count;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    std::size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+using Samples = std::array<std::vector<double>, MetricCount>;
+
+// Function to run a case `runs` times, adding to the samples
+bool measure(const Case& c, int runs, const std::string& log, Samples& samples) {
+    for (int run = 0; run < runs; ++run) {
+        Metrics metrics{};
+        if ((c.reset && !c.reset()) || !runTimed(c.args, log, metrics)) return false;
+        for (int m = 0; m < MetricCount; ++m) samples[m].push_back(metrics[m]);
+    }
+    return true;
+}
+
+// Noise only ever adds time, so times are the best run; the other metrics are the median
+Metrics summarize(const Samples& samples, long syscalls) {
+    Metrics metrics{};
+    for (int m = 0; m < MetricCount; ++m) {
+        if (m == WallMs || m == CpuMs) metrics[m] = *std::min_element(samples[m].begin(), samples[m].end());
+        else metrics[m] = m == Syscalls ? static_cast<double>(syscalls) : median(samples[m]);
+    }
+    return metrics;
+}
+
+// ---------------------------------------- baseline ----------------------------------------
+
+using Baseline = std::map<std::string, std::map<std::string, double>>;
+
+Baseline readBaseline(const std::string& filename) {
+    Baseline baseline;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string name, metric;
+        double value;
+        if (std::getline(fields, name, '\t') && std::getline(fields, metric, '\t') && fields >> value) {
+            baseline[name][metric] = value;
+        }
+    }
+    return baseline;
+}
+
+// Function to compare a case with its baseline values, "ok" or the metrics that regressed
+std::string compare(const std::map<std::string, double>& base, const Metrics& metrics) {
+    std::string status;
+    for (int m = 0; m < MetricCount; ++m) {
+        auto value = base.find(tolerances[m].name);
+        if (value == base.end() || metrics[m] < 0) continue;
+        double delta = metrics[m] - value->second;
+        if (delta > value->second * tolerances[m].relative && delta > tolerances[m].floor) {
+            status += fmt::format("{}{} +{:.0f}%", status.empty() ? "REGRESSION " : ", ", tolerances[m].name,
+                                  value->second > 0 ? delta / value->second * 100 : 100);
+        }
+    }
+    return status.empty() ? "ok" : status;
+}
+
+std::string cpuModel() {
+    std::ifstream file("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.rfind("model name", 0) == 0) return line.substr(line.find(':') + 2);
+    }
+    return "unknown CPU";
+}
+
+bool writeBaseline(const std::string& filename, const std::vector<std::pair<std::string, Metrics>>& results) {
+    std::ofstream file(filename);
+    if (!file) {
+        fmt::println("Failed to open {} for writing.", filename);
+        return false;
+    }
+    file << "# stego_perf baseline: case, metric, value (tab separated). Machine specific, regenerate with\n";
+    file << "# stego_perf --update-baseline on the machine that runs the comparison.\n";
+    file << fmt::format("# {}, {} threads\n", cpuModel(), std::thread::hardware_concurrency());
+    for (const auto& [name, metrics] : results) {
+        for (int m = 0; m < MetricCount; ++m) {
+            if (metrics[m] >= 0) file << fmt::format("{}\t{}\t{:.1f}\n", name, tolerances[m].name, metrics[m]);
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+// ---------------------------------------- cases ----------------------------------------
+
+std::string readFile(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+bool copyFile(const fs::path& from, const fs::path& to) {
+    std::error_code error;
+    fs::copy_file(from, to, fs::copy_options::overwrite_existing, error);
+    return !error;
+}
+
+std::vector<Case> buildCases(const Settings& settings, const fs::path& work, const fs::path& corpus) {
+    const std::string tool = settings.tool;
+    const std::string big = "bmp24_noise_4001x2999.bmp";
+    const std::vector<std::string> images = {big, "bmp32_noise_1021x765.bmp", "ppm16_noise_1279x719.ppm",
+                                             "pgm8_gradient_2047x1535.pgm"};
+    const std::string text1k = readFile(corpus / "payload_text_1024.txt");
+    const std::string text64k = readFile(corpus / "payload_text_65536.txt");
+    auto stem = [](const std::string& file) { return fs::path(file).stem().string(); };
+
+    std::vector<Case> cases;
+    for (const std::string& image : images) {
+        std::string path = (corpus / image).string();
+        cases.push_back({"info/" + stem(image), {tool, "-i", path}, nullptr, nullptr});
+        cases.push_back({"check/" + stem(image) + "/text1k", {tool, "-c", path, text1k}, nullptr, nullptr});
+    }
+
+    // -e rewrites the carrier, every run starts from a fresh copy
+    struct Encrypt {
+        std::string image, label, message;
+        std::vector<std::string> options;
+    };
+    fs::path keyFile = work / "key.txt";
+    std::ofstream(keyFile) << std::string(64, 'a') << '\n';
+    const std::vector<Encrypt> encrypts = {
+        {big, "text1k", text1k, {}},
+        {big, "text64k", text64k, {}},
+        {big, "text64k/compress", text64k, {"--compress"}},
+        {big, "text64k/key", text64k, {"--key-file=" + keyFile.string()}},
+        {big, "text64k/k2", text64k, {"--bits-per-sample=2"}},
+        {big, "text64k/fec", text64k, {"--fec=32"}},
+        {"ppm16_noise_1279x719.ppm", "text64k", text64k, {}},
+        {"pgm8_gradient_2047x1535.pgm", "text64k", text64k, {}},
+    };
+    for (const Encrypt& e : encrypts) {
+        fs::path source = corpus / e.image, carrier = work / ("carrier" + fs::path(e.image).extension().string());
+        std::vector<std::string> args = {tool, "-e", carrier.string(), e.message};
+        args.insert(args.end(), e.options.begin(), e.options.end());
+        cases.push_back({"encrypt/" + stem(e.image) + "/" + e.label, args, nullptr,
+                         [source, carrier] { return copyFile(source, carrier); }});
+
+        // -d on a carrier prepared once with the same message and options
+        fs::path stego = work / ("stego_" + std::to_string(cases.size()) + fs::path(e.image).extension().string());
+        std::vector<std::string> embed = {tool, "-e", stego.string(), e.message};
+        embed.insert(embed.end(), e.options.begin(), e.options.end());
+        std::vector<std::string> extract = {tool, "-d", stego.string()};
+        extract.insert(extract.end(), e.options.begin(), e.options.end());
+        std::string log = (work / "prepare.log").string();
+        cases.push_back({"decrypt/" + stem(e.image) + "/" + e.label, extract,
+                         [source, stego, embed, log] {
+                             Metrics unused{};
+                             return copyFile(source, stego) && runTimed(embed, log, unused);
+                         },
+                         nullptr});
+    }
+
+    // -plan over a pool of carriers, then -batch of its manifest on fresh copies of the pool
+    fs::path pool = work / "pool", messages = work / "messages.txt", manifest = work / "manifest.tsv";
+    const std::vector<std::string> poolImages = {"bmp24_noise_1023x767.bmp", "bmp24_gradient_1023x767.bmp",
+                                                 "bmp32_noise_1021x765.bmp", "ppm8_noise_1921x1081.ppm",
+                                                 "pgm8_noise_2047x1535.pgm", big};
+    auto fillPool = [=] {
+        std::error_code error;
+        fs::create_directories(pool, error);
+        for (const std::string& image : poolImages) {
+            if (!copyFile(corpus / image, pool / image)) return false;
+        }
+        return true;
+    };
+    auto writeMessages = [=] {
+        std::ofstream list(messages);
+        for (const char* file : {"payload_text_1024.txt", "payload_text_65536.txt", "payload_random_65536.txt",
+                                 "payload_text_1048576.txt", "payload_random_1048576.txt"}) {
+            list << (corpus / file).string() << '\n';
+        }
+        return fillPool() && static_cast<bool>(list);
+    };
+    std::vector<std::string> planArgs = {tool, "-plan", pool.string(), messages.string(), manifest.string()};
+    cases.push_back({"plan", planArgs, writeMessages, nullptr});
+    std::string log = (work / "prepare.log").string();
+    cases.push_back({"batch", {tool, "-batch", manifest.string()},
+                     [=] {
+                         Metrics unused{};
+                         return writeMessages() && runTimed(planArgs, log, unused);
+                     },
+                     fillPool});
+    return cases;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    double threshold = -1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.starts_with("--tool=")) settings.tool = arg.substr(7);
+        else if (arg.starts_with("--baseline=")) settings.baseline = arg.substr(11);
+        else if (arg.starts_with("--filter=")) settings.filter = arg.substr(9);
+        else if (arg.starts_with("--runs=")) settings.runs = std::max(1, std::atoi(arg.c_str() + 7));
+        else if (arg.starts_with("--threshold=")) threshold = std::atof(arg.c_str() + 12) / 100;
+        else if (arg == "--update-baseline") settings.update = true;
+        else if (arg == "--keep") settings.keep = true;
+        else {
+            fmt::println("Usage: stego_perf [--tool=path] [--baseline=file] [--update-baseline] [--runs=N] "
+                         "[--threshold=pct] [--filter=text] [--keep]");
+            fmt::println("--threshold sets the allowed slowdown of wall and CPU time (25% by default).");
+            return 1;
+        }
+    }
+    if (threshold > 0) tolerances[WallMs].relative = tolerances[CpuMs].relative = threshold;
+    if (settings.tool.empty()) {
+        // The tool is built next to the harness
+        std::error_code error;
+        settings.tool = (fs::read_symlink("/proc/self/exe", error).parent_path() / "Steganography_project").string();
+    }
+    if (!fs::exists(settings.tool)) {
+        fmt::println("{} not found, pass --tool=path.", settings.tool);
+        return 1;
+    }
+
+    fs::path work = fs::temp_directory_path() / fmt::format("stego_perf_{}", getpid());
+    fs::path corpus = work / "corpus";
+    if (Corpus::writeStandardCorpus(corpus.string(), 1, 1).empty()) {
+        fmt::println("Failed to generate the corpus in {}.", corpus.string());
+        return 1;
+    }
+    std::vector<Case> cases = buildCases(settings, work, corpus);
+    std::erase_if(cases, [&](const Case& c) { return c.name.find(settings.filter) == std::string::npos; });
+
+    Baseline baseline = readBaseline(settings.baseline);
+    if (baseline.empty() && !settings.update) fmt::println("No baseline in {}, nothing to compare.", settings.baseline);
+
+    fmt::println("{:<48} {:>9} {:>9} {:>8} {:>8} {:>9} {:>9}  {}", "case", "wall ms", "cpu ms", "rss MB", "syscalls",
+                 "read MB", "write MB", "status");
+    const std::string log = (work / "run.log").string();
+    std::vector<std::pair<std::string, Metrics>> results;
+    int regressions = 0, failures = 0;
+    for (const Case& c : cases) {
+        if (c.prepare && !c.prepare()) {
+            fmt::println("{:<48} setup failed", c.name);
+            ++failures;
+            continue;
+        }
+        Samples samples;
+        bool ok = measure(c, settings.runs, log, samples);
+        long syscalls = ok && (!c.reset || c.reset()) ? countSyscalls(c.args, log) : -1;
+        if (!ok) {
+            fmt::println("{:<48} FAILED, see {}", c.name, log);
+            ++failures;
+            settings.keep = true;
+            continue;
+        }
+        Metrics metrics = summarize(samples, syscalls);
+        auto known = baseline.find(c.name);
+        std::string status = known == baseline.end() ? "new" : compare(known->second, metrics);
+        if (status != "new" && status != "ok" && measure(c, settings.runs, log, samples)) {
+            // A second round of runs before calling it a regression, one slow round is usually the machine
+            metrics = summarize(samples, syscalls);
+            status = compare(known->second, metrics);
+        }
+        if (status != "new" && status != "ok") ++regressions;
+        fmt::println("{:<48} {:>9.1f} {:>9.1f} {:>8.1f} {:>8} {:>9.2f} {:>9.2f}  {}", c.name, metrics[WallMs],
+                     metrics[CpuMs], metrics[PeakRssKb] / 1024, syscalls < 0 ? std::string("n/a") : std::to_string(syscalls),
+                     metrics[ReadBytes] / 1e6, metrics[WriteBytes] / 1e6, status);
+        std::fflush(stdout);
+        results.emplace_back(c.name, metrics);
+    }
+
+    std::error_code error;
+    if (!settings.keep) fs::remove_all(work, error);
+    else fmt::println("Work files kept in {}.", work.string());
+
+    if (settings.update) {
+        if (failures || !writeBaseline(settings.baseline, results)) return 1;
+        fmt::println("Baseline written to {}.", settings.baseline);
+        return 0;
+    }
+    if (regressions || failures) {
+        fmt::println("{} regression(s), {} failure(s).", regressions, failures);
+        return 1;
+    }
+    return 0;
+}
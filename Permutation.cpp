@@ -0,0 +1,17 @@
+#include "Permutation.h"
+
+namespace Permutation {
+
+// Function to derive the Feistel round keys from the message key
+RoundKeys roundKeys(const Crypto::Key& key) {
+    // ChaCha20 keystream under a fixed nonce that the payload cipher never uses (its nonces are random)
+    const Crypto::Nonce nonce = {'c', 'a', 'r', 'r', 'i', 'e', 'r', '-', 'o', 'r', 'd', 'r'};
+    unsigned char bytes[32] = {};
+    Crypto::chacha20Xor(key, nonce, 0, bytes, bytes, sizeof(bytes));
+
+    RoundKeys keys{};
+    for (int i = 0; i < 32; ++i) keys[i / 8] |= static_cast<std::uint64_t>(bytes[i]) << (8 * (i % 8));
+    return keys;
+}
+
+} // namespace Permutation
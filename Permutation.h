@@ -0,0 +1,116 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include "Crypto.h"
+
+// Keyed pseudo-random carrier order without an index table.
+// Payload bit i goes to chunk i % chunks and inside that chunk to a keyed Feistel permutation of i / chunks.
+// Every chunk is a contiguous carrier range of at most 64 KiB, so walking one chunk stays in cache, the message is
+// spread evenly over the whole carrier, and separate chunks can be handled by separate threads.
+namespace Permutation {
+
+    using RoundKeys = std::array<std::uint64_t, 4>;
+
+    // Function to derive the Feistel round keys from the message key (separate from the cipher keystream)
+    RoundKeys roundKeys(const Crypto::Key& key);
+
+    // Keyed bijection of [0, size): a 4-round balanced Feistel network over the smallest even bit width
+    // that covers size. Outputs past size are encrypted again (cycle walking) until they land inside,
+    // which takes fewer than 4 rounds of that on average since the domain is less than 4x size.
+    class Feistel {
+    public:
+        Feistel(const RoundKeys& keys, std::uint64_t tweak, std::uint32_t size) : keys(keys), tweak(tweak), size(size) {
+            int bits = size > 1 ? std::bit_width(size - 1) : 1;
+            halfBits = (bits + 1) / 2;
+            mask = (1u << halfBits) - 1;
+        }
+
+        std::uint32_t operator()(std::uint32_t value) const {
+            do {
+                value = encrypt(value);
+            } while (value >= size);
+            return value;
+        }
+
+    private:
+        std::uint32_t encrypt(std::uint32_t value) const {
+            std::uint32_t left = value >> halfBits, right = value & mask;
+            for (int round = 0; round < 4; ++round) {
+                std::uint32_t next = left ^ (mix(keys[round] ^ tweak ^ right) & mask);
+                left = right;
+                right = next;
+            }
+            return (left << halfBits) | right;
+        }
+
+        // Round function: one 64-bit multiply, the high half mixes every input bit. This only has to
+        // look random to someone without the key, the message itself is protected by the cipher.
+        static std::uint32_t mix(std::uint64_t x) {
+            x *= 0x9e3779b97f4a7c15ull;
+            return static_cast<std::uint32_t>(x >> 32) ^ static_cast<std::uint32_t>(x >> 13);
+        }
+
+        const RoundKeys& keys;
+        std::uint64_t tweak;
+        std::uint32_t size;
+        int halfBits;
+        std::uint32_t mask;
+    };
+
+    // Keyed order of `samples` carrier positions, O(1) memory
+    class Order {
+    public:
+        // 2^16: chunks are nearly full powers of two, so cycle walking rarely has to repeat, and fit in L2
+        static constexpr std::size_t chunkSize = 64 * 1024;
+
+        Order(std::size_t samples, const Crypto::Key& key)
+            : keys(roundKeys(key)), samples(samples), chunks(samples > chunkSize ? (samples + chunkSize - 1) / chunkSize : 1),
+              base(samples / chunks), extra(samples % chunks) {}
+
+        std::size_t size() const { return samples; }
+        std::size_t chunkCount() const { return chunks; }
+
+        // Carrier position of sample i
+        std::size_t operator()(std::size_t i) const {
+            std::size_t chunk = i % chunks;
+            return chunkBegin(chunk) + feistel(chunk)(static_cast<std::uint32_t>(i / chunks));
+        }
+
+        // Function to call fn(i, position) for every i in [first, last) whose chunk is in [chunkFirst, chunkLast),
+        // one chunk after the other so each chunk is walked while it is in cache
+        template <typename Fn>
+        void forEach(std::size_t first, std::size_t last, std::size_t chunkFirst, std::size_t chunkLast, Fn&& fn) const {
+            if (last - first < chunks) {
+                // Fewer samples than chunks (e.g. just the header), every sample is in a different chunk anyway
+                for (std::size_t i = first; i < last; ++i) {
+                    std::size_t chunk = i % chunks;
+                    if (chunk >= chunkFirst && chunk < chunkLast) fn(i, (*this)(i));
+                }
+                return;
+            }
+            for (std::size_t chunk = chunkFirst; chunk < chunkLast; ++chunk) {
+                Feistel permute = feistel(chunk);
+                std::size_t begin = chunkBegin(chunk);
+                std::size_t j = first > chunk ? (first - chunk + chunks - 1) / chunks : 0;
+                for (std::size_t i = j * chunks + chunk; i < last; i += chunks, ++j) {
+                    fn(i, begin + permute(static_cast<std::uint32_t>(j)));
+                }
+            }
+        }
+
+    private:
+        // Chunk c holds the samples i with i % chunks == c, the first `extra` chunks get one more
+        std::size_t chunkBegin(std::size_t chunk) const { return chunk * base + (chunk < extra ? chunk : extra); }
+        std::size_t chunkLength(std::size_t chunk) const { return base + (chunk < extra ? 1 : 0); }
+        Feistel feistel(std::size_t chunk) const { return Feistel(keys, chunk, static_cast<std::uint32_t>(chunkLength(chunk))); }
+
+        RoundKeys keys;
+        std::size_t samples;
+        std::size_t chunks;
+        std::size_t base;
+        std::size_t extra;
+    };
+
+} // namespace Permutation
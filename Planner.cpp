@@ -0,0 +1,227 @@
+#include "Planner.h"
+#include "Parallel.h"
+#include "Probe.h"
+#include "Slots.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <queue>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+#include <fmt/core.h>
+
+namespace Planner {
+
+namespace {
+
+struct Payload {
+    std::string path;
+    std::string name;
+    std::size_t samples = 0; // carrier samples the slot takes
+};
+
+struct Carrier {
+    std::size_t room = 0; // samples left for slots
+    int slots = 0;
+    std::vector<std::size_t> payloads;
+};
+
+bool readLines(const std::string& path, std::vector<std::string>& lines) {
+    std::ifstream file(path);
+    if (!file) {
+        fmt::println("Failed to open '{}'.", path);
+        return false;
+    }
+    for (std::string line; std::getline(file, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty() && line[0] != '#') lines.push_back(line);
+    }
+    return true;
+}
+
+bool readFile(const std::string& path, std::string& content) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+bool listCarriers(const std::string& path, std::vector<std::string>& files) {
+    if (!std::filesystem::is_directory(path)) return readLines(path, files);
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_regular_file(error)) files.push_back(it->path().string());
+    }
+    if (error) fmt::println("Failed to read directory '{}': {}", path, error.message());
+    return !error;
+}
+
+} // namespace
+
+// Function to plan where the messages go
+bool plan(const std::string& carriers, const std::string& payloads, const std::string& manifest,
+          Objective objective, const Steganography::EmbedOptions& options) {
+    std::vector<std::string> carrierFiles, payloadFiles;
+    if (!listCarriers(carriers, carrierFiles) || !readLines(payloads, payloadFiles)) return false;
+
+    // Slot sizes depend on the options (compression, encryption, layout), so they are the ones -batch has to get
+    std::vector<Payload> items(payloadFiles.size());
+    std::atomic<bool> readable{true};
+    Parallel::forEach(items.size(), [&](std::size_t i) {
+        Payload& item = items[i];
+        item.path = payloadFiles[i];
+        item.name = std::filesystem::path(item.path).filename().string().substr(0, Slots::nameSize);
+        std::string message;
+        if (!readFile(item.path, message)) {
+            fmt::println("Failed to read message file '{}'.", item.path);
+            readable = false;
+            return;
+        }
+        std::vector<unsigned char> payload = Steganography::buildPayload(message, options);
+        item.samples = Steganography::payloadLayout(payload).samplesFor(payload.size() * 8);
+    }, [&](std::size_t i, std::exception_ptr error) {
+        fmt::println("Failed to read message file '{}': {}", payloadFiles[i], Parallel::describe(error));
+        readable = false;
+    });
+    if (!readable) return false;
+    std::unordered_set<std::string> names;
+    for (const Payload& item : items) {
+        if (!names.insert(item.name).second) {
+            fmt::println("Two message files are named '{}', slot names have to be unique.", item.name);
+            return false;
+        }
+    }
+
+    // Only the image headers are read, unreadable files just have no room
+    std::vector<Carrier> pool(carrierFiles.size());
+    Parallel::forEach(pool.size(), [&](std::size_t i) {
+        ImageHandler::ImageInfo info;
+        if (!Probe::readInfo(carrierFiles[i], info)) return;
+        std::size_t samples = info.rowStride * static_cast<std::size_t>(info.height) / (info.maxVal > 255 ? 2 : 1);
+        pool[i].room = samples > Slots::directorySamples() ? samples - Slots::directorySamples() : 0;
+    }, [&](std::size_t i, std::exception_ptr error) {
+        fmt::println("Carrier '{}' is unreadable ({}).", carrierFiles[i], Parallel::describe(error));
+    });
+
+    std::vector<std::size_t> order(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return items[a].samples > items[b].samples; });
+    auto place = [&](std::size_t carrier, std::size_t item) {
+        pool[carrier].room -= items[item].samples;
+        pool[carrier].slots += 1;
+        pool[carrier].payloads.push_back(item);
+    };
+    auto unplaced = [&](std::size_t item) {
+        fmt::println("'{}' ({} samples) fits in none of the carriers left.", items[item].path, items[item].samples);
+        return false;
+    };
+
+    if (objective == Objective::MinCarriers) {
+        // Open carriers by room left, the smallest one that still fits is found with lower_bound
+        std::vector<std::size_t> unused(pool.size());
+        std::iota(unused.begin(), unused.end(), 0);
+        std::sort(unused.begin(), unused.end(), [&](std::size_t a, std::size_t b) { return pool[a].room > pool[b].room; });
+        std::size_t nextUnused = 0;
+        std::multimap<std::size_t, std::size_t> open;
+        for (std::size_t item : order) {
+            std::size_t carrier;
+            auto fit = open.lower_bound(items[item].samples);
+            if (fit != open.end()) {
+                carrier = fit->second;
+                open.erase(fit);
+            } else {
+                if (nextUnused == unused.size() || pool[unused[nextUnused]].room < items[item].samples) return unplaced(item);
+                carrier = unused[nextUnused++];
+            }
+            place(carrier, item);
+            if (pool[carrier].slots < Slots::defaultSlots) open.emplace(pool[carrier].room, carrier);
+        }
+    } else {
+        auto less = [&](std::size_t a, std::size_t b) { return pool[a].room < pool[b].room; };
+        std::vector<std::size_t> heap(pool.size());
+        std::iota(heap.begin(), heap.end(), 0);
+        std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(less)> roomiest(less, std::move(heap));
+        for (std::size_t item : order) {
+            if (roomiest.empty() || pool[roomiest.top()].room < items[item].samples) return unplaced(item);
+            std::size_t carrier = roomiest.top();
+            roomiest.pop();
+            place(carrier, item);
+            if (pool[carrier].slots < Slots::defaultSlots) roomiest.push(carrier);
+        }
+    }
+
+    std::ofstream out(manifest);
+    if (!out) {
+        fmt::println("Failed to create manifest '{}'.", manifest);
+        return false;
+    }
+    std::size_t used = 0, leastRoom = SIZE_MAX, totalRoom = 0;
+    for (const Carrier& carrier : pool) {
+        if (carrier.payloads.empty()) continue;
+        ++used;
+        leastRoom = std::min(leastRoom, carrier.room);
+        totalRoom += carrier.room;
+    }
+    out << fmt::format("# {} messages on {} of {} carriers ({})\n", items.size(), used, pool.size(),
+                       objective == Objective::MinCarriers ? "min" : "spread");
+    out << "# carrier\tslot name\tmessage file\n";
+    for (std::size_t i = 0; i < pool.size(); ++i) {
+        for (std::size_t item : pool[i].payloads) {
+            out << carrierFiles[i] << '\t' << items[item].name << '\t' << items[item].path << '\n';
+        }
+    }
+    if (!out) {
+        fmt::println("Error writing manifest.");
+        return false;
+    }
+    fmt::println("{} messages on {} of {} carriers, headroom {} samples in total, {} in the fullest carrier.",
+                 items.size(), used, pool.size(), totalRoom, used ? leastRoom : 0);
+    return true;
+}
+
+// Function to carry out a manifest
+long runManifest(const std::string& manifest, const Steganography::EmbedOptions& options) {
+    std::vector<std::string> lines;
+    if (!readLines(manifest, lines)) return -1;
+
+    // Slots of one carrier go in manifest order on one thread, different carriers run side by side
+    std::vector<std::string> carriers;
+    std::map<std::string, std::vector<std::pair<std::string, std::string>>> slots;
+    for (const std::string& line : lines) {
+        std::size_t first = line.find('\t'), second = line.find('\t', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            fmt::println("Invalid manifest line '{}'.", line);
+            return -1;
+        }
+        std::string carrier = line.substr(0, first);
+        auto& list = slots[carrier];
+        if (list.empty()) carriers.push_back(carrier);
+        list.emplace_back(line.substr(first + 1, second - first - 1), line.substr(second + 1));
+    }
+
+    std::atomic<long> written{0};
+    Parallel::forEach(carriers.size(), [&](std::size_t i) {
+        for (const auto& [name, path] : slots.at(carriers[i])) {
+            std::string message;
+            if (!readFile(path, message)) {
+                fmt::println("Failed to read message file '{}'.", path);
+            } else if (Slots::addSlot(carriers[i], name, message, options)) {
+                ++written;
+            } else {
+                fmt::println("Slot '{}' was not written to '{}'.", name, carriers[i]);
+            }
+        }
+    }, [&](std::size_t i, std::exception_ptr error) {
+        fmt::println("Writing slots to '{}' stopped: {}", carriers[i], Parallel::describe(error));
+    });
+    fmt::println("{} of {} messages written.", written.load(), lines.size());
+    return written;
+}
+
+} // namespace Planner
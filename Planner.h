@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include "Steganography.h"
+
+// Capacity planning for many messages over a pool of carriers (-plan) and the batch mode that carries a plan out
+// (-batch). Carrier capacities come from header-only reads (Probe::readInfo) on parallel threads, message sizes from
+// building their payloads with the given options. Messages become named slots (see Slots.h), so one carrier can take
+// several of them, up to the directory's 16 slots.
+//
+// Objectives:
+//   min    - best fit decreasing: the largest message first, into the fullest carrier it still fits, a new carrier
+//            (the largest unused one) only when none does. Few carriers, little headroom left in them.
+//   spread - worst fit decreasing: every message goes to the carrier with the most room left, so the headroom of
+//            the fullest carrier is as large as it gets.
+//
+// Manifest: text, '#' lines are comments, one line per message: carrier path, slot name, message file, tab separated.
+namespace Planner {
+
+    enum class Objective { MinCarriers, Spread };
+
+    // Function to plan where the messages go. `carriers` is a directory (scanned recursively) or a text file with one
+    // image path per line, `payloads` a text file with one message file per line (the slot name is its file name,
+    // cut to 16 bytes). Writes the manifest, false if a message fits no carrier.
+    bool plan(const std::string& carriers, const std::string& payloads, const std::string& manifest,
+              Objective objective, const Steganography::EmbedOptions& options = {});
+
+    // Function to carry out a manifest, carriers in parallel and the slots of one carrier in order.
+    // Returns the number of messages written, -1 if the manifest cannot be read.
+    long runManifest(const std::string& manifest, const Steganography::EmbedOptions& options = {});
+
+} // namespace Planner
@@ -0,0 +1,381 @@
+#include "ImageFormats.h"
+#include "Deflate.h"
+#include "ImageKernels.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <fmt/core.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ImageHandler {
+
+    namespace {
+
+        constexpr unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+        //Keep IDAT chunks reasonably small, some readers dislike huge chunks
+        constexpr std::size_t idatChunkSize = 1 << 20;
+        //DEFLATE turns one input byte into at most 1032 output bytes (258-byte matches in 2-bit codes)
+        constexpr std::size_t maxInflateRatio = 1032;
+
+        std::uint32_t readBE32(const unsigned char *p) {
+            return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+        }
+
+        void writeBE32(unsigned char *p, std::uint32_t value) {
+            p[0] = static_cast<unsigned char>(value >> 24);
+            p[1] = static_cast<unsigned char>(value >> 16);
+            p[2] = static_cast<unsigned char>(value >> 8);
+            p[3] = static_cast<unsigned char>(value);
+        }
+
+        struct Chunk {
+            char type[5] = {};
+            std::vector<unsigned char> data;
+        };
+
+        //Reads one chunk and checks its CRC (computed over type + data)
+        bool readChunk(std::istream &file, Chunk &chunk) {
+            unsigned char head[8];
+            file.read(reinterpret_cast<char *>(head), 8);
+            if (!file) return false;
+            std::uint32_t length = readBE32(head);
+            if (length > 0x7FFFFFFF) return false;
+            std::memcpy(chunk.type, head + 4, 4);
+            chunk.data.resize(length + 4); //the CRC goes to the end and is removed below
+            file.read(reinterpret_cast<char *>(chunk.data.data()), length + 4);
+            if (!file) return false;
+
+            std::uint32_t expected = readBE32(chunk.data.data() + length);
+            chunk.data.resize(length);
+            std::uint32_t crc = Deflate::crc32(head + 4, 4);
+            crc = Deflate::crc32(chunk.data.data(), length, crc);
+            return crc == expected;
+        }
+
+        void writeChunk(std::ostream &file, const char *type, const unsigned char *data, std::size_t length) {
+            unsigned char head[8];
+            writeBE32(head, static_cast<std::uint32_t>(length));
+            std::memcpy(head + 4, type, 4);
+            std::uint32_t crc = Deflate::crc32(head + 4, 4);
+            crc = Deflate::crc32(data, length, crc);
+            unsigned char tail[4];
+            writeBE32(tail, crc);
+            file.write(reinterpret_cast<const char *>(head), 8);
+            file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(length));
+            file.write(reinterpret_cast<const char *>(tail), 4);
+        }
+
+        int bytesPerPixel(const ImageInfo &info) {
+            return info.channels * (info.maxVal > 255 ? 2 : 1);
+        }
+
+        inline unsigned char paeth(int a, int b, int c) {
+            int pa = std::abs(b - c);
+            int pb = std::abs(a - c);
+            int pc = std::abs(a + b - 2 * c);
+            if (pa <= pb && pa <= pc) return static_cast<unsigned char>(a);
+            return static_cast<unsigned char>(pb <= pc ? b : c);
+        }
+
+#if defined(__SSE2__)
+        template<int Bpp>
+        inline __m128i loadPixel(const unsigned char *p) {
+            std::uint64_t value = 0;
+            std::memcpy(&value, p, Bpp);
+            return _mm_unpacklo_epi8(_mm_cvtsi64_si128(static_cast<long long>(value)), _mm_setzero_si128());
+        }
+
+        template<int Bpp>
+        inline void storePixel(unsigned char *p, __m128i pixel) {
+            std::uint64_t value = static_cast<std::uint64_t>(_mm_cvtsi128_si64(_mm_packus_epi16(pixel, pixel)));
+            std::memcpy(p, &value, Bpp);
+        }
+
+        inline __m128i select(__m128i mask, __m128i ifSet, __m128i ifClear) {
+            return _mm_or_si128(_mm_and_si128(mask, ifSet), _mm_andnot_si128(mask, ifClear));
+        }
+
+        //Paeth reversal, one pixel per iteration with every byte of the pixel in its own 16-bit lane.
+        //The left neighbour is the pixel just reconstructed, so the row itself is inherently sequential.
+        template<int Bpp>
+        void unpaethSse2(unsigned char *row, const unsigned char *prev, std::size_t rowBytes) {
+            const __m128i lowByte = _mm_set1_epi16(0xFF);
+            __m128i a = _mm_setzero_si128();
+            __m128i c = _mm_setzero_si128();
+            for (std::size_t i = 0; i + Bpp <= rowBytes; i += Bpp) {
+                __m128i b = loadPixel<Bpp>(prev + i);
+                __m128i x = loadPixel<Bpp>(row + i);
+
+                __m128i pa = ImageKernels::abs16(_mm_sub_epi16(b, c));
+                __m128i pb = ImageKernels::abs16(_mm_sub_epi16(a, c));
+                __m128i pc = ImageKernels::abs16(_mm_add_epi16(_mm_sub_epi16(b, c), _mm_sub_epi16(a, c)));
+                __m128i bOrC = select(_mm_cmpgt_epi16(pb, pc), c, b);
+                __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+                __m128i predicted = select(notA, bOrC, a);
+
+                a = _mm_and_si128(_mm_add_epi16(x, predicted), lowByte);
+                storePixel<Bpp>(row + i, a);
+                c = b;
+            }
+        }
+#endif
+
+        //Reverses the filter of one scanline in place, prev is the already reconstructed row above (zeros for the first row)
+        bool unfilterRow(int filter, unsigned char *row, const unsigned char *prev, std::size_t rowBytes, int bpp) {
+            switch (filter) {
+                case 0: //None
+                    return true;
+                case 1: //Sub
+                    for (std::size_t i = bpp; i < rowBytes; ++i) row[i] += row[i - bpp];
+                    return true;
+                case 2: { //Up
+                    std::size_t i = 0;
+#if defined(__SSE2__)
+                    for (; i + 16 <= rowBytes; i += 16) {
+                        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+                        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(prev + i));
+                        _mm_storeu_si128(reinterpret_cast<__m128i *>(row + i), _mm_add_epi8(x, b));
+                    }
+#endif
+                    for (; i < rowBytes; ++i) row[i] += prev[i];
+                    return true;
+                }
+                case 3: //Average
+                    for (int i = 0; i < bpp; ++i) row[i] += prev[i] >> 1;
+                    for (std::size_t i = bpp; i < rowBytes; ++i) row[i] += (row[i - bpp] + prev[i]) >> 1;
+                    return true;
+                case 4: //Paeth
+#if defined(__SSE2__)
+                    switch (bpp) {
+                        case 3: unpaethSse2<3>(row, prev, rowBytes); return true;
+                        case 4: unpaethSse2<4>(row, prev, rowBytes); return true;
+                        case 6: unpaethSse2<6>(row, prev, rowBytes); return true;
+                        case 8: unpaethSse2<8>(row, prev, rowBytes); return true;
+                        default: break;
+                    }
+#endif
+                    for (int i = 0; i < bpp; ++i) row[i] += paeth(0, prev[i], 0);
+                    for (std::size_t i = bpp; i < rowBytes; ++i) row[i] += paeth(row[i - bpp], prev[i], prev[i - bpp]);
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        //Applies filter `filter` to one row into out, returns the sum of |signed bytes| used to pick the best filter
+        unsigned long long filterRow(int filter, const unsigned char *row, const unsigned char *prev, std::size_t rowBytes,
+                                     int bpp, unsigned char *out) {
+            unsigned long long cost = 0;
+            for (std::size_t i = 0; i < rowBytes; ++i) {
+                int a = i >= static_cast<std::size_t>(bpp) ? row[i - bpp] : 0;
+                int b = prev[i];
+                int c = i >= static_cast<std::size_t>(bpp) ? prev[i - bpp] : 0;
+                int predicted = 0;
+                switch (filter) {
+                    case 1: predicted = a; break;
+                    case 2: predicted = b; break;
+                    case 3: predicted = (a + b) >> 1; break;
+                    case 4: predicted = paeth(a, b, c); break;
+                    default: break;
+                }
+                out[i] = static_cast<unsigned char>(row[i] - predicted);
+                cost += std::abs(static_cast<signed char>(out[i]));
+            }
+            return cost;
+        }
+
+    } //namespace
+
+    bool PngFormat::probe(std::string_view head) {
+        return head.size() >= 8 && std::memcmp(head.data(), signature, 8) == 0;
+    }
+
+    bool PngFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        unsigned char sig[8];
+        file.read(reinterpret_cast<char *>(sig), 8);
+        Chunk chunk;
+        if (!file || std::memcmp(sig, signature, 8) != 0 || !readChunk(file, chunk) ||
+            std::memcmp(chunk.type, "IHDR", 4) != 0 || chunk.data.size() != 13) {
+            fmt::print("Invalid PNG header.\n");
+            return false;
+        }
+
+        //IHDR: width, height, bit depth, color type, compression, filter, interlace
+        const unsigned char *h = chunk.data.data();
+        std::uint32_t width = readBE32(h);
+        std::uint32_t height = readBE32(h + 4);
+        int bitDepth = h[8];
+        int colorType = h[9];
+        if (colorType == 3) {
+            fmt::print("Palette PNG files are not supported, convert the image to truecolor first.\n");
+            return false;
+        }
+        if (h[12] != 0) {
+            fmt::print("Interlaced PNG files are not supported, save the image without interlacing first.\n");
+            return false;
+        }
+        if (bitDepth != 8 && bitDepth != 16) {
+            fmt::print("PNG bit depth {} is not supported, only 8 and 16 bits per sample are.\n", bitDepth);
+            return false;
+        }
+        int channels = colorType == 0 ? 1 : colorType == 2 ? 3 : colorType == 4 ? 2 : colorType == 6 ? 4 : 0;
+        if (channels == 0 || width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF ||
+            h[10] != 0 || h[11] != 0) {
+            fmt::print("Unsupported PNG color type or geometry.\n");
+            return false;
+        }
+
+        info.format = id;
+        info.width = static_cast<int>(width);
+        info.height = static_cast<int>(height);
+        info.channels = channels;
+        info.maxVal = bitDepth == 16 ? 65535 : 255;
+        info.bitsPerPixel = channels * bitDepth;
+        info.topDown = true;
+        info.pixelDataOffset = 0; //pixels are compressed, there is no direct file offset
+        info.rowStride = static_cast<std::size_t>(width) * bytesPerPixel(info);
+        info.header.clear();
+        //Each row is inflated with its filter-type byte, the whole image must fit in memory
+        if (info.rowStride + 1 > SIZE_MAX / height) {
+            fmt::print("PNG image is too large.\n");
+            return false;
+        }
+
+        //Keep the ancillary chunks before the first IDAT (gAMA, sRGB, pHYs, iCCP, tEXt...) so they can be written back
+        for (;;) {
+            auto chunkStart = file.tellg();
+            if (!readChunk(file, chunk)) {
+                fmt::print("PNG chunk is corrupt or truncated.\n");
+                return false;
+            }
+            if (std::memcmp(chunk.type, "IDAT", 4) == 0) {
+                file.seekg(chunkStart);
+                return true;
+            }
+            if (std::memcmp(chunk.type, "IEND", 4) == 0) {
+                fmt::print("PNG file has no image data.\n");
+                return false;
+            }
+            unsigned char head[8];
+            writeBE32(head, static_cast<std::uint32_t>(chunk.data.size()));
+            std::memcpy(head + 4, chunk.type, 4);
+            info.header.insert(info.header.end(), head, head + 8);
+            info.header.insert(info.header.end(), chunk.data.begin(), chunk.data.end());
+        }
+    }
+
+    PixelView PngFormat::pixelView(const ImageInfo &info, std::vector<char> &data) {
+        return {data.data(), info.width, info.height, info.channels, info.maxVal > 255 ? 2 : 1, info.rowStride};
+    }
+
+    bool PngFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        //All IDAT chunks together form one zlib stream
+        std::vector<unsigned char> compressed;
+        Chunk chunk;
+        bool seenData = false;
+        for (;;) {
+            if (!readChunk(file, chunk)) {
+                fmt::print("PNG chunk is corrupt or truncated.\n");
+                return false;
+            }
+            if (std::memcmp(chunk.type, "IDAT", 4) == 0) {
+                compressed.insert(compressed.end(), chunk.data.begin(), chunk.data.end());
+                seenData = true;
+            } else if (std::memcmp(chunk.type, "IEND", 4) == 0 || seenData) {
+                break; //anything after the image data is not needed
+            }
+        }
+
+        std::size_t rowBytes = info.rowStride;
+        std::size_t filteredSize = (rowBytes + 1) * info.height;
+        std::vector<unsigned char> filtered;
+        //Reserved for what the IDAT data can expand to, not for the size IHDR claims
+        //The limit stops a small IDAT from inflating without bound. One byte over the expected size, so a valid
+        //stream ends on its own and still gets its Adler-32 checked.
+        filtered.reserve(std::min(filteredSize, compressed.size() * maxInflateRatio));
+        if (!Deflate::zlibDecompress(compressed.data(), compressed.size(), filtered, filteredSize + 1) ||
+            filtered.size() < filteredSize) {
+            fmt::print("PNG image data is corrupt.\n");
+            return false;
+        }
+
+        //Each scanline is one filter-type byte followed by the filtered row
+        data.resize(rowBytes * info.height);
+        unsigned char *out = reinterpret_cast<unsigned char *>(data.data());
+        std::vector<unsigned char> zeroRow(rowBytes, 0);
+        const unsigned char *prev = zeroRow.data();
+        int bpp = bytesPerPixel(info);
+        for (int y = 0; y < info.height; ++y) {
+            const unsigned char *line = filtered.data() + y * (rowBytes + 1);
+            unsigned char *row = out + y * rowBytes;
+            std::memcpy(row, line + 1, rowBytes);
+            if (!unfilterRow(line[0], row, prev, rowBytes, bpp)) {
+                fmt::print("PNG image data uses an unknown filter type.\n");
+                return false;
+            }
+            prev = row;
+        }
+        return true;
+    }
+
+    bool PngFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        int colorType = info.channels == 1 ? 0 : info.channels == 2 ? 4 : info.channels == 3 ? 2 : info.channels == 4 ? 6 : -1;
+        if (colorType < 0) {
+            fmt::print("PNG supports 1 to 4 channels only.\n");
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char *>(signature), 8);
+        unsigned char ihdr[13] = {};
+        writeBE32(ihdr, static_cast<std::uint32_t>(info.width));
+        writeBE32(ihdr + 4, static_cast<std::uint32_t>(info.height));
+        ihdr[8] = info.maxVal > 255 ? 16 : 8;
+        ihdr[9] = static_cast<unsigned char>(colorType);
+        writeChunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+        //Chunks preserved by parseHeader, stored as length + type + data (the CRC is recomputed)
+        const unsigned char *kept = reinterpret_cast<const unsigned char *>(info.header.data());
+        std::size_t keptSize = info.header.size();
+        for (std::size_t offset = 0; offset + 8 <= keptSize;) {
+            std::size_t length = readBE32(kept + offset);
+            if (offset + 8 + length > keptSize) break;
+            char type[4];
+            std::memcpy(type, kept + offset + 4, 4);
+            writeChunk(file, type, kept + offset + 8, length);
+            offset += 8 + length;
+        }
+
+        //Filter every row with the filter that gives the smallest sum of absolute values (the usual heuristic)
+        std::size_t rowBytes = static_cast<std::size_t>(info.width) * bytesPerPixel(info);
+        int bpp = bytesPerPixel(info);
+        std::vector<unsigned char> filtered((rowBytes + 1) * info.height);
+        std::vector<unsigned char> candidate(rowBytes);
+        std::vector<unsigned char> zeroRow(rowBytes, 0);
+        const unsigned char *in = reinterpret_cast<const unsigned char *>(data.data());
+        const unsigned char *prev = zeroRow.data();
+        for (int y = 0; y < info.height; ++y) {
+            const unsigned char *row = in + y * info.rowStride;
+            unsigned char *line = filtered.data() + y * (rowBytes + 1);
+            unsigned long long bestCost = ~0ull;
+            for (int filter = 0; filter < 5; ++filter) {
+                unsigned long long cost = filterRow(filter, row, prev, rowBytes, bpp, candidate.data());
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    line[0] = static_cast<unsigned char>(filter);
+                    std::memcpy(line + 1, candidate.data(), rowBytes);
+                }
+            }
+            prev = row;
+        }
+
+        std::vector<unsigned char> compressed = Deflate::zlibCompress(filtered.data(), filtered.size());
+        for (std::size_t offset = 0; offset < compressed.size(); offset += idatChunkSize) {
+            writeChunk(file, "IDAT", compressed.data() + offset, std::min(idatChunkSize, compressed.size() - offset));
+        }
+        writeChunk(file, "IEND", nullptr, 0);
+        return static_cast<bool>(file);
+    }
+
+} //namespace ImageHandler
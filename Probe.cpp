@@ -0,0 +1,213 @@
+#include "Probe.h"
+#include "ImageHandler.h"
+#include "Parallel.h"
+#include "Slots.h"
+#include "Steganography.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <fmt/core.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Probe {
+
+namespace {
+
+// First read, enough for the common image headers plus the carrier bytes of a full payload header
+constexpr std::size_t headRead = 8192;
+// Carrier bytes that hold the largest payload header (the header size is one byte), one bit each
+constexpr std::size_t headerSamples = 255 * 8;
+
+// Positional reads without moving a shared file offset, pread where there is one
+class File {
+public:
+    explicit File(const std::string& filename) {
+#if defined(__unix__) || defined(__APPLE__)
+        fd = ::open(filename.c_str(), O_RDONLY);
+#else
+        stream.open(filename, std::ios::binary);
+#endif
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    ~File() {
+        if (fd >= 0) ::close(fd);
+    }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+
+    std::size_t readAt(std::size_t offset, char* out, std::size_t size) {
+        std::size_t done = 0;
+        while (done < size) {
+            ssize_t got = ::pread(fd, out + done, size - done, static_cast<off_t>(offset + done));
+            if (got <= 0) break;
+            done += static_cast<std::size_t>(got);
+        }
+        return done;
+    }
+private:
+    int fd = -1;
+#else
+    bool isOpen() const { return static_cast<bool>(stream); }
+
+    std::size_t readAt(std::size_t offset, char* out, std::size_t size) {
+        stream.clear();
+        stream.seekg(static_cast<std::streamoff>(offset));
+        stream.read(out, static_cast<std::streamsize>(size));
+        return static_cast<std::size_t>(stream.gcount());
+    }
+private:
+    std::ifstream stream;
+#endif
+};
+
+bool isRaw(ImageHandler::ImageFormat format) {
+    using ImageHandler::ImageFormat;
+    return format == ImageFormat::Bmp || format == ImageFormat::Ppm || format == ImageFormat::Pgm ||
+           format == ImageFormat::Pam;
+}
+
+// Classifies the first carrier bytes, `carrierSize` is the number of samples in the whole carrier
+void classify(const char* carrier, std::size_t available, std::size_t carrierSize, std::size_t sampleBytes,
+              Result& result) {
+    Steganography::Carrier samples = Steganography::Carrier::buffer(const_cast<char*>(carrier), available, sampleBytes);
+    std::vector<unsigned char> bytes(samples.size / 8, 0);
+    Steganography::extractBits(samples, {}, 0, bytes.data(), 0, bytes.size() * 8);
+    result = Result{};
+    auto startsWith = [&](const char* magic) {
+        return bytes.size() >= 4 && std::memcmp(bytes.data(), magic, 4) == 0;
+    };
+    if (startsWith("STG2")) {
+        // A real header is complete and declares a payload that fits the carrier
+        Steganography::Layout layout;
+        if (!Steganography::payloadLayout(bytes.data(), bytes.size(), layout)) return;
+        std::size_t total = Steganography::payloadSize(bytes.data(), bytes.size());
+        if (total == 0 || layout.samplesFor(total * 8) > carrierSize) return;
+        result.kind = Kind::Payload;
+        result.flags = bytes[5];
+        result.messageLength = bytes[6] | bytes[7] << 8 | bytes[8] << 16 | static_cast<std::uint32_t>(bytes[9]) << 24;
+        result.storedLength = total;
+    } else if (startsWith(Slots::directoryMagic) && bytes.size() >= 6 && bytes[5] <= bytes[4]) {
+        result.kind = Kind::Slots;
+        result.slots = bytes[5];
+    } else if (startsWith("MSG:")) {
+        result.kind = Kind::Legacy;
+    }
+}
+
+// Parses the image header from the first bytes of the file
+bool parseHead(const std::string& head, ImageHandler::ImageInfo& info) {
+    std::istringstream stream(head);
+    return ImageHandler::Formats::dispatchProbe(head, [&]<typename Format>(std::type_identity<Format>) {
+        return Format::parseHeader(stream, info);
+    });
+}
+
+} // namespace
+
+// Function to read the image header from the first bytes of a file
+bool readInfo(const std::string& filename, ImageHandler::ImageInfo& info) {
+    File file(filename);
+    if (!file.isOpen()) return false;
+    std::string head(headRead, '\0');
+    head.resize(file.readAt(0, head.data(), head.size()));
+    if (parseHead(head, info)) return true;
+    return head.size() == headRead && ImageHandler::readImageInfo(filename, info);
+}
+
+// Function to probe one image file
+bool probeFile(const std::string& filename, Result& result) {
+    File file(filename);
+    if (!file.isOpen()) return false;
+    std::string head(headRead, '\0');
+    head.resize(file.readAt(0, head.data(), head.size()));
+
+    ImageHandler::ImageInfo info;
+    if (!isRaw(ImageHandler::Formats::probe(head))) {
+        std::vector<char> data;
+        if (ImageHandler::Formats::probe(head) == ImageHandler::ImageFormat::Unknown ||
+            !ImageHandler::readImage(filename, data, info)) {
+            return false;
+        }
+        Steganography::Carrier carrier = Steganography::Carrier::image(data, info);
+        classify(data.data(), std::min(data.size(), headerSamples * carrier.sampleBytes), carrier.size,
+                 carrier.sampleBytes, result);
+        return true;
+    }
+
+    // The header is parsed from the bytes already read, only a header longer than that goes back to the file
+    if (!parseHead(head, info) && (head.size() < headRead || !ImageHandler::readImageInfo(filename, info))) return false;
+
+    std::size_t sampleBytes = info.maxVal > 255 ? 2 : 1;
+    std::size_t carrierSize = info.rowStride * info.height;
+    std::size_t want = std::min(carrierSize, headerSamples * sampleBytes);
+    if (info.pixelDataOffset + want <= head.size()) {
+        classify(head.data() + info.pixelDataOffset, want, carrierSize / sampleBytes, sampleBytes, result);
+        return true;
+    }
+    std::vector<char> carrier(want);
+    carrier.resize(file.readAt(info.pixelDataOffset, carrier.data(), want));
+    classify(carrier.data(), carrier.size(), carrierSize / sampleBytes, sampleBytes, result);
+    return true;
+}
+
+// Function to probe every image in a directory tree
+long probeDirectory(const std::string& path) {
+    std::vector<std::string> files;
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_regular_file(error)) files.push_back(it->path().string());
+    }
+    if (error) {
+        fmt::println("Failed to read directory '{}': {}", path, error.message());
+        return -1;
+    }
+
+    // Lines come out in completion order, each one is a single write
+    std::atomic<long> found{0}, images{0};
+    Parallel::forEach(files.size(), [&](std::size_t i) {
+        Result result;
+        if (!probeFile(files[i], result)) return; // not a supported image
+        ++images;
+        if (result.kind != Kind::None) ++found;
+        fmt::println("{}: {}", files[i], describe(result));
+    }, [&](std::size_t i, std::exception_ptr error) {
+        // One broken file does not end the scan
+        fmt::println("{}: unreadable ({})", files[i], Parallel::describe(error));
+    });
+    fmt::println("{} of {} images carry a message.", found.load(), images.load());
+    return found;
+}
+
+// Function to describe a result in one line
+std::string describe(const Result& result) {
+    switch (result.kind) {
+        case Kind::Payload: {
+            std::string details;
+            auto add = [&](std::uint8_t flag, const char* name) {
+                if (result.flags & flag) details += details.empty() ? name : std::string(", ") + name;
+            };
+            add(Steganography::Compressed, "compressed");
+            add(Steganography::Encrypted, "encrypted");
+            add(Steganography::Fec, "error correction");
+            std::string text = fmt::format("yes, {} bytes ({} stored)", result.messageLength, result.storedLength);
+            return details.empty() ? text : fmt::format("{}, {}", text, details);
+        }
+        case Kind::Slots:
+            return fmt::format("yes, slot directory with {} slot(s)", result.slots);
+        case Kind::Legacy:
+            return "yes, old MSG: format (length not stored)";
+        default:
+            return "no";
+    }
+}
+
+} // namespace Probe
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "ImageFormats.h"
+
+// Quick "does this image carry a message?" check (-probe) for scanning large archives.
+// Only the start of the file is read: one pread of the first 8 KiB covers the image header and the carrier bytes
+// of a payload header in BMP, binary PPM/PGM and PAM files (a second pread is needed only for unusually large
+// headers). PNG, QOI and plain Netpbm have no byte-addressable pixels and are decoded in full.
+// Payloads scattered with --permute start in keyed positions and cannot be seen without the key.
+namespace Probe {
+
+    enum class Kind { None, Payload, Legacy, Slots };
+
+    struct Result {
+        Kind kind = Kind::None;
+        std::uint32_t messageLength = 0; // declared message length (Payload)
+        std::uint64_t storedLength = 0;  // payload bytes in the carrier, header included (Payload)
+        std::uint8_t flags = 0;          // Steganography::PayloadFlags (Payload)
+        int slots = 0;                   // entries of a slot directory (Slots)
+    };
+
+    // Function to read the image header from the first bytes of a file (the same single pread), for capacity scans
+    bool readInfo(const std::string& filename, ImageHandler::ImageInfo& info);
+
+    // Function to probe one image file, false if it cannot be read as a supported image
+    bool probeFile(const std::string& filename, Result& result);
+
+    // Function to print one line per image in a directory tree, probed on parallel threads. Returns the number
+    // of images that carry something, -1 if the directory cannot be read.
+    long probeDirectory(const std::string& path);
+
+    // Function to describe a result in one line ("yes, 120 bytes (compressed, encrypted)", "no", ...)
+    std::string describe(const Result& result);
+
+} // namespace Probe
@@ -0,0 +1,274 @@
+#include "Qoi.h"
+#include <cstring>
+#include <fmt/core.h>
+
+namespace ImageHandler {
+
+    namespace {
+
+        constexpr unsigned char opIndex = 0x00; //00xxxxxx
+        constexpr unsigned char opDiff = 0x40;  //01xxxxxx
+        constexpr unsigned char opLuma = 0x80;  //10xxxxxx
+        constexpr unsigned char opRun = 0xC0;   //11xxxxxx
+        constexpr unsigned char opRgb = 0xFE;
+        constexpr unsigned char opRgba = 0xFF;
+        constexpr unsigned char opMask = 0xC0;
+        constexpr unsigned char endMarker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        //Largest chunk is OP_RGBA with 5 bytes
+        constexpr std::size_t maxChunk = 5;
+
+        inline int hashPixel(const QoiPixel &p) {
+            return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) & 63;
+        }
+
+        inline bool samePixel(const QoiPixel &a, const QoiPixel &b) {
+            return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+        }
+
+        std::uint32_t readBE32(const unsigned char *p) {
+            return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | p[3];
+        }
+
+        void writeBE32(unsigned char *p, std::uint32_t value) {
+            p[0] = static_cast<unsigned char>(value >> 24);
+            p[1] = static_cast<unsigned char>(value >> 16);
+            p[2] = static_cast<unsigned char>(value >> 8);
+            p[3] = static_cast<unsigned char>(value);
+        }
+
+    } //namespace
+
+    //---------------------------------------- Decoder ----------------------------------------
+
+    bool QoiDecoder::readHeader(ImageInfo &info) {
+        unsigned char header[14];
+        in.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!in || std::memcmp(header, "qoif", 4) != 0) {
+            fmt::print("Invalid QOI header.\n");
+            return false;
+        }
+        std::uint32_t width = readBE32(header + 4);
+        std::uint32_t height = readBE32(header + 8);
+        channels = header[12];
+        if (width == 0 || height == 0 || width > 0x7FFFFFFF || height > 0x7FFFFFFF ||
+            (channels != 3 && channels != 4)) {
+            fmt::print("Unsupported QOI geometry or channel count.\n");
+            return false;
+        }
+
+        info.format = ImageFormat::Qoi;
+        info.width = static_cast<int>(width);
+        info.height = static_cast<int>(height);
+        info.channels = channels;
+        info.maxVal = 255;
+        info.bitsPerPixel = channels * 8;
+        info.topDown = true;
+        info.pixelDataOffset = sizeof(header);
+        info.rowStride = static_cast<std::size_t>(width) * channels;
+        info.header.assign(header, header + sizeof(header)); //keeps the colorspace byte
+        return true;
+    }
+
+    bool QoiDecoder::refill() {
+        //Move the unread tail to the front and top the buffer up
+        std::size_t tail = available - position;
+        std::memmove(buffer.data(), buffer.data() + position, tail);
+        in.read(reinterpret_cast<char *>(buffer.data()) + tail, buffer.size() - tail);
+        available = tail + static_cast<std::size_t>(in.gcount());
+        position = 0;
+        return available > 0;
+    }
+
+    bool QoiDecoder::decode(char *out, std::size_t pixels) {
+        return channels == 4 ? decodePixels<4>(out, pixels) : decodePixels<3>(out, pixels);
+    }
+
+    template<int Channels>
+    bool QoiDecoder::decodePixels(char *out, std::size_t pixels) {
+        unsigned char *o = reinterpret_cast<unsigned char *>(out);
+        //Locals instead of members so the compiler can keep them in registers
+        QoiPixel px = previous;
+        int pending = run;
+        std::size_t pos = position;
+        for (std::size_t i = 0; i < pixels; ++i, o += Channels) {
+            if (pending > 0) {
+                --pending;
+            } else {
+                //Keep at least one full chunk in the buffer so the chunk decoding below never checks bounds
+                if (available - pos < maxChunk) {
+                    position = pos;
+                    if (!refill()) {
+                        fmt::print("QOI data is truncated.\n");
+                        return false;
+                    }
+                    pos = position;
+                }
+                const unsigned char *p = buffer.data() + pos;
+                unsigned char b1 = p[0];
+                if (b1 < opDiff) {
+                    px = index[b1];
+                    pos += 1;
+                } else if (b1 < opLuma) {
+                    px.r += ((b1 >> 4) & 3) - 2;
+                    px.g += ((b1 >> 2) & 3) - 2;
+                    px.b += (b1 & 3) - 2;
+                    pos += 1;
+                } else if (b1 < opRun) {
+                    int dg = (b1 & 0x3F) - 32;
+                    unsigned char b2 = p[1];
+                    px.r += dg - 8 + ((b2 >> 4) & 0x0F);
+                    px.g += dg;
+                    px.b += dg - 8 + (b2 & 0x0F);
+                    pos += 2;
+                } else if (b1 == opRgb) {
+                    px.r = p[1];
+                    px.g = p[2];
+                    px.b = p[3];
+                    pos += 4;
+                } else if (b1 == opRgba) {
+                    px.r = p[1];
+                    px.g = p[2];
+                    px.b = p[3];
+                    px.a = p[4];
+                    pos += 5;
+                } else {
+                    pending = b1 & 0x3F; //Run of 1..62, this pixel is the first one
+                    pos += 1;
+                }
+                if (pos > available) {
+                    fmt::print("QOI data is truncated.\n");
+                    return false;
+                }
+                index[hashPixel(px)] = px;
+            }
+
+            o[0] = px.r;
+            o[1] = px.g;
+            o[2] = px.b;
+            if constexpr (Channels == 4) o[3] = px.a;
+        }
+        previous = px;
+        run = pending;
+        position = pos;
+        return true;
+    }
+
+    //---------------------------------------- Encoder ----------------------------------------
+
+    bool QoiEncoder::writeHeader() {
+        unsigned char header[14];
+        if (info.header.size() == sizeof(header)) {
+            std::memcpy(header, info.header.data(), sizeof(header));
+        } else {
+            std::memcpy(header, "qoif", 4);
+            header[13] = 0; //sRGB with linear alpha
+        }
+        writeBE32(header + 4, static_cast<std::uint32_t>(info.width));
+        writeBE32(header + 8, static_cast<std::uint32_t>(info.height));
+        header[12] = static_cast<unsigned char>(info.channels);
+        buffer.reserve(1 << 16);
+        buffer.assign(header, header + sizeof(header));
+        return info.channels == 3 || info.channels == 4;
+    }
+
+    void QoiEncoder::flushIfFull() {
+        if (buffer.size() >= (1 << 16) - 64) {
+            out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+            buffer.clear();
+        }
+    }
+
+    void QoiEncoder::encode(const char *in, std::size_t pixels) {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(in);
+        int channels = info.channels;
+        QoiPixel prev = previous;
+        for (std::size_t i = 0; i < pixels; ++i, p += channels) {
+            QoiPixel px{p[0], p[1], p[2], channels == 4 ? p[3] : static_cast<unsigned char>(255)};
+
+            if (samePixel(px, prev)) {
+                if (++run == 62) {
+                    buffer.push_back(opRun | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                buffer.push_back(opRun | (run - 1));
+                run = 0;
+            }
+
+            int hash = hashPixel(px);
+            if (samePixel(index[hash], px)) {
+                buffer.push_back(opIndex | hash);
+            } else {
+                index[hash] = px;
+                if (px.a == prev.a) {
+                    //Wrapping differences, as the spec requires
+                    signed char dr = static_cast<signed char>(px.r - prev.r);
+                    signed char dg = static_cast<signed char>(px.g - prev.g);
+                    signed char db = static_cast<signed char>(px.b - prev.b);
+                    signed char drg = static_cast<signed char>(dr - dg);
+                    signed char dbg = static_cast<signed char>(db - dg);
+
+                    if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2) {
+                        buffer.push_back(opDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+                    } else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8) {
+                        buffer.push_back(opLuma | (dg + 32));
+                        buffer.push_back(((drg + 8) << 4) | (dbg + 8));
+                    } else {
+                        buffer.insert(buffer.end(), {opRgb, px.r, px.g, px.b});
+                    }
+                } else {
+                    buffer.insert(buffer.end(), {opRgba, px.r, px.g, px.b, px.a});
+                }
+            }
+            prev = px;
+            flushIfFull();
+        }
+        previous = prev;
+    }
+
+    bool QoiEncoder::finish() {
+        if (run > 0) {
+            buffer.push_back(opRun | (run - 1));
+            run = 0;
+        }
+        buffer.insert(buffer.end(), std::begin(endMarker), std::end(endMarker));
+        out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+        buffer.clear();
+        return static_cast<bool>(out);
+    }
+
+    //---------------------------------------- Format traits ----------------------------------------
+
+    bool QoiFormat::probe(std::string_view head) {
+        return head.size() >= 4 && head.substr(0, 4) == "qoif";
+    }
+
+    bool QoiFormat::parseHeader(std::istream &file, ImageInfo &info) {
+        return QoiDecoder(file).readHeader(info);
+    }
+
+    PixelView QoiFormat::pixelView(const ImageInfo &info, std::vector<char> &data) {
+        return {data.data(), info.width, info.height, info.channels, 1, info.rowStride};
+    }
+
+    bool QoiFormat::readPixels(std::istream &file, const ImageInfo &info, std::vector<char> &data) {
+        //parseHeader already consumed the header, the stream is at the first chunk
+        QoiDecoder decoder(file, info.channels);
+        data.resize(info.rowStride * info.height);
+        return decoder.decode(data.data(), static_cast<std::size_t>(info.width) * info.height);
+    }
+
+    bool QoiFormat::write(std::ostream &file, const ImageInfo &info, const std::vector<char> &data) {
+        //One pass over the pixels, the encoder flushes its buffer as it goes
+        QoiEncoder encoder(file, info);
+        if (!encoder.writeHeader()) {
+            fmt::print("QOI only supports 3 or 4 channels.\n");
+            return false;
+        }
+        encoder.encode(data.data(), static_cast<std::size_t>(info.width) * info.height);
+        return encoder.finish();
+    }
+
+} //namespace ImageHandler
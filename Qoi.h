@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+#include "ImageFormats.h"
+
+namespace ImageHandler {
+
+    //Streaming QOI codec, https://qoiformat.org/qoi-specification.pdf
+    //Both sides keep only the 64-entry color index, the previous pixel and a small I/O buffer,
+    //so an image can be decoded or encoded in slices of any size (e.g. row by row).
+
+    //QOI pixel, always RGBA internally (alpha is 255 for 3-channel images).
+    //The color index starts as all zeros, the previous pixel starts as opaque black.
+    struct QoiPixel {
+        unsigned char r = 0, g = 0, b = 0, a = 0;
+    };
+
+    class QoiDecoder {
+    public:
+        //channels can be given when the header was already parsed, otherwise call readHeader first
+        explicit QoiDecoder(std::istream &in, int channels = 0) : in(in), channels(channels) {}
+
+        //Reads the 14-byte header
+        bool readHeader(ImageInfo &info);
+
+        //Decodes the next `pixels` pixels into out, `channels` bytes per pixel
+        bool decode(char *out, std::size_t pixels);
+
+    private:
+        bool refill();
+
+        template<int Channels>
+        bool decodePixels(char *out, std::size_t pixels);
+
+        std::istream &in;
+        int channels;
+        std::vector<unsigned char> buffer = std::vector<unsigned char>(1 << 16);
+        std::size_t position = 0;
+        std::size_t available = 0;
+        std::array<QoiPixel, 64> index{};
+        QoiPixel previous{0, 0, 0, 255};
+        int run = 0;
+    };
+
+    class QoiEncoder {
+    public:
+        QoiEncoder(std::ostream &out, const ImageInfo &info) : out(out), info(info) {}
+
+        bool writeHeader();
+
+        //Encodes the next `pixels` pixels from in, `channels` bytes per pixel
+        void encode(const char *in, std::size_t pixels);
+
+        //Flushes a pending run, writes the end marker and the buffer
+        bool finish();
+
+    private:
+        void flushIfFull();
+
+        std::ostream &out;
+        const ImageInfo &info;
+        std::vector<unsigned char> buffer;
+        std::array<QoiPixel, 64> index{};
+        QoiPixel previous{0, 0, 0, 255};
+        int run = 0;
+    };
+
+} //namespace ImageHandler
@@ -0,0 +1,283 @@
+#include "Quality.h"
+#include "ImageHandler.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Quality {
+
+namespace {
+
+// Target size of one band of rows
+constexpr std::size_t bandBytes = std::size_t{8} << 20;
+
+inline unsigned sample16(const unsigned char* p) { return p[0] << 8 | p[1]; }
+
+// Squared error, largest error and changed bytes of 8-bit samples
+void difference8(const unsigned char* a, const unsigned char* b, std::size_t size, Metrics& metrics) {
+    std::uint64_t squared = 0, changed = 0;
+    unsigned largest = 0;
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i maxima = zero;
+    while (i + 16 <= size) {
+        // madd leaves sums of two squares (<= 2 * 255^2) in 32-bit lanes, 4096 rounds stay far below overflow
+        __m128i sums = zero;
+        for (int round = 0; round < 4096 && i + 16 <= size; ++round, i += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            __m128i diff = _mm_or_si128(_mm_subs_epu8(x, y), _mm_subs_epu8(y, x));
+            maxima = _mm_max_epu8(maxima, diff);
+            changed += std::popcount(~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero))) & 0xFFFF);
+            __m128i low = _mm_unpacklo_epi8(diff, zero), high = _mm_unpackhi_epi8(diff, zero);
+            sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_madd_epi16(low, low), _mm_madd_epi16(high, high)));
+        }
+        alignas(16) std::uint32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sums);
+        squared += std::uint64_t{lanes[0]} + lanes[1] + lanes[2] + lanes[3];
+    }
+    alignas(16) unsigned char top[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(top), maxima);
+    for (unsigned char t : top) largest = std::max<unsigned>(largest, t);
+#endif
+    for (; i < size; ++i) {
+        unsigned diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        squared += diff * diff;
+        changed += diff != 0;
+        largest = std::max(largest, diff);
+    }
+    metrics.squaredError += static_cast<double>(squared);
+    metrics.changedBytes += changed;
+    metrics.maxError = std::max(metrics.maxError, largest);
+}
+
+// Same for 16-bit big endian samples
+void difference16(const unsigned char* a, const unsigned char* b, std::size_t size, Metrics& metrics) {
+    double squared = 0;
+    for (std::size_t i = 0; i + 1 < size; i += 2) {
+        std::int64_t diff = static_cast<std::int64_t>(sample16(a + i)) - sample16(b + i);
+        squared += static_cast<double>(diff * diff);
+        metrics.maxError = std::max(metrics.maxError, static_cast<std::uint32_t>(diff < 0 ? -diff : diff));
+        metrics.changedBytes += (a[i] != b[i]) + (a[i + 1] != b[i + 1]);
+    }
+    metrics.squaredError += squared;
+}
+
+// Column sums of one group of 8 rows: x, y, x^2, y^2, xy for every byte position
+struct ColumnSums {
+    std::vector<std::uint32_t> x, y, xx, yy, xy;
+
+    void resize(std::size_t columns) {
+        for (auto* v : {&x, &y, &xx, &yy, &xy}) v->resize(columns);
+    }
+};
+
+// Column sums over 8 rows of `size` bytes, every byte column is summed in registers and stored once
+void addRows8(const unsigned char* a, const unsigned char* b, std::size_t rowBytes, ColumnSums& sums) {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    auto store = [&](std::vector<std::uint32_t>& column, std::size_t at, __m128i low, __m128i high) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(column.data() + at), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(column.data() + at + 4), high);
+    };
+    for (; i + 8 <= rowBytes; i += 8) {
+        // 8 rows of byte sums fit 16 bits; products of two bytes fit 16 unsigned bits, mullo gives them exactly
+        __m128i sx = zero, sy = zero, xxLow = zero, xxHigh = zero, yyLow = zero, yyHigh = zero, xyLow = zero,
+                xyHigh = zero;
+        for (std::size_t r = 0; r < 8; ++r) {
+            __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + r * rowBytes + i)), zero);
+            __m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + r * rowBytes + i)), zero);
+            sx = _mm_add_epi16(sx, x);
+            sy = _mm_add_epi16(sy, y);
+            __m128i xx = _mm_mullo_epi16(x, x), yy = _mm_mullo_epi16(y, y), xy = _mm_mullo_epi16(x, y);
+            xxLow = _mm_add_epi32(xxLow, _mm_unpacklo_epi16(xx, zero));
+            xxHigh = _mm_add_epi32(xxHigh, _mm_unpackhi_epi16(xx, zero));
+            yyLow = _mm_add_epi32(yyLow, _mm_unpacklo_epi16(yy, zero));
+            yyHigh = _mm_add_epi32(yyHigh, _mm_unpackhi_epi16(yy, zero));
+            xyLow = _mm_add_epi32(xyLow, _mm_unpacklo_epi16(xy, zero));
+            xyHigh = _mm_add_epi32(xyHigh, _mm_unpackhi_epi16(xy, zero));
+        }
+        store(sums.x, i, _mm_unpacklo_epi16(sx, zero), _mm_unpackhi_epi16(sx, zero));
+        store(sums.y, i, _mm_unpacklo_epi16(sy, zero), _mm_unpackhi_epi16(sy, zero));
+        store(sums.xx, i, xxLow, xxHigh);
+        store(sums.yy, i, yyLow, yyHigh);
+        store(sums.xy, i, xyLow, xyHigh);
+    }
+#endif
+    for (; i < rowBytes; ++i) {
+        std::uint32_t sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        for (std::size_t r = 0; r < 8; ++r) {
+            std::uint32_t x = a[r * rowBytes + i], y = b[r * rowBytes + i];
+            sx += x, sy += y, sxx += x * x, syy += y * y, sxy += x * y;
+        }
+        sums.x[i] = sx, sums.y[i] = sy, sums.xx[i] = sxx, sums.yy[i] = syy, sums.xy[i] = sxy;
+    }
+}
+
+double blockSsim(double sx, double sy, double sxx, double syy, double sxy, double c1, double c2) {
+    const double n = 64;
+    double mx = sx / n, my = sy / n;
+    double vx = sxx / n - mx * mx, vy = syy / n - my * my, cxy = sxy / n - mx * my;
+    return ((2 * mx * my + c1) * (2 * cxy + c2)) / ((mx * mx + my * my + c1) * (vx + vy + c2));
+}
+
+// SSIM of the 8x8 blocks in 8 rows starting at a and b
+void ssimRows(const unsigned char* a, const unsigned char* b, std::size_t rowBytes, int channels, int maxVal,
+              ColumnSums& sums, Metrics& metrics) {
+    const double c1 = (0.01 * maxVal) * (0.01 * maxVal), c2 = (0.03 * maxVal) * (0.03 * maxVal);
+    const std::size_t pixelBytes = maxVal > 255 ? 2 * channels : channels;
+    const std::size_t blocks = rowBytes / pixelBytes / 8;
+    if (maxVal > 255) {
+        // 16-bit sums would overflow 32-bit columns, these go straight into doubles per block
+        for (std::size_t block = 0; block < blocks; ++block) {
+            for (int c = 0; c < channels; ++c) {
+                double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+                for (std::size_t r = 0; r < 8; ++r) {
+                    for (std::size_t i = 0; i < 8; ++i) {
+                        std::size_t at = r * rowBytes + (block * 8 + i) * pixelBytes + 2 * c;
+                        double x = sample16(a + at), y = sample16(b + at);
+                        sx += x, sy += y, sxx += x * x, syy += y * y, sxy += x * y;
+                    }
+                }
+                metrics.ssimSum += blockSsim(sx, sy, sxx, syy, sxy, c1, c2);
+            }
+        }
+        metrics.ssimBlocks += blocks * channels;
+        return;
+    }
+    sums.resize(rowBytes);
+    addRows8(a, b, rowBytes, sums);
+    for (std::size_t block = 0; block < blocks; ++block) {
+        for (int c = 0; c < channels; ++c) {
+            std::uint64_t sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+            for (std::size_t i = 0; i < 8; ++i) {
+                std::size_t at = (block * 8 + i) * pixelBytes + c;
+                sx += sums.x[at], sy += sums.y[at], sxx += sums.xx[at], syy += sums.yy[at], sxy += sums.xy[at];
+            }
+            metrics.ssimSum += blockSsim(static_cast<double>(sx), static_cast<double>(sy), static_cast<double>(sxx),
+                                         static_cast<double>(syy), static_cast<double>(sxy), c1, c2);
+        }
+    }
+    metrics.ssimBlocks += blocks * channels;
+}
+
+} // namespace
+
+Metrics& Metrics::operator+=(const Metrics& other) {
+    samples += other.samples;
+    bytes += other.bytes;
+    changedBytes += other.changedBytes;
+    squaredError += other.squaredError;
+    maxError = std::max(maxError, other.maxError);
+    ssimSum += other.ssimSum;
+    ssimBlocks += other.ssimBlocks;
+    return *this;
+}
+
+double Metrics::psnr(int maxVal) const {
+    if (squaredError == 0) return std::numeric_limits<double>::infinity();
+    return 10 * std::log10(static_cast<double>(maxVal) * maxVal / mse());
+}
+
+// Function to measure packed rows
+Metrics measure(const unsigned char* a, const unsigned char* b, std::size_t rows, std::size_t rowBytes,
+                int channels, int maxVal) {
+    Metrics metrics;
+    const std::size_t size = rows * rowBytes;
+    metrics.bytes = size;
+    metrics.samples = maxVal > 255 ? size / 2 : size;
+    // Tile by tile of 8 rows, the difference pass finds the tile still in cache
+    ColumnSums sums;
+    for (std::size_t r = 0; r < rows; r += 8) {
+        const unsigned char* x = a + r * rowBytes;
+        const unsigned char* y = b + r * rowBytes;
+        std::size_t tileBytes = std::min<std::size_t>(8, rows - r) * rowBytes;
+        if (r + 8 <= rows) ssimRows(x, y, rowBytes, channels, maxVal, sums, metrics);
+        if (maxVal > 255) {
+            difference16(x, y, tileBytes, metrics);
+        } else {
+            difference8(x, y, tileBytes, metrics);
+        }
+    }
+    return metrics;
+}
+
+// Function to compare two images
+bool compareFiles(const std::string& first, const std::string& second) {
+    ImageHandler::RowReader sources[2];
+    if (!sources[0].open(first) || !sources[1].open(second)) {
+        fmt::println("Failed to read images for comparison.");
+        return false;
+    }
+    const ImageHandler::ImageInfo& info = sources[0].imageInfo();
+    const ImageHandler::ImageInfo& other = sources[1].imageInfo();
+    if (info.width != other.width || info.height != other.height || info.channels != other.channels) {
+        fmt::println("The images differ in geometry ({}x{}x{} and {}x{}x{}).", info.width, info.height, info.channels,
+                     other.width, other.height, other.channels);
+        return false;
+    }
+    // PSNR and SSIM are relative to the sample range, two ranges have no common scale
+    if (info.maxVal != other.maxVal) {
+        fmt::println("The images differ in max color value ({} and {}).", info.maxVal, other.maxVal);
+        return false;
+    }
+    const std::size_t height = static_cast<std::size_t>(info.height), rowBytes = sources[0].rowBytes();
+    const int maxVal = info.maxVal;
+    // Bands are whole groups of 8 rows, so SSIM blocks never straddle two bands
+    const std::size_t bandRows = std::max<std::size_t>(8, bandBytes / std::max<std::size_t>(rowBytes, 1) / 8 * 8);
+
+    std::vector<unsigned char> current[2], next[2];
+    auto readBand = [&](std::size_t firstRow, std::vector<unsigned char>* band) {
+        std::size_t count = std::min(bandRows, height - firstRow);
+        return sources[0].read(firstRow, count, band[0]) && sources[1].read(firstRow, count, band[1]);
+    };
+    if (!readBand(0, current)) return false;
+
+    std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    Metrics total;
+    for (std::size_t firstRow = 0; firstRow < height; firstRow += bandRows) {
+        std::size_t rows = std::min(bandRows, height - firstRow);
+        // The next band is read while this one is measured
+        bool nextOk = true;
+        std::thread reader;
+        if (firstRow + bandRows < height) reader = std::thread([&] { nextOk = readBand(firstRow + bandRows, next); });
+
+        std::size_t groups = (rows + 7) / 8, parts = std::min(threads, groups);
+        std::vector<Metrics> results(parts);
+        std::vector<std::thread> pool;
+        auto work = [&](std::size_t part) {
+            std::size_t from = groups * part / parts * 8, to = std::min(rows, groups * (part + 1) / parts * 8);
+            results[part] = measure(current[0].data() + from * rowBytes, current[1].data() + from * rowBytes,
+                                    to - from, rowBytes, info.channels, maxVal);
+        };
+        for (std::size_t part = 1; part < parts; ++part) pool.emplace_back(work, part);
+        work(0);
+        for (auto& thread : pool) thread.join();
+        for (const Metrics& result : results) total += result;
+
+        if (reader.joinable()) reader.join();
+        if (!nextOk) return false;
+        std::swap(current, next);
+    }
+
+    fmt::println("Samples:       {} ({}x{}, {} channel(s), {} bit)", total.samples, info.width, info.height,
+                 info.channels, maxVal > 255 ? 16 : 8);
+    fmt::println("Changed bytes: {} of {} ({:.4f}%)", total.changedBytes, total.bytes,
+                 total.bytes ? 100.0 * total.changedBytes / total.bytes : 0.0);
+    fmt::println("Max error:     {}", total.maxError);
+    fmt::println("MSE:           {:.6f}", total.mse());
+    fmt::println("PSNR:          {:.2f} dB", total.psnr(maxVal));
+    fmt::println("SSIM:          {:.6f}", total.ssim());
+    return true;
+}
+
+} // namespace Quality
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Distortion between a cover and a stego image (-compare): MSE, PSNR, largest sample error, changed bytes and SSIM.
+// Both images are streamed in bands of rows (raw formats straight from the file, without their row padding), the
+// next band is read while the current one is measured on all cores, so memory stays at a few bands whatever the
+// image size. SSIM is the mean over 8x8 blocks of every channel (partial blocks at the right and bottom edges are
+// left out), with the usual constants (0.01 L)^2 and (0.03 L)^2.
+namespace Quality {
+
+    struct Metrics {
+        std::uint64_t samples = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t changedBytes = 0;
+        double squaredError = 0;
+        std::uint32_t maxError = 0;
+        double ssimSum = 0;
+        std::uint64_t ssimBlocks = 0;
+
+        Metrics& operator+=(const Metrics& other);
+        double mse() const { return samples ? squaredError / samples : 0; }
+        double psnr(int maxVal) const; // infinite for identical images
+        double ssim() const { return ssimBlocks ? ssimSum / ssimBlocks : 1; }
+    };
+
+    // Function to measure `rows` rows of `rowBytes` bytes (packed), 8-bit samples or 16-bit big endian ones.
+    // SSIM blocks are taken from whole groups of 8 rows.
+    Metrics measure(const unsigned char* a, const unsigned char* b, std::size_t rows, std::size_t rowBytes,
+                    int channels, int maxVal);
+
+    // Function to compare two images of the same geometry and print the metrics
+    bool compareFiles(const std::string& first, const std::string& second);
+
+} // namespace Quality
@@ -0,0 +1,367 @@
+#include "ReedSolomon.h"
+#include "Cpu.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define STEGO_HAVE_PSHUFB 1
+#endif
+
+namespace ReedSolomon {
+
+namespace {
+
+// exp/log tables of GF(256) with generator 2, and for every constant c the products c * x for the low nibbles
+// x = 0..15 (entries 0-15) and for the high nibbles x = 16, 32 .. 240 (entries 16-31)
+struct Field {
+    std::array<unsigned char, 512> exp{};
+    std::array<int, 256> log{};
+    std::array<std::array<unsigned char, 32>, 256> nibbles{};
+};
+
+const Field field = [] {
+    Field f;
+    int x = 1;
+    for (int i = 0; i < 255; ++i) {
+        f.exp[i] = static_cast<unsigned char>(x);
+        f.log[x] = i;
+        x <<= 1;
+        if (x & 0x100) x ^= 0x11D;
+    }
+    for (int i = 255; i < 512; ++i) f.exp[i] = f.exp[i - 255];
+    for (int c = 1; c < 256; ++c) {
+        for (int n = 1; n < 16; ++n) {
+            f.nibbles[c][n] = f.exp[f.log[c] + f.log[n]];
+            f.nibbles[c][16 + n] = f.exp[f.log[c] + f.log[n << 4]];
+        }
+    }
+    return f;
+}();
+
+unsigned char mul(unsigned char a, unsigned char b) {
+    return a && b ? field.exp[field.log[a] + field.log[b]] : 0;
+}
+
+unsigned char div(unsigned char a, unsigned char b) {
+    return a ? field.exp[field.log[a] + 255 - field.log[b]] : 0;
+}
+
+unsigned char power(int exponent) {
+    return field.exp[((exponent % 255) + 255) % 255];
+}
+
+// Rows of codeword bytes are processed in tiles of this many lanes, so the parity or syndrome rows of a tile
+// (at most 255 of them) stay in L1/L2 while the data rows stream through
+constexpr std::size_t tileWidth = 4096;
+
+// Horner = false: dst[i] ^= c * src[i] (encoding), Horner = true: dst[i] = c * dst[i] ^ src[i] (syndromes)
+template <bool Horner>
+void kernelScalar(unsigned char* dst, const unsigned char* src, unsigned char c, std::size_t size) {
+    const unsigned char* t = field.nibbles[c].data();
+    for (std::size_t i = 0; i < size; ++i) {
+        unsigned char x = Horner ? dst[i] : src[i];
+        unsigned char product = t[x & 15] ^ t[16 + (x >> 4)];
+        dst[i] = product ^ (Horner ? src[i] : dst[i]);
+    }
+}
+
+#if STEGO_HAVE_PSHUFB
+// c * x is the XOR of c * (x & 15) and c * (x & 240), each a 16-entry table lookup of one nibble
+template <bool Horner>
+__attribute__((target("ssse3"))) void kernelSsse3(unsigned char* dst, const unsigned char* src, unsigned char c,
+                                                  std::size_t size) {
+    const unsigned char* t = field.nibbles[c].data();
+    const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t));
+    const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(t + 16));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i x = Horner ? d : s;
+        __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(x, mask)),
+                                        _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(x, 4), mask)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(product, Horner ? s : d));
+    }
+    kernelScalar<Horner>(dst + i, src + i, c, size - i);
+}
+
+template <bool Horner>
+__attribute__((target("avx2"))) void kernelAvx2(unsigned char* dst, const unsigned char* src, unsigned char c,
+                                                std::size_t size) {
+    const unsigned char* t = field.nibbles[c].data();
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(t)));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(t + 16)));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i x = Horner ? d : s;
+        __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(x, mask)),
+                                           _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(product, Horner ? s : d));
+    }
+    kernelScalar<Horner>(dst + i, src + i, c, size - i);
+}
+#endif
+
+template <bool Horner>
+void kernel(unsigned char* dst, const unsigned char* src, unsigned char c, std::size_t size) {
+#if STEGO_HAVE_PSHUFB
+    if (Cpu::hasAvx2()) return kernelAvx2<Horner>(dst, src, c, size);
+    if (Cpu::hasSsse3()) return kernelSsse3<Horner>(dst, src, c, size);
+#endif
+    kernelScalar<Horner>(dst, src, c, size);
+}
+
+// out[i] = a[i] ^ b[i], 8 bytes at a time
+void xorRows(unsigned char* out, const unsigned char* a, const unsigned char* b, std::size_t size) {
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t x, y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        x ^= y;
+        std::memcpy(out + i, &x, 8);
+    }
+    for (; i < size; ++i) out[i] = a[i] ^ b[i];
+}
+
+// g(x) = (x - 1)(x - a)..(x - a^(parity-1)) without its leading 1: g[j] is the coefficient of x^j
+std::vector<unsigned char> generator(int parity) {
+    std::vector<unsigned char> g(parity + 1, 0);
+    g[0] = 1;
+    for (int i = 0; i < parity; ++i) {
+        unsigned char root = power(i);
+        for (int j = i + 1; j > 0; --j) g[j] = g[j - 1] ^ mul(g[j], root);
+        g[0] = mul(g[0], root);
+    }
+    g.pop_back();
+    return g;
+}
+
+// Errors of one codeword of n bytes from its syndromes: Berlekamp-Massey for the error locator, Chien search for
+// the positions, Forney for the values. Returns false if the errors cannot be located consistently.
+bool correct(const std::vector<unsigned char>& syndromes, std::size_t n,
+             std::vector<std::pair<std::size_t, unsigned char>>& errors) {
+    const int parity = static_cast<int>(syndromes.size());
+    std::vector<unsigned char> locator{1}, previous{1};
+    int length = 0, shift = 1;
+    unsigned char lastDelta = 1;
+    for (int r = 0; r < parity; ++r) {
+        unsigned char delta = syndromes[r];
+        for (int i = 1; i <= length && i < static_cast<int>(locator.size()); ++i) delta ^= mul(locator[i], syndromes[r - i]);
+        if (delta == 0) {
+            ++shift;
+            continue;
+        }
+        std::vector<unsigned char> before = locator;
+        unsigned char factor = div(delta, lastDelta);
+        locator.resize(std::max(locator.size(), previous.size() + shift), 0);
+        for (std::size_t i = 0; i < previous.size(); ++i) locator[i + shift] ^= mul(factor, previous[i]);
+        if (2 * length <= r) {
+            length = r + 1 - length;
+            previous = before;
+            lastDelta = delta;
+            shift = 1;
+        } else {
+            ++shift;
+        }
+    }
+    if (2 * length > parity) return false;
+
+    // Error at degree d (byte n - 1 - d) when the locator vanishes at a^-d
+    errors.clear();
+    std::vector<std::size_t> degrees;
+    for (std::size_t d = 0; d < n; ++d) {
+        unsigned char x = power(-static_cast<int>(d)), value = 0;
+        for (std::size_t i = locator.size(); i-- > 0;) value = mul(value, x) ^ locator[i];
+        if (value == 0) degrees.push_back(d);
+    }
+    if (static_cast<int>(degrees.size()) != length) return false;
+
+    // Omega = S * locator mod x^parity, the error value at X = a^d is X * Omega(1/X) / locator'(1/X)
+    std::vector<unsigned char> omega(parity, 0);
+    for (int i = 0; i < parity; ++i) {
+        for (std::size_t j = 0; j < locator.size() && j <= static_cast<std::size_t>(i); ++j) {
+            omega[i] ^= mul(syndromes[i - j], locator[j]);
+        }
+    }
+    for (std::size_t d : degrees) {
+        unsigned char inverse = power(-static_cast<int>(d)), numerator = 0, denominator = 0;
+        for (int i = parity; i-- > 0;) numerator = mul(numerator, inverse) ^ omega[i];
+        // Formal derivative: only the odd terms survive in characteristic 2
+        unsigned char x2 = mul(inverse, inverse), term = 1;
+        for (std::size_t i = 1; i < locator.size(); i += 2, term = mul(term, x2)) denominator ^= mul(locator[i], term);
+        if (denominator == 0) return false;
+        errors.emplace_back(n - 1 - d, mul(power(static_cast<int>(d)), div(numerator, denominator)));
+    }
+    return true;
+}
+
+// Coefficient of data shard i in parity shard j
+unsigned char cauchy(int k, int j, int i) {
+    return div(1, static_cast<unsigned char>((k + j) ^ i));
+}
+
+// Gauss-Jordan inversion of a k x k matrix (row-major), false if it is singular
+bool invert(std::vector<unsigned char>& matrix, int k) {
+    std::vector<unsigned char> inverse(k * k, 0);
+    for (int i = 0; i < k; ++i) inverse[i * k + i] = 1;
+    for (int column = 0; column < k; ++column) {
+        int pivot = column;
+        while (pivot < k && matrix[pivot * k + column] == 0) ++pivot;
+        if (pivot == k) return false;
+        for (int c = 0; c < k; ++c) {
+            std::swap(matrix[pivot * k + c], matrix[column * k + c]);
+            std::swap(inverse[pivot * k + c], inverse[column * k + c]);
+        }
+        unsigned char scale = div(1, matrix[column * k + column]);
+        for (int c = 0; c < k; ++c) {
+            matrix[column * k + c] = mul(matrix[column * k + c], scale);
+            inverse[column * k + c] = mul(inverse[column * k + c], scale);
+        }
+        for (int row = 0; row < k; ++row) {
+            unsigned char factor = matrix[row * k + column];
+            if (row == column || factor == 0) continue;
+            for (int c = 0; c < k; ++c) {
+                matrix[row * k + c] ^= mul(factor, matrix[column * k + c]);
+                inverse[row * k + c] ^= mul(factor, inverse[column * k + c]);
+            }
+        }
+    }
+    matrix = inverse;
+    return true;
+}
+
+} // namespace
+
+// Function to compute dst[i] ^= c * src[i]
+void mulAdd(unsigned char* dst, const unsigned char* src, unsigned char c, std::size_t size) {
+    kernel<false>(dst, src, c, size);
+}
+
+// Function to cut data into k data shards and n - k parity shards
+std::vector<std::vector<unsigned char>> encodeShards(const unsigned char* data, std::size_t size, int k, int n) {
+    std::size_t shardSize = (size + k - 1) / k;
+    std::vector<std::vector<unsigned char>> shards(n, std::vector<unsigned char>(shardSize, 0));
+    for (int i = 0; i < k; ++i) {
+        std::size_t begin = std::min(size, i * shardSize), end = std::min(size, begin + shardSize);
+        std::copy(data + begin, data + end, shards[i].begin());
+    }
+    for (int j = 0; j < n - k; ++j) {
+        for (int i = 0; i < k; ++i) mulAdd(shards[k + j].data(), shards[i].data(), cauchy(k, j, i), shardSize);
+    }
+    return shards;
+}
+
+// Function to rebuild the data from any k shards
+bool decodeShards(const std::vector<std::pair<int, const unsigned char*>>& shards, std::size_t shardSize, int k,
+                  std::size_t size, std::vector<unsigned char>& out) {
+    if (static_cast<int>(shards.size()) < k || size > shardSize * k) return false;
+    // Row r of the matrix says how shard r was made from the data shards, its inverse undoes that
+    std::vector<unsigned char> matrix(k * k, 0);
+    for (int r = 0; r < k; ++r) {
+        int index = shards[r].first;
+        for (int i = 0; i < k; ++i) matrix[r * k + i] = index < k ? (index == i) : cauchy(k, index - k, i);
+    }
+    if (!invert(matrix, k)) return false;
+
+    out.assign(shardSize * k, 0);
+    for (int i = 0; i < k; ++i) {
+        unsigned char* target = out.data() + i * shardSize;
+        for (int r = 0; r < k; ++r) {
+            unsigned char c = matrix[i * k + r];
+            if (c == 1) {
+                for (std::size_t b = 0; b < shardSize; ++b) target[b] ^= shards[r].second[b];
+            } else if (c != 0) {
+                mulAdd(target, shards[r].second, c, shardSize);
+            }
+        }
+    }
+    out.resize(size);
+    return true;
+}
+
+// Function to lay out the data in codewords
+Shape shape(std::size_t size, int parity) {
+    Shape result;
+    result.parity = parity;
+    std::size_t perCodeword = 255 - static_cast<std::size_t>(parity);
+    result.codewords = std::max<std::size_t>(1, (size + perCodeword - 1) / perCodeword);
+    result.dataRows = (size + result.codewords - 1) / result.codewords;
+    return result;
+}
+
+// Function to encode data
+std::vector<unsigned char> encode(const unsigned char* data, std::size_t size, int parity) {
+    const Shape layout = shape(size, parity);
+    const std::size_t columns = layout.codewords;
+    std::vector<unsigned char> out(layout.encodedSize(), 0);
+    std::copy(data, data + size, out.begin());
+    const std::vector<unsigned char> g = generator(parity);
+
+    // Division by g(x), one LFSR per lane. The registers are a ring: shifting them up one degree is moving `top`.
+    std::vector<unsigned char> registers(parity * std::min(columns, tileWidth)), feedback(std::min(columns, tileWidth));
+    for (std::size_t tile = 0; tile < columns; tile += tileWidth) {
+        std::size_t width = std::min(tileWidth, columns - tile);
+        std::fill(registers.begin(), registers.end(), 0);
+        auto row = [&](int degree, int top) { return registers.data() + ((degree + top) % parity) * width; };
+        int top = 0; // register of degree 0 sits in row `top`
+        for (std::size_t m = 0; m < layout.dataRows; ++m) {
+            const unsigned char* in = out.data() + m * columns + tile;
+            unsigned char* highest = row(parity - 1, top);
+            xorRows(feedback.data(), in, highest, width);
+            top = (top + parity - 1) % parity;
+            std::memset(row(0, top), 0, width);
+            for (int j = 0; j < parity; ++j) mulAdd(row(j, top), feedback.data(), g[j], width);
+        }
+        // Parity bytes follow the data highest degree first
+        for (int q = 0; q < parity; ++q) {
+            std::memcpy(out.data() + (layout.dataRows + q) * columns + tile, row(parity - 1 - q, top), width);
+        }
+    }
+    return out;
+}
+
+// Function to correct and return the data
+bool decode(const unsigned char* encoded, std::size_t encodedSize, std::size_t size, int parity,
+            std::vector<unsigned char>& out, std::size_t* corrected) {
+    const Shape layout = shape(size, parity);
+    if (encodedSize != layout.encodedSize()) return false;
+    const std::size_t columns = layout.codewords, n = layout.dataRows + parity;
+    out.assign(encoded, encoded + layout.dataRows * columns);
+    if (corrected) *corrected = 0;
+
+    // Syndrome j of every lane is r(a^j), evaluated by Horner over the rows
+    std::vector<unsigned char> syndromeRows(parity * std::min(columns, tileWidth));
+    std::vector<unsigned char> syndromes(parity);
+    std::vector<std::pair<std::size_t, unsigned char>> errors;
+    for (std::size_t tile = 0; tile < columns; tile += tileWidth) {
+        std::size_t width = std::min(tileWidth, columns - tile);
+        std::fill(syndromeRows.begin(), syndromeRows.end(), 0);
+        for (std::size_t m = 0; m < n; ++m) {
+            const unsigned char* in = encoded + m * columns + tile;
+            for (int j = 0; j < parity; ++j) kernel<true>(syndromeRows.data() + j * width, in, power(j), width);
+        }
+        for (std::size_t lane = 0; lane < width; ++lane) {
+            bool clean = true;
+            for (int j = 0; j < parity; ++j) {
+                syndromes[j] = syndromeRows[j * width + lane];
+                clean = clean && syndromes[j] == 0;
+            }
+            if (clean) continue;
+            if (!correct(syndromes, n, errors)) return false;
+            for (const auto& [position, value] : errors) {
+                if (position < layout.dataRows) out[position * columns + tile + lane] ^= value;
+            }
+            if (corrected) *corrected += errors.size();
+        }
+    }
+    out.resize(size);
+    return true;
+}
+
+} // namespace ReedSolomon
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Reed-Solomon forward error correction for payloads (--fec), over GF(256) with polynomial 0x11D.
+// The data is spread over `codewords` interleaved codewords: byte b belongs to codeword b % codewords, so a damaged
+// run of carrier bytes (a cropped last row, an overwritten block) is shared out over all of them. The encoded form
+// is the data itself (zero padded to whole rows) followed by `parity` rows of parity bytes, one byte per codeword.
+// Every codeword corrects up to parity / 2 damaged bytes.
+// Codewords sit side by side in SIMD lanes, so encoding and the syndromes are GF(256) multiply-adds by constants
+// over whole rows, done with split-nibble table lookups (pshufb: SSSE3, AVX2 when the CPU has it).
+namespace ReedSolomon {
+
+    // How a data length maps to interleaved codewords
+    struct Shape {
+        std::size_t codewords = 1;
+        std::size_t dataRows = 0; // data bytes per codeword
+        int parity = 0;           // parity bytes per codeword
+
+        std::size_t encodedSize() const { return (dataRows + parity) * codewords; }
+    };
+
+    // Function to lay out `size` data bytes in codewords of at most 255 bytes with `parity` parity bytes each
+    Shape shape(std::size_t size, int parity);
+
+    // Function to encode data, the result is shape(size, parity).encodedSize() bytes
+    std::vector<unsigned char> encode(const unsigned char* data, std::size_t size, int parity);
+
+    // Function to correct encoded bytes back into the `size` data bytes. False if a codeword has more errors than
+    // it can correct (as far as that can be detected), `corrected` counts the bytes that were repaired.
+    bool decode(const unsigned char* encoded, std::size_t encodedSize, std::size_t size, int parity,
+                std::vector<unsigned char>& out, std::size_t* corrected = nullptr);
+
+    // Function to compute dst[i] ^= c * src[i] in GF(256), the kernel behind encode
+    void mulAdd(unsigned char* dst, const unsigned char* src, unsigned char c, std::size_t size);
+
+    // Erasure coding for shards: the data is cut into k equal data shards (zero padded), shard k + j is the sum of
+    // cauchy(j, i) * data shard i with cauchy(j, i) = 1 / ((k + j) ^ i). Every k x k selection of rows of
+    // [identity; cauchy] is invertible, so any k of the n shards give the data back. n is at most 256.
+
+    // Function to cut `size` bytes into n shards of ceil(size / k) bytes
+    std::vector<std::vector<unsigned char>> encodeShards(const unsigned char* data, std::size_t size, int k, int n);
+
+    // Function to rebuild the `size` data bytes from k shards, given as (shard index, bytes) with distinct indices
+    bool decodeShards(const std::vector<std::pair<int, const unsigned char*>>& shards, std::size_t shardSize, int k,
+                      std::size_t size, std::vector<unsigned char>& out);
+
+} // namespace ReedSolomon
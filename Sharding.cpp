@@ -0,0 +1,144 @@
+#include "Sharding.h"
+#include "Parallel.h"
+#include "ReedSolomon.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <fmt/core.h>
+
+namespace Sharding {
+
+namespace {
+
+constexpr std::size_t recordHeaderSize = 19;
+
+using SetId = std::array<unsigned char, 8>;
+
+// One shard record as read back from an image
+struct Shard {
+    SetId setId{};
+    int index = 0;
+    int k = 0;
+    int n = 0;
+    std::uint32_t payloadLength = 0;
+    std::string bytes; // the whole record, shard bytes from recordHeaderSize on
+};
+
+bool parseShard(const std::string& record, Shard& shard) {
+    if (!isShard(record)) return false;
+    const auto* bytes = reinterpret_cast<const unsigned char*>(record.data());
+    std::copy(bytes + 4, bytes + 12, shard.setId.begin());
+    shard.index = bytes[12];
+    shard.k = bytes[13];
+    shard.n = bytes[14];
+    shard.payloadLength = bytes[15] | bytes[16] << 8 | bytes[17] << 16 | static_cast<std::uint32_t>(bytes[18]) << 24;
+    shard.bytes = record;
+    return shard.k >= 1 && shard.k <= shard.n && shard.index < shard.n;
+}
+
+} // namespace
+
+// Function to tell if an extracted message is a shard record
+bool isShard(const std::string& extracted) {
+    return extracted.size() >= recordHeaderSize && std::memcmp(extracted.data(), shardMagic, 4) == 0;
+}
+
+// Function to hide a message in k-of-n shards
+int encryptShards(const std::vector<std::string>& files, const std::string& message, int k,
+                  const Steganography::EmbedOptions& options) {
+    const int n = static_cast<int>(files.size());
+    if (k < 1 || k > n || n > 255) {
+        fmt::println("Sharding needs 1 <= k <= n <= 255 (k = {}, n = {}).", k, n);
+        return -1;
+    }
+
+    // Compression and encryption apply to the whole payload, the carrier layout to every image on its own
+    Steganography::EmbedOptions whole, perImage = options;
+    whole.compress = options.compress;
+    whole.encrypt = options.encrypt;
+    whole.key = options.key;
+    perImage.compress = false;
+    perImage.encrypt = false;
+    std::vector<unsigned char> payload = Steganography::buildPayload(message, whole);
+    std::vector<std::vector<unsigned char>> shards = ReedSolomon::encodeShards(payload.data(), payload.size(), k, n);
+
+    // A random set ID keeps shards of different messages hidden in the same pool apart
+    Crypto::Nonce random = Crypto::randomNonce();
+    std::string header(recordHeaderSize, '\0');
+    std::memcpy(header.data(), shardMagic, 4);
+    std::copy(random.begin(), random.begin() + 8, header.begin() + 4);
+    header[13] = static_cast<char>(k);
+    header[14] = static_cast<char>(n);
+    for (int b = 0; b < 4; ++b) header[15 + b] = static_cast<char>(payload.size() >> (8 * b));
+
+    std::vector<char> written(n, 0);
+    Parallel::forEach(files.size(), [&](std::size_t i) {
+        std::string record = header;
+        record[12] = static_cast<char>(i);
+        record.append(reinterpret_cast<const char*>(shards[i].data()), shards[i].size());
+        written[i] = Steganography::encryptMessage(files[i], record, perImage);
+    }, [&](std::size_t i, std::exception_ptr error) {
+        fmt::println("Failed to write '{}': {}", files[i], Parallel::describe(error));
+    });
+
+    int count = 0;
+    for (int i = 0; i < n; ++i) {
+        if (written[i]) {
+            ++count;
+        } else {
+            fmt::println("Shard {} was not written to '{}'.", i, files[i]);
+        }
+    }
+    fmt::println("Shard size: {} bytes, {} of {} shards written, any {} of them recover the message.",
+                 shards[0].size(), count, n, k);
+    return count;
+}
+
+// Function to extract the shards and rebuild the message
+std::string extractShards(const std::vector<std::string>& files, const Steganography::EmbedOptions& options) {
+    std::vector<Shard> found(files.size());
+    std::vector<char> valid(files.size(), 0);
+    Parallel::forEach(files.size(), [&](std::size_t i) {
+        valid[i] = parseShard(Steganography::extractMessage(files[i], options), found[i]);
+    }, [&](std::size_t i, std::exception_ptr error) {
+        fmt::println("Failed to read '{}': {}", files[i], Parallel::describe(error));
+    });
+
+    // Group by set, a set is complete once it has k distinct shards that agree on its shape
+    std::map<SetId, std::vector<const Shard*>> sets;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        if (!valid[i]) {
+            fmt::println("No intact shard in '{}'.", files[i]);
+            continue;
+        }
+        std::vector<const Shard*>& set = sets[found[i].setId];
+        const Shard& shard = found[i];
+        bool fits = set.empty() || (shard.k == set[0]->k && shard.n == set[0]->n &&
+                                    shard.payloadLength == set[0]->payloadLength &&
+                                    shard.bytes.size() == set[0]->bytes.size());
+        bool duplicate = std::any_of(set.begin(), set.end(), [&](const Shard* s) { return s->index == shard.index; });
+        if (fits && !duplicate) set.push_back(&shard);
+    }
+
+    for (const auto& [setId, set] : sets) {
+        int k = set[0]->k;
+        if (static_cast<int>(set.size()) < k) {
+            fmt::println("Found {} of the {} shards needed for a set of {}.", set.size(), k, set[0]->n);
+            continue;
+        }
+        std::vector<std::pair<int, const unsigned char*>> pieces;
+        for (int r = 0; r < k; ++r) {
+            pieces.emplace_back(set[r]->index,
+                                reinterpret_cast<const unsigned char*>(set[r]->bytes.data()) + recordHeaderSize);
+        }
+        std::vector<unsigned char> payload;
+        std::size_t shardSize = set[0]->bytes.size() - recordHeaderSize;
+        if (!ReedSolomon::decodeShards(pieces, shardSize, k, set[0]->payloadLength, payload)) continue;
+        return Steganography::parsePayload(payload.data(), payload.size(), options);
+    }
+    return "";
+}
+
+} // namespace Sharding
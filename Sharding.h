@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Steganography.h"
+
+// A message spread over several carrier images (-xe / -xd), for payloads no single carrier can hold.
+// The payload (compressed and encrypted as usual) is cut into k data shards, n - k parity shards are added with
+// the Reed-Solomon erasure code, and shard i goes into image i as an ordinary checksummed message, with the layout
+// options (--matrix, --fec, --permute, ...) applying per image. Any k intact shards of a set give the message back;
+// a missing, unreadable or damaged image just counts as a lost shard. Images are handled on parallel threads.
+//
+// Shard record (the message stored in each image): "STGS", set ID (8 bytes), shard index, k, n (one byte each),
+// payload length (u32 little endian), then the shard bytes.
+namespace Sharding {
+
+    constexpr char shardMagic[4] = {'S', 'T', 'G', 'S'};
+
+    // Function to tell if a message extracted from one image is a shard record
+    bool isShard(const std::string& extracted);
+
+    // Function to hide a message in k-of-n shards, one per file (n = files.size(), at most 255).
+    // Returns the number of images written, the set can be recovered if that is at least k.
+    int encryptShards(const std::vector<std::string>& files, const std::string& message, int k,
+                      const Steganography::EmbedOptions& options = {});
+
+    // Function to extract the shards from the files in parallel and rebuild the message, empty if fewer than k are intact
+    std::string extractShards(const std::vector<std::string>& files, const Steganography::EmbedOptions& options = {});
+
+} // namespace Sharding
@@ -0,0 +1,264 @@
+#include "SharedFrames.h"
+#include "Steganography.h"
+#include <algorithm>
+#include <fmt/core.h>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace SharedFrames {
+
+#ifdef __linux__
+
+namespace {
+
+// Waits while word == expected. The timeout only makes sure a closed ring is noticed,
+// close() cannot change the word the other side sleeps on.
+void futexWait(std::atomic<std::uint32_t>& word, std::uint32_t expected) {
+    timespec timeout{0, 100'000'000};
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futexWake(std::atomic<std::uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+std::size_t pageAlign(std::size_t size) {
+    std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return (size + page - 1) / page * page;
+}
+
+// shm_open names look like "/name", memfds and other files are opened by path
+int openRing(const std::string& name, bool create) {
+    if (name.rfind("/proc/", 0) == 0 || name.rfind("/dev/", 0) == 0) {
+        return open(name.c_str(), O_RDWR | O_CLOEXEC);
+    }
+    return shm_open(name.c_str(), O_RDWR | (create ? O_CREAT | O_EXCL : 0), 0600);
+}
+
+} // namespace
+
+Ring::~Ring() {
+    if (header) munmap(header, mappedSize);
+    if (!unlinkName.empty()) shm_unlink(unlinkName.c_str());
+}
+
+bool Ring::map(int fd, std::size_t size) {
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping keeps the object alive
+    if (address == MAP_FAILED) {
+        fmt::println("Failed to map shared memory ring.");
+        return false;
+    }
+    header = static_cast<RingHeader*>(address);
+    mappedSize = size;
+    return true;
+}
+
+// Function to create a new ring (producer side)
+bool Ring::create(const std::string& name, std::uint32_t slotCount, const ImageHandler::PixelView& layout) {
+    int fd;
+    if (name.empty()) {
+        fd = static_cast<int>(syscall(SYS_memfd_create, "stego-ring", 0));
+        ringPath = fmt::format("/proc/{}/fd/{}", getpid(), fd);
+    } else {
+        fd = openRing(name, true);
+        ringPath = name;
+        unlinkName = name;
+    }
+    if (fd < 0) {
+        fmt::println("Failed to create shared memory ring '{}'.", name);
+        unlinkName.clear();
+        return false;
+    }
+
+    std::size_t dataOffset = pageAlign(sizeof(RingHeader));
+    std::size_t slotSize = pageAlign(layout.size());
+    std::size_t size = dataOffset + slotSize * slotCount;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        fmt::println("Failed to size shared memory ring.");
+        ::close(fd);
+        return false;
+    }
+    // memfds stay reachable through /proc only while the descriptor is open
+    if (name.empty()) fd = dup(fd);
+    if (!map(fd, size)) return false;
+
+    // ftruncate zero-fills, so the counters start at 0
+    std::copy(std::begin(ringMagic), std::end(ringMagic), header->magic);
+    header->slotCount = slotCount;
+    header->width = layout.width;
+    header->height = layout.height;
+    header->channels = layout.channels;
+    header->bytesPerSample = layout.bytesPerSample;
+    header->rowStride = layout.rowStride;
+    header->slotSize = slotSize;
+    header->dataOffset = dataOffset;
+    return true;
+}
+
+// Function to map an existing ring (consumer side)
+bool Ring::attach(const std::string& name) {
+    int fd = openRing(name, false);
+    struct stat st{};
+    if (fd < 0 || fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(RingHeader)) {
+        fmt::println("Shared memory ring '{}' not found.", name);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    if (!map(fd, static_cast<std::size_t>(st.st_size))) return false;
+    ringPath = name;
+
+    const RingHeader& h = *header;
+    bool valid = std::equal(std::begin(ringMagic), std::end(ringMagic), h.magic) && h.slotCount > 0 &&
+                 h.rowStride >= static_cast<std::uint64_t>(h.width) * h.channels * h.bytesPerSample &&
+                 h.slotSize >= h.rowStride * h.height &&
+                 h.dataOffset >= sizeof(RingHeader) && h.dataOffset + h.slotSize * h.slotCount <= mappedSize;
+    if (!valid) {
+        fmt::println("'{}' is not a valid frame ring.", name);
+        return false;
+    }
+    current = header->tail.load(std::memory_order_acquire);
+    return true;
+}
+
+ImageHandler::PixelView Ring::slot(std::uint32_t frame) const {
+    ImageHandler::PixelView view;
+    view.data = reinterpret_cast<char*>(header) + header->dataOffset + (frame % header->slotCount) * header->slotSize;
+    view.width = static_cast<int>(header->width);
+    view.height = static_cast<int>(header->height);
+    view.channels = static_cast<int>(header->channels);
+    view.bytesPerSample = static_cast<int>(header->bytesPerSample);
+    view.rowStride = header->rowStride;
+    return view;
+}
+
+std::uint32_t Ring::released() const {
+    return header->tail.load(std::memory_order_acquire);
+}
+
+// Function for the consumer to wait for the next frame
+bool Ring::acquire(ImageHandler::PixelView& frame) {
+    for (;;) {
+        std::uint32_t head = header->head.load(std::memory_order_acquire);
+        if (head != current) break;
+        if (header->closed.load(std::memory_order_acquire)) return false;
+        futexWait(header->head, head);
+    }
+    frame = slot(current);
+    return true;
+}
+
+// Function for the consumer to hand the frame back
+void Ring::release() {
+    header->tail.store(++current, std::memory_order_release);
+    futexWake(header->tail);
+}
+
+// Function for the producer to wait for a free slot
+ImageHandler::PixelView Ring::reserve() {
+    for (;;) {
+        std::uint32_t tail = header->tail.load(std::memory_order_acquire);
+        if (current - tail < header->slotCount) break;
+        futexWait(header->tail, tail);
+    }
+    return slot(current);
+}
+
+// Function for the producer to publish the reserved slot
+void Ring::publish() {
+    header->head.store(++current, std::memory_order_release);
+    futexWake(header->head);
+}
+
+// Function for the producer to wait for the consumer and close the ring
+void Ring::close() {
+    for (;;) {
+        std::uint32_t tail = header->tail.load(std::memory_order_acquire);
+        if (tail == current) break;
+        futexWait(header->tail, tail);
+    }
+    header->closed.store(1, std::memory_order_release);
+    futexWake(header->head);
+}
+
+// Function to hide a message in every frame that passes through the ring
+long encryptRing(const std::string& name, const std::string& message, const Steganography::EmbedOptions& options) {
+    if (options.adaptive) {
+        fmt::println("Adaptive embedding works on image files only.");
+        return -1;
+    }
+    Ring ring;
+    if (!ring.attach(name)) return -1;
+
+    // Built once: compression, the nonce, encryption and the checksum are the same for every frame
+    std::vector<unsigned char> payload = Steganography::buildPayload(message, options);
+    long frames = 0;
+    ImageHandler::PixelView frame;
+    while (ring.acquire(frame)) {
+        // The frame is changed where the producer put it, nothing is copied
+        bool ok = Steganography::embedPayloadInView(frame, payload, options);
+        ring.release();
+        if (!ok) return -1;
+        ++frames;
+    }
+    return frames;
+}
+
+// Function to extract the message from every frame that passes through the ring
+long extractRing(const std::string& name, const Steganography::EmbedOptions& options) {
+    Ring ring;
+    if (!ring.attach(name)) return -1;
+
+    long frames = 0;
+    std::string previous;
+    ImageHandler::PixelView frame;
+    while (ring.acquire(frame)) {
+        std::string message = Steganography::extractFromView(frame, options);
+        ring.release();
+        // Consecutive frames usually carry the same message, print only when it changes
+        if (frames == 0 || message != previous) {
+            fmt::println("Frame {}: '{}'", ring.frameNumber() - 1, message);
+            previous = std::move(message);
+        }
+        ++frames;
+    }
+    return frames;
+}
+
+#else
+
+// Shared-memory rings need shm_open/memfd and futexes, so they are Linux only
+Ring::~Ring() = default;
+bool Ring::map(int, std::size_t) { return false; }
+bool Ring::create(const std::string&, std::uint32_t, const ImageHandler::PixelView&) { return false; }
+bool Ring::attach(const std::string&) { return false; }
+bool Ring::acquire(ImageHandler::PixelView&) { return false; }
+void Ring::release() {}
+ImageHandler::PixelView Ring::reserve() { return {}; }
+void Ring::publish() {}
+void Ring::close() {}
+std::uint32_t Ring::released() const { return 0; }
+ImageHandler::PixelView Ring::slot(std::uint32_t) const { return {}; }
+
+long encryptRing(const std::string&, const std::string&, const Steganography::EmbedOptions&) {
+    fmt::println("Shared memory rings are only supported on Linux.");
+    return -1;
+}
+
+long extractRing(const std::string&, const Steganography::EmbedOptions&) {
+    fmt::println("Shared memory rings are only supported on Linux.");
+    return -1;
+}
+
+#endif
+
+} // namespace SharedFrames
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ImageFormats.h"
+#include "Steganography.h"
+
+// Shared-memory frame ring (Linux). A capture process keeps raw frames in a POSIX shared-memory object
+// (shm_open name, or a memfd passed as /proc/<pid>/fd/<n>) and the tool embeds/extracts in place,
+// without files and without copying frames. Producer and consumer hand slots over with two
+// counters used as futex words, so nobody spins and nobody polls.
+//
+// Layout: RingHeader at offset 0, slot i at dataOffset + i * slotSize. A slot holds one frame with
+// `height` rows of `rowStride` bytes, each row starting with width * channels * bytesPerSample pixel bytes.
+namespace SharedFrames {
+
+    constexpr char ringMagic[8] = {'S', 'T', 'G', 'R', 'I', 'N', 'G', '1'};
+
+    struct RingHeader {
+        char magic[8];
+        std::uint32_t slotCount;
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t channels;
+        std::uint32_t bytesPerSample;
+        std::uint32_t reserved;
+        std::uint64_t rowStride;
+        std::uint64_t slotSize;
+        std::uint64_t dataOffset;
+        // Frames published by the producer, frame n lives in slot n % slotCount
+        alignas(64) std::atomic<std::uint32_t> head;
+        // Frames the consumer is done with, the producer may reuse their slots
+        alignas(64) std::atomic<std::uint32_t> tail;
+        // Set by the producer when no more frames will come
+        std::atomic<std::uint32_t> closed;
+    };
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "futex words must be plain 32-bit integers");
+
+    // A mapped ring, used by both sides
+    class Ring {
+    public:
+        Ring() = default;
+        Ring(const Ring&) = delete;
+        Ring& operator=(const Ring&) = delete;
+        ~Ring();
+
+        // Function to create a new ring (producer side), slots are page aligned.
+        // An empty name creates an anonymous memfd, path() then tells the consumer where to find it.
+        bool create(const std::string& name, std::uint32_t slotCount, const ImageHandler::PixelView& layout);
+
+        // Function to map an existing ring (consumer side)
+        bool attach(const std::string& name);
+
+        // Function for the consumer to wait for the next frame, false once the producer closed the ring
+        bool acquire(ImageHandler::PixelView& frame);
+        // Function for the consumer to hand the frame from acquire back to the producer
+        void release();
+
+        // Function for the producer to wait for a free slot
+        ImageHandler::PixelView reserve();
+        // Function for the producer to publish the slot from reserve
+        void publish();
+        // Function for the producer to wait until the consumer released everything and close the ring
+        void close();
+
+        // Name or path a consumer passes to attach
+        const std::string& path() const { return ringPath; }
+
+        // Frame number of the current (acquired or reserved) slot
+        std::uint32_t frameNumber() const { return current; }
+        // Frames released by the consumer so far
+        std::uint32_t released() const;
+        // Slot of a given frame number, valid until the producer reuses it
+        ImageHandler::PixelView slot(std::uint32_t frame) const;
+
+    private:
+        bool map(int fd, std::size_t size);
+
+        RingHeader* header = nullptr;
+        std::size_t mappedSize = 0;
+        std::string ringPath;
+        std::string unlinkName; // creator removes the shm_open name again
+        std::uint32_t current = 0;
+    };
+
+    // Function to hide a message in every frame that passes through the ring, returns the number of frames
+    long encryptRing(const std::string& name, const std::string& message, const Steganography::EmbedOptions& options = {});
+
+    // Function to extract the message from every frame that passes through the ring
+    long extractRing(const std::string& name, const Steganography::EmbedOptions& options = {});
+
+} // namespace SharedFrames
@@ -0,0 +1,107 @@
+#include "SharedFrames.h"
+#include "Steganography.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <fmt/core.h>
+
+// Local stand-in for a capture process: creates a frame ring, fills frames with noise and checks
+// what the tool did to them once they come back. Run it first, then point the tool at the printed ring:
+//   stego_shm_producer /stego-ring 1000 1920 1080 3 --expect "secret" &
+//   Steganography_project -se /stego-ring "secret"
+
+namespace {
+
+constexpr unsigned char paddingByte = 0xA5; // row padding must come back unchanged
+constexpr std::uint32_t slotCount = 4;
+
+void fillFrame(const ImageHandler::PixelView& view, std::uint64_t seed) {
+    std::size_t rowBytes = static_cast<std::size_t>(view.width) * view.channels * view.bytesPerSample;
+    std::uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (int row = 0; row < view.height; ++row) {
+        char* p = view.data + row * view.rowStride;
+        for (std::size_t i = 0; i < rowBytes; ++i) {
+            // xorshift64, cheap enough not to dominate the measurement
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            p[i] = static_cast<char>(state >> 56);
+        }
+        std::fill(p + rowBytes, p + view.rowStride, static_cast<char>(paddingByte));
+    }
+}
+
+bool paddingIntact(const ImageHandler::PixelView& view) {
+    std::size_t rowBytes = static_cast<std::size_t>(view.width) * view.channels * view.bytesPerSample;
+    for (int row = 0; row < view.height; ++row) {
+        const char* p = view.data + row * view.rowStride;
+        for (std::size_t i = rowBytes; i < view.rowStride; ++i) {
+            if (static_cast<unsigned char>(p[i]) != paddingByte) return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc != 6 && argc != 8) {
+        fmt::println("Usage: stego_shm_producer <ring name | --memfd> <frames> <width> <height> <channels> [--expect|--embed message]");
+        fmt::println("--expect checks that every frame came back carrying the message (use with -se),");
+        fmt::println("--embed hides the message in every frame before publishing it (use with -sd).");
+        return 1;
+    }
+    std::string name = argv[1];
+    if (name == "--memfd") name.clear();
+    long frames = std::atol(argv[2]);
+    ImageHandler::PixelView layout;
+    layout.width = std::atoi(argv[3]);
+    layout.height = std::atoi(argv[4]);
+    layout.channels = std::atoi(argv[5]);
+    // Rows padded to 4 bytes like BMP, so the consumer has to honour rowStride
+    layout.rowStride = (static_cast<std::size_t>(layout.width) * layout.channels + 3) & ~std::size_t{3};
+    std::string mode = argc == 8 ? argv[6] : "";
+    std::string message = argc == 8 ? argv[7] : "";
+    if (frames <= 0 || layout.width <= 0 || layout.height <= 0 || layout.channels <= 0 ||
+        (!mode.empty() && mode != "--expect" && mode != "--embed")) {
+        fmt::println("Invalid arguments.");
+        return 1;
+    }
+
+    SharedFrames::Ring ring;
+    if (!ring.create(name, slotCount, layout)) return 1;
+    fmt::println("Ring ready: {}", ring.path());
+    std::fflush(stdout);
+
+    long failures = 0;
+    auto verify = [&](std::uint32_t frame) {
+        ImageHandler::PixelView view = ring.slot(frame);
+        bool ok = paddingIntact(view);
+        if (mode == "--expect") ok = ok && Steganography::extractFromView(view) == message;
+        if (!ok) {
+            if (failures < 10) fmt::println("Frame {} came back wrong.", frame);
+            ++failures;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (long n = 0; n < frames; ++n) {
+        ImageHandler::PixelView view = ring.reserve();
+        // reserve() returns once the consumer released the frame that used this slot before
+        if (n >= static_cast<long>(slotCount)) verify(static_cast<std::uint32_t>(n - slotCount));
+        fillFrame(view, static_cast<std::uint64_t>(n));
+        if (mode == "--embed" && !Steganography::embedInView(view, message)) return 1;
+        ring.publish();
+    }
+    ring.close();
+    for (long n = std::max(0L, frames - static_cast<long>(slotCount)); n < frames; ++n) {
+        verify(static_cast<std::uint32_t>(n));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fmt::println("{} frames in {:.3f} s ({:.1f} frames/s), {} failures.", frames, seconds, frames / seconds, failures);
+    return failures == 0 ? 0 : 1;
+}
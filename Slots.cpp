@@ -0,0 +1,257 @@
+#include "Slots.h"
+#include "ImageHandler.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <fmt/core.h>
+
+namespace Slots {
+
+namespace {
+
+constexpr std::size_t headerSize = 8;
+constexpr std::size_t entrySize = nameSize + 8;
+
+// The carrier samples of an image file. Raw formats are accessed in place at pixelDataOffset + sample bytes,
+// the others are decoded into memory and written back whole by commit. Ranges are in samples, the bytes read and
+// written are whole samples (two bytes each for 16-bit images).
+class CarrierFile {
+public:
+    bool open(const std::string& path, bool writable) {
+        filename = path;
+        if (!ImageHandler::readImageInfo(filename, info)) return false;
+        using ImageHandler::ImageFormat;
+        direct = info.format == ImageFormat::Bmp || info.format == ImageFormat::Ppm ||
+                 info.format == ImageFormat::Pgm || info.format == ImageFormat::Pam;
+        if (!direct) return ImageHandler::readImage(filename, data, info);
+        file.open(filename, writable ? std::ios::in | std::ios::out | std::ios::binary : std::ios::in | std::ios::binary);
+        if (!file) {
+            fmt::println("Failed to open '{}'.", filename);
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t sampleBytes() const { return info.maxVal > 255 ? 2 : 1; }
+
+    std::size_t size() const { return (direct ? info.rowStride * info.height : data.size()) / sampleBytes(); }
+
+    bool read(std::size_t first, std::size_t count, std::vector<char>& bytes) {
+        if (first + count > size()) return false;
+        first *= sampleBytes();
+        count *= sampleBytes();
+        bytes.resize(count);
+        if (!direct) {
+            std::copy(data.begin() + first, data.begin() + first + count, bytes.begin());
+            return true;
+        }
+        file.seekg(static_cast<std::streamoff>(info.pixelDataOffset + first));
+        file.read(bytes.data(), bytes.size());
+        return static_cast<bool>(file);
+    }
+
+    bool write(std::size_t first, const std::vector<char>& bytes) {
+        first *= sampleBytes();
+        if (first + bytes.size() > size() * sampleBytes()) return false;
+        if (!direct) {
+            std::copy(bytes.begin(), bytes.end(), data.begin() + first);
+            dirty = true;
+            return true;
+        }
+        file.seekp(static_cast<std::streamoff>(info.pixelDataOffset + first));
+        file.write(bytes.data(), bytes.size());
+        return static_cast<bool>(file.flush());
+    }
+
+    bool commit() {
+        if (direct || !dirty) return true;
+        if (!ImageHandler::writeImage(filename, data, info)) {
+            fmt::println("Error writing image.");
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string filename;
+    ImageHandler::ImageInfo info;
+    std::fstream file;
+    bool direct = false;
+    std::vector<char> data;
+    bool dirty = false;
+};
+
+// Bytes stored one bit per sample from carrier sample `first` on
+bool readBytes(CarrierFile& file, std::size_t first, unsigned char* out, std::size_t count) {
+    std::vector<char> carrier;
+    if (!file.read(first, count * 8, carrier)) return false;
+    std::fill(out, out + count, 0);
+    Steganography::extractBits(Steganography::Carrier::buffer(carrier.data(), carrier.size(), file.sampleBytes()), {}, 0,
+                               out, 0, count * 8);
+    return true;
+}
+
+bool writeBytes(CarrierFile& file, std::size_t first, const unsigned char* bytes, std::size_t count) {
+    std::vector<char> carrier;
+    if (!file.read(first, count * 8, carrier)) return false;
+    Steganography::embedBits(Steganography::Carrier::buffer(carrier.data(), carrier.size(), file.sampleBytes()), {}, 0,
+                             bytes, 0, count * 8);
+    return file.write(first, carrier);
+}
+
+std::uint32_t readLE32(const unsigned char* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+}
+
+void writeLE32(unsigned char* p, std::uint32_t value) {
+    for (int b = 0; b < 4; ++b) p[b] = static_cast<unsigned char>(value >> (8 * b));
+}
+
+struct Directory {
+    int capacity = defaultSlots;
+    std::vector<Entry> entries;
+
+    // First carrier sample after the directory, slots start there
+    std::size_t end() const { return directorySamples(capacity); }
+};
+
+bool readDirectory(CarrierFile& file, Directory& directory) {
+    unsigned char header[headerSize];
+    if (!readBytes(file, 0, header, headerSize) || std::memcmp(header, directoryMagic, 4) != 0) return false;
+    directory.capacity = header[4];
+    int count = header[5];
+    if (count > directory.capacity) return false;
+
+    std::vector<unsigned char> table(entrySize * count);
+    if (!readBytes(file, headerSize * 8, table.data(), table.size())) return false;
+    directory.entries.clear();
+    for (int i = 0; i < count; ++i) {
+        const unsigned char* entry = table.data() + i * entrySize;
+        const char* name = reinterpret_cast<const char*>(entry);
+        directory.entries.push_back({std::string(name, std::find(name, name + nameSize, '\0')),
+                                     readLE32(entry + nameSize), readLE32(entry + nameSize + 4)});
+    }
+    return true;
+}
+
+void writeHeader(unsigned char* header, const Directory& directory) {
+    std::memcpy(header, directoryMagic, 4);
+    header[4] = static_cast<unsigned char>(directory.capacity);
+    header[5] = static_cast<unsigned char>(directory.entries.size());
+    header[6] = header[7] = 0;
+}
+
+} // namespace
+
+// Function to tell if an image starts with a slot directory
+bool hasDirectory(const std::string& filename) {
+    CarrierFile file;
+    Directory directory;
+    return file.open(filename, false) && readDirectory(file, directory);
+}
+
+// Function to list the slots of an image
+bool listSlots(const std::string& filename, std::vector<Entry>& entries) {
+    CarrierFile file;
+    Directory directory;
+    if (!file.open(filename, false)) return false;
+    if (!readDirectory(file, directory)) {
+        fmt::println("The image has no slot directory.");
+        return false;
+    }
+    entries = directory.entries;
+    return true;
+}
+
+// Function to append a named message
+bool addSlot(const std::string& filename, const std::string& name, const std::string& message,
+             const Steganography::EmbedOptions& options) {
+    if (name.empty() || name.size() > nameSize || name.find('\0') != std::string::npos) {
+        fmt::println("Slot names are 1 to {} bytes long.", nameSize);
+        return false;
+    }
+    if (options.adaptive) {
+        fmt::println("Adaptive embedding chooses bytes from the whole image, it cannot be used for slots.");
+        return false;
+    }
+    CarrierFile file;
+    if (!file.open(filename, true)) return false;
+    Directory directory;
+    if (!readDirectory(file, directory)) {
+        directory = Directory{};
+        if (directory.end() > file.size()) {
+            fmt::println("The image is too small for a slot directory.");
+            return false;
+        }
+    }
+    if (std::any_of(directory.entries.begin(), directory.entries.end(), [&](const Entry& e) { return e.name == name; })) {
+        fmt::println("A slot named '{}' already exists.", name);
+        return false;
+    }
+    if (static_cast<int>(directory.entries.size()) >= directory.capacity) {
+        fmt::println("The slot directory is full ({} slots).", directory.capacity);
+        return false;
+    }
+
+    // Slots are packed one after the other, the new one goes behind the last
+    std::size_t first = directory.end();
+    for (const Entry& entry : directory.entries) first = std::max<std::size_t>(first, entry.first + entry.samples);
+    std::vector<unsigned char> payload = Steganography::buildPayload(message, options);
+    Steganography::Layout layout = Steganography::payloadLayout(payload);
+    std::size_t samples = layout.samplesFor(payload.size() * 8);
+    if (first + samples > file.size() || first + samples > UINT32_MAX) {
+        fmt::println("Insufficient space in image for this slot ({} samples needed, {} left).", samples,
+                     file.size() > first ? file.size() - first : 0);
+        return false;
+    }
+
+    // The slot first, then its entry, the count last: an interrupted append leaves the directory as it was
+    std::vector<char> range;
+    if (!file.read(first, samples, range)) return false;
+    Steganography::Carrier carrier = Steganography::Carrier::buffer(range.data(), range.size(), file.sampleBytes());
+    std::optional<Permutation::Order> order;
+    if (options.permute) carrier.order = &order.emplace(carrier.size, options.key);
+    Steganography::embedBits(carrier, layout, 0, payload.data(), 0, payload.size() * 8);
+    if (!file.write(first, range)) return false;
+
+    unsigned char entry[entrySize] = {};
+    std::memcpy(entry, name.data(), name.size());
+    writeLE32(entry + nameSize, static_cast<std::uint32_t>(first));
+    writeLE32(entry + nameSize + 4, static_cast<std::uint32_t>(samples));
+    std::size_t index = directory.entries.size();
+    directory.entries.push_back({name, static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(samples)});
+    unsigned char header[headerSize];
+    writeHeader(header, directory);
+    if (!writeBytes(file, (headerSize + entrySize * index) * 8, entry, entrySize) ||
+        !writeBytes(file, 0, header, headerSize)) {
+        fmt::println("Error writing the slot directory.");
+        return false;
+    }
+    return file.commit();
+}
+
+// Function to extract the message of a named slot
+std::string readSlot(const std::string& filename, const std::string& name, const Steganography::EmbedOptions& options) {
+    CarrierFile file;
+    Directory directory;
+    if (!file.open(filename, false)) return "";
+    if (!readDirectory(file, directory)) {
+        fmt::println("The image has no slot directory.");
+        return "";
+    }
+    auto entry = std::find_if(directory.entries.begin(), directory.entries.end(),
+                              [&](const Entry& e) { return e.name == name; });
+    if (entry == directory.entries.end()) {
+        fmt::println("There is no slot named '{}'.", name);
+        return "";
+    }
+    std::vector<char> range;
+    if (!file.read(entry->first, entry->samples, range)) {
+        fmt::println("The slot lies outside the image.");
+        return "";
+    }
+    return Steganography::extractFromBuffer(range.data(), range.size(), options, file.sampleBytes());
+}
+
+} // namespace Slots
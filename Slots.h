@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Steganography.h"
+
+// Several named messages in one image (-ta / -tg / -tl). The first carrier bytes hold a slot directory, one bit per
+// sample like a payload header, and every slot is an ordinary payload in its own carrier range after it, so
+// compression, encryption, --bits-per-sample, --matrix, --fec and --permute work per slot.
+// Slots are only ever appended: adding one writes the slot, its directory entry and the entry count, nothing else.
+// Reading one reads the directory and that slot's range. For BMP, binary PPM/PGM and PAM the carrier bytes are read
+// and written in place in the file; compressed formats (PNG, QOI) and plain Netpbm have to be decoded and written
+// back whole, but the other slots are still left as they are.
+//
+// Directory: "STGT", slot capacity, slot count, 2 reserved bytes, then per slot: name (16 bytes, zero padded),
+// first carrier sample (u32), carrier samples (u32), little endian.
+namespace Slots {
+
+    constexpr char directoryMagic[4] = {'S', 'T', 'G', 'T'};
+    constexpr std::size_t nameSize = 16;
+    constexpr int defaultSlots = 16;
+
+    // Carrier samples taken by a directory with room for `slots` entries, the slots start after them
+    constexpr std::size_t directorySamples(int slots = defaultSlots) { return (8 + (nameSize + 8) * slots) * 8; }
+
+    struct Entry {
+        std::string name;
+        std::uint32_t first = 0;   // carrier sample where the slot starts
+        std::uint32_t samples = 0; // carrier samples it takes
+    };
+
+    // Function to tell if an image starts with a slot directory
+    bool hasDirectory(const std::string& filename);
+
+    // Function to list the slots of an image, false if it has no directory
+    bool listSlots(const std::string& filename, std::vector<Entry>& entries);
+
+    // Function to append a named message, the directory is created on first use (replacing what the image held)
+    bool addSlot(const std::string& filename, const std::string& name, const std::string& message,
+                 const Steganography::EmbedOptions& options = {});
+
+    // Function to extract the message of a named slot, empty if there is none
+    std::string readSlot(const std::string& filename, const std::string& name,
+                         const Steganography::EmbedOptions& options = {});
+
+} // namespace Slots
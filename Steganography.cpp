@@ -1,49 +1,788 @@
 #include "Steganography.h"
+#include "Checksum.h"
+#include "CostMap.h"
 #include "ImageHandler.h"
+#include "LsbKernels.h"
+#include "Lz.h"
+#include "ReedSolomon.h"
+#include "Trace.h"
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <algorithm>
+#include <string_view>
 #include <vector>
-#include <bitset>
 #include <fmt/core.h>
 
 namespace Steganography {
 
-const std::string marker = "MSG:"; // Marker to indicate message presence so I know what to look for
+const std::string marker = "MSG:"; // Marker of the old payload format, still recognised when extracting
+constexpr std::string_view headerMagic = "STG2";
+
+namespace {
+
+void putLE32(unsigned char* p, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+std::uint32_t getLE32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+bool startsWith(const unsigned char* bytes, std::size_t available, std::string_view prefix) {
+    return available >= prefix.size() && std::equal(prefix.begin(), prefix.end(), bytes);
+}
+
+// Reads the header fields this version knows, false if the bytes are not a (complete) header
+bool readHeader(const unsigned char* bytes, std::size_t available, PayloadHeader& header) {
+    if (!startsWith(bytes, available, headerMagic) || available < PayloadHeader::minSize) return false;
+    header.size = bytes[4];
+    header.flags = bytes[5];
+    header.messageLength = getLE32(bytes + 6);
+    header.dataLength = getLE32(bytes + 10);
+    std::size_t needed = PayloadHeader::minSize;
+    if (header.flags & Encrypted) needed += header.nonce.size() + header.tag.size();
+    if (header.flags & MultiBit) needed += 1;
+    if (header.flags & Matrix) needed += 1;
+    if (header.flags & Adaptive) needed += 1;
+    if (header.flags & Checksummed) needed += 4;
+    if (header.flags & Fec) needed += 5;
+    if (header.size < needed || available < header.size) return false;
+
+    // Optional fields, in flag order
+    const unsigned char* field = bytes + PayloadHeader::minSize;
+    if (header.flags & Encrypted) {
+        std::copy(field, field + header.nonce.size(), header.nonce.begin());
+        field += header.nonce.size();
+        std::copy(field, field + header.tag.size(), header.tag.begin());
+        field += header.tag.size();
+    }
+    header.bitsPerSample = 1;
+    if (header.flags & MultiBit) {
+        header.bitsPerSample = *field++;
+        if (header.bitsPerSample < 1 || header.bitsPerSample > 4) return false;
+    }
+    header.matrixBits = 0;
+    if (header.flags & Matrix) {
+        header.matrixBits = *field++;
+        if (header.matrixBits < 2 || header.matrixBits > 8 || header.bitsPerSample != 1) return false;
+    }
+    header.threshold = 0;
+    if (header.flags & Adaptive) header.threshold = *field++;
+    header.checksum = 0;
+    if (header.flags & Checksummed) {
+        header.checksum = getLE32(field);
+        field += 4;
+    }
+    header.fecParity = 0;
+    header.plainLength = header.dataLength;
+    if (header.flags & Fec) {
+        header.fecParity = field[0];
+        header.plainLength = getLE32(field + 1);
+        if (header.fecParity < 2 || header.fecParity > 128 || header.fecParity % 2 != 0) return false;
+        if (ReedSolomon::shape(header.plainLength, header.fecParity).encodedSize() != header.dataLength) return false;
+    }
+    return true;
+}
+
+void writeHeader(unsigned char* bytes, const PayloadHeader& header) {
+    std::copy(headerMagic.begin(), headerMagic.end(), bytes);
+    bytes[4] = header.size;
+    bytes[5] = header.flags;
+    putLE32(bytes + 6, header.messageLength);
+    putLE32(bytes + 10, header.dataLength);
+    unsigned char* field = bytes + PayloadHeader::minSize;
+    if (header.flags & Encrypted) {
+        field = std::copy(header.nonce.begin(), header.nonce.end(), field);
+        field = std::copy(header.tag.begin(), header.tag.end(), field);
+    }
+    if (header.flags & MultiBit) *field++ = header.bitsPerSample;
+    if (header.flags & Matrix) *field++ = header.matrixBits;
+    if (header.flags & Adaptive) *field++ = header.threshold;
+    if (header.flags & Checksummed) {
+        putLE32(field, header.checksum);
+        field += 4;
+    }
+    if (header.flags & Fec) {
+        field[0] = header.fecParity;
+        putLE32(field + 1, header.plainLength);
+    }
+}
+
+Layout layoutOf(const PayloadHeader& header) {
+    return Layout{header.size * std::size_t{8}, header.bitsPerSample, header.matrixBits};
+}
+
+// Runs fn(chunkFirst, chunkLast) over all chunks of an order, split over threads when there is enough work
+template <typename Fn>
+void forChunks(const Permutation::Order& order, std::size_t bitCount, Fn fn) {
+    std::size_t threads = 1;
+    if (bitCount >= (std::size_t{1} << 20)) {
+        threads = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), order.chunkCount());
+    }
+    if (threads == 1) {
+        fn(0, order.chunkCount(), 0);
+        return;
+    }
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&fn](std::size_t chunkFirst, std::size_t chunkLast, std::size_t thread) {
+            Trace::Span span("stego/chunks");
+            fn(chunkFirst, chunkLast, thread);
+        }, order.chunkCount() * t / threads, order.chunkCount() * (t + 1) / threads, t);
+    }
+    for (auto& thread : pool) thread.join();
+}
+
+// Writes the payload bits of [first, last) that belong to global sample `sample` into its low bits
+template <int K>
+void putSample(char* byte, const Layout& layout, std::size_t sample, const unsigned char* payload,
+               std::size_t first, std::size_t last) {
+    if (sample < layout.headerBits) {
+        if (sample >= first && sample < last) {
+            *byte = static_cast<char>((*byte & 0xFE) | LsbKernels::payloadBit(payload, sample));
+        }
+        return;
+    }
+    std::size_t bit = layout.firstBitOf(sample);
+    for (int t = 0; t < K; ++t, ++bit) {
+        if (bit < first || bit >= last) continue;
+        int shift = K - 1 - t;
+        *byte = static_cast<char>((*byte & ~(1 << shift)) | (LsbKernels::payloadBit(payload, bit) << shift));
+    }
+}
+
+// Reads them back into payload, where bit b lands at bit b - base of `out`
+template <int K>
+void getSample(const char* byte, const Layout& layout, std::size_t sample, unsigned char* out, std::size_t base,
+               std::size_t first, std::size_t last) {
+    auto put = [&](std::size_t bit, int value) {
+        std::size_t index = bit - base;
+        out[index >> 3] |= static_cast<unsigned char>(value << (7 - (index & 7)));
+    };
+    if (sample < layout.headerBits) {
+        if (sample >= first && sample < last) put(sample, *byte & 1);
+        return;
+    }
+    std::size_t bit = layout.firstBitOf(sample);
+    for (int t = 0; t < K; ++t, ++bit) {
+        if (bit >= first && bit < last) put(bit, (*byte >> (K - 1 - t)) & 1);
+    }
+}
+
+// Contiguous run of carrier bytes holding global samples [sample, sample + count).
+// Header samples use the 1-bit kernel, data samples go 8 at a time (K payload bytes) once aligned.
+template <int K>
+void embedRun(char* p, std::size_t sample, std::size_t count, const Layout& layout, const unsigned char* payload,
+              std::size_t first, std::size_t last) {
+    std::size_t i = 0;
+    if (sample < layout.headerBits) {
+        std::size_t begin = std::max(sample, first);
+        std::size_t end = std::min({sample + count, layout.headerBits, last});
+        if (begin < end) LsbKernels::embedBits(p + (begin - sample), payload, begin, end - begin);
+        i = std::min(count, layout.headerBits - sample);
+    }
+    while (i < count) {
+        std::size_t s = sample + i;
+        std::size_t bit = layout.firstBitOf(s);
+        if ((s - layout.headerBits) % 8 == 0 && i + 8 <= count && bit >= first && bit + 8 * K <= last) {
+            LsbKernels::scatterGroup<K>(p + i, payload + bit / 8);
+            i += 8;
+        } else {
+            putSample<K>(p + i, layout, s, payload, first, last);
+            ++i;
+        }
+    }
+}
+
+template <int K>
+void extractRun(const char* p, std::size_t sample, std::size_t count, const Layout& layout, unsigned char* payload,
+                std::size_t first, std::size_t last) {
+    std::size_t i = 0;
+    if (sample < layout.headerBits) {
+        std::size_t begin = std::max(sample, first);
+        std::size_t end = std::min({sample + count, layout.headerBits, last});
+        if (begin < end) LsbKernels::extractBits(p + (begin - sample), payload, begin, end - begin);
+        i = std::min(count, layout.headerBits - sample);
+    }
+    while (i < count) {
+        std::size_t s = sample + i;
+        std::size_t bit = layout.firstBitOf(s);
+        if ((s - layout.headerBits) % 8 == 0 && i + 8 <= count && bit >= first && bit + 8 * K <= last) {
+            LsbKernels::gatherGroup<K>(p + i, payload + bit / 8);
+            i += 8;
+        } else {
+            getSample<K>(p + i, layout, s, payload, 0, first, last);
+            ++i;
+        }
+    }
+}
+
+template <int K>
+void embedWith(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, const unsigned char* payload,
+               std::size_t first, std::size_t last) {
+    // Carrier-local sample range that holds the bits
+    std::size_t begin = layout.sampleOf(first) - sampleOffset;
+    std::size_t end = layout.samplesFor(last) - sampleOffset;
+    if (carrier.positions) {
+        // Adaptive selection, the positions are increasing so this still walks the carrier forwards
+        for (std::size_t local = begin; local < end; ++local) {
+            putSample<K>(carrier.at(carrier.positions[local]), layout, local + sampleOffset, payload, first, last);
+        }
+        return;
+    }
+    if (carrier.order) {
+        // Keyed positions, walked chunk by chunk; chunks are disjoint carrier ranges so threads never share bytes
+        forChunks(*carrier.order, end - begin, [&](std::size_t chunkFirst, std::size_t chunkLast, std::size_t) {
+            carrier.order->forEach(begin, end, chunkFirst, chunkLast, [&](std::size_t local, std::size_t position) {
+                putSample<K>(carrier.at(position), layout, local + sampleOffset, payload, first, last);
+            });
+        });
+        return;
+    }
+    if (carrier.sampleBytes != 1) {
+        // 16-bit samples, only every other byte is a carrier byte so the byte kernels do not apply
+        for (std::size_t local = begin; local < end; ++local) {
+            putSample<K>(carrier.at(local), layout, local + sampleOffset, payload, first, last);
+        }
+        return;
+    }
+    for (std::size_t local = begin; local < end;) {
+        std::size_t count = std::min(carrier.rowSamples - local % carrier.rowSamples, end - local);
+        embedRun<K>(carrier.at(local), local + sampleOffset, count, layout, payload, first, last);
+        local += count;
+    }
+}
+
+template <int K>
+void extractWith(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, unsigned char* payload,
+                 std::size_t first, std::size_t last) {
+    std::size_t begin = layout.sampleOf(first) - sampleOffset;
+    std::size_t end = layout.samplesFor(last) - sampleOffset;
+    if (carrier.positions) {
+        for (std::size_t local = begin; local < end; ++local) {
+            getSample<K>(carrier.at(carrier.positions[local]), layout, local + sampleOffset, payload, 0, first, last);
+        }
+        return;
+    }
+    if (carrier.order) {
+        // Neighbouring bits come from different chunks, so every thread fills its own copy and they are OR-ed together
+        std::size_t firstByte = first / 8;
+        std::size_t byteCount = (last + 7) / 8 - firstByte;
+        std::vector<std::vector<unsigned char>> parts(std::max(1u, std::thread::hardware_concurrency()));
+        forChunks(*carrier.order, end - begin, [&](std::size_t chunkFirst, std::size_t chunkLast, std::size_t thread) {
+            std::vector<unsigned char>& part = parts[thread];
+            part.assign(byteCount, 0);
+            carrier.order->forEach(begin, end, chunkFirst, chunkLast, [&](std::size_t local, std::size_t position) {
+                getSample<K>(carrier.at(position), layout, local + sampleOffset, part.data(), firstByte * 8, first, last);
+            });
+        });
+        for (const auto& part : parts) {
+            for (std::size_t i = 0; i < part.size(); ++i) payload[firstByte + i] |= part[i];
+        }
+        return;
+    }
+    if (carrier.sampleBytes != 1) {
+        for (std::size_t local = begin; local < end; ++local) {
+            getSample<K>(carrier.at(local), layout, local + sampleOffset, payload, 0, first, last);
+        }
+        return;
+    }
+    for (std::size_t local = begin; local < end;) {
+        std::size_t count = std::min(carrier.rowSamples - local % carrier.rowSamples, end - local);
+        extractRun<K>(carrier.at(local), local + sampleOffset, count, layout, payload, first, last);
+        local += count;
+    }
+}
+
+// Carrier byte of carrier-local sample `local`, in keyed order or adaptive selection when the carrier has one
+char* sampleAt(const Carrier& carrier, std::size_t local) {
+    if (carrier.positions) return carrier.at(carrier.positions[local]);
+    return carrier.at(carrier.order ? (*carrier.order)(local) : local);
+}
+
+// Syndrome of the matrix block starting at carrier-local sample `local`. Blocks inside a contiguous run use the
+// table kernel (8 samples per lookup), keyed orders, row ends and P = 2 go sample by sample.
+template <int P>
+unsigned syndromeAt(const Carrier& carrier, std::size_t local) {
+    constexpr std::size_t n = (std::size_t{1} << P) - 1;
+    if constexpr (P >= 3) {
+        // The kernel reads one byte past the block, it has to be in the same row
+        if (!carrier.order && !carrier.positions && carrier.sampleBytes == 1 &&
+            carrier.rowSamples - local % carrier.rowSamples > n) {
+            return LsbKernels::blockSyndrome<P>(carrier.at(local));
+        }
+    }
+    unsigned syndrome = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        if (*sampleAt(carrier, local + i) & 1) syndrome ^= static_cast<unsigned>(i ? i : n);
+    }
+    return syndrome;
+}
+
+// Matrix embedding of data bits [first, last): block b (samples headerBits + b * n ...) must get the P payload bits
+// starting at headerBits + b * P as its syndrome, which takes flipping the LSB of the sample labelled
+// syndrome ^ bits, or nothing when they already match. Bits outside [first, last) count as 0.
+template <int P>
+void embedMatrix(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, const unsigned char* payload,
+                 std::size_t first, std::size_t last) {
+    constexpr unsigned n = (1u << P) - 1;
+    std::size_t firstBlock = (first - layout.headerBits) / P;
+    std::size_t lastBlock = (last - layout.headerBits + P - 1) / P;
+    for (std::size_t block = firstBlock; block < lastBlock; ++block) {
+        std::size_t bit = layout.headerBits + block * P;
+        unsigned bits = 0;
+        for (int t = 0; t < P; ++t, ++bit) {
+            bits = (bits << 1) | (bit >= first && bit < last ? LsbKernels::payloadBit(payload, bit) : 0);
+        }
+        std::size_t local = layout.headerBits + block * n - sampleOffset;
+        unsigned label = syndromeAt<P>(carrier, local) ^ bits;
+        if (label) *sampleAt(carrier, local + (label == n ? 0 : label)) ^= 1;
+    }
+}
+
+template <int P>
+void extractMatrix(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, unsigned char* payload,
+                   std::size_t first, std::size_t last) {
+    constexpr unsigned n = (1u << P) - 1;
+    std::size_t firstBlock = (first - layout.headerBits) / P;
+    std::size_t lastBlock = (last - layout.headerBits + P - 1) / P;
+    for (std::size_t block = firstBlock; block < lastBlock; ++block) {
+        unsigned bits = syndromeAt<P>(carrier, layout.headerBits + block * n - sampleOffset);
+        std::size_t bit = layout.headerBits + block * P;
+        for (int t = P - 1; t >= 0; --t, ++bit) {
+            if (bit >= first && bit < last) payload[bit >> 3] |= static_cast<unsigned char>(((bits >> t) & 1) << (7 - (bit & 7)));
+        }
+    }
+}
+
+// Cost map geometry of an image's carrier samples: its rows, with neighbours of the same channel one pixel apart
+CostMap::Geometry geometryOf(const ImageHandler::ImageInfo& info, std::size_t samples) {
+    std::size_t rows = static_cast<std::size_t>(std::max(1, info.height));
+    return {samples / rows, rows, static_cast<std::size_t>(std::max(1, info.channels))};
+}
+
+// Adaptive selection for a payload of `total` bytes: the header samples stay where they are, the stored bytes go
+// to the carrier bytes whose cost reaches the threshold. A negative threshold is replaced by the highest one
+// that still leaves enough bytes. Empty if the carrier has too few of them.
+std::vector<std::uint32_t> adaptivePositions(const Carrier& carrier, const CostMap::Geometry& geometry,
+                                             const Layout& layout, std::size_t total, int& threshold) {
+    Trace::Span span("stego/adaptivePositions", carrier.size);
+    if (carrier.size > UINT32_MAX || layout.samplesFor(total * 8) > carrier.size) return {};
+    const char* bytes = carrier.data;
+    std::vector<char> high;
+    if (carrier.sampleBytes != 1) {
+        // 16-bit samples are mapped by their high bytes, the payload only changes the low ones
+        high.resize(carrier.size);
+        for (std::size_t i = 0; i < carrier.size; ++i) high[i] = *(carrier.at(i) - 1);
+        bytes = high.data();
+    }
+    CostMap::Histogram histogram;
+    std::vector<std::uint8_t> map = CostMap::build(bytes, geometry, histogram);
+    std::size_t header = std::min(layout.headerBits, map.size());
+    std::size_t needed = layout.samplesFor(total * 8) - layout.headerBits;
+    if (threshold < 0) {
+        for (std::size_t i = 0; i < header; ++i) --histogram[map[i]];
+        threshold = CostMap::threshold(histogram, needed);
+        if (threshold < 0) return {};
+    }
+    std::vector<std::uint32_t> selected = CostMap::select(map, header, threshold, needed);
+    if (selected.size() < needed) return {};
+    std::vector<std::uint32_t> positions(header + needed);
+    std::iota(positions.begin(), positions.begin() + header, 0u);
+    std::copy(selected.begin(), selected.end(), positions.begin() + header);
+    return positions;
+}
+
+// Pulls the payload out of a carrier in its order: header first (one bit per sample), then the stored bytes with
+// the layout the header describes. Old "MSG:" payloads are read in doubling steps until their terminator.
+// Adaptive payloads need the image geometry to rebuild the cost map.
+std::string readCarrier(Carrier carrier, const EmbedOptions& options, const CostMap::Geometry* geometry) {
+    const Layout sequential;
+    std::size_t capacity = carrier.size / 8;
+    std::vector<unsigned char> bytes(std::min(PayloadHeader::minSize, capacity), 0);
+    extractBits(carrier, sequential, 0, bytes.data(), 0, bytes.size() * 8);
+
+    if (startsWith(bytes.data(), bytes.size(), headerMagic)) {
+        std::size_t headerSize = std::min<std::size_t>(bytes[4], capacity);
+        if (headerSize > bytes.size()) {
+            std::size_t have = bytes.size();
+            bytes.resize(headerSize, 0);
+            extractBits(carrier, sequential, 0, bytes.data(), have * 8, (headerSize - have) * 8);
+        }
+        PayloadHeader header;
+        if (!readHeader(bytes.data(), bytes.size(), header)) return "";
+        Layout layout = layoutOf(header);
+        std::size_t total = header.size + static_cast<std::size_t>(header.dataLength);
+        if (layout.samplesFor(total * 8) > carrier.size) return ""; // does not fit, not a real header
+        std::vector<std::uint32_t> positions;
+        if (header.flags & Adaptive) {
+            if (!geometry) {
+                fmt::println("The message was embedded adaptively, it can only be read from an image file.");
+                return "";
+            }
+            int threshold = header.threshold;
+            positions = adaptivePositions(carrier, *geometry, layout, total, threshold);
+            if (positions.empty()) return "";
+            carrier.positions = positions.data();
+        }
+        bytes.resize(total, 0);
+        if (!(header.flags & Checksummed) || (header.flags & Fec)) {
+            // With error correction the checksum is over the corrected bytes, parsePayload computes it
+            extractBits(carrier, layout, 0, bytes.data(), header.size * std::size_t{8}, header.dataLength * std::size_t{8});
+            return parsePayload(bytes.data(), total, options);
+        }
+        // The stored bytes come out in blocks that are checksummed right away, while they are still in cache
+        constexpr std::size_t block = 256 * 1024;
+        std::uint32_t checksum = Checksum::crc32c(bytes.data(), PayloadHeader::minSize);
+        for (std::size_t at = header.size; at < total; at += block) {
+            std::size_t count = std::min(block, total - at);
+            extractBits(carrier, layout, 0, bytes.data(), at * 8, count * 8);
+            checksum = Checksum::crc32c(bytes.data() + at, count, checksum);
+        }
+        return parsePayload(bytes.data(), total, options, &checksum);
+    }
+
+    std::size_t have = bytes.size();
+    for (;;) {
+        std::size_t size = payloadSize(bytes.data(), have);
+        if (size > 0 && size <= have) return parsePayload(bytes.data(), size, options);
+        if (have == capacity) return parsePayload(bytes.data(), have, options);
+        std::size_t want = std::min(capacity, have * 2);
+        bytes.resize(want, 0);
+        extractBits(carrier, sequential, 0, bytes.data(), have * 8, (want - have) * 8);
+        have = want;
+    }
+}
+
+// Function to extract a payload, from the keyed order when there is a key and a keyed header.
+// A --permute embed leaves the samples it does not use as they were, so the header of an older sequential
+// payload can still sit at the top of the carrier; the keyed payload wins, the sequential one is read only when
+// the keyed one does not verify.
+std::string readPayload(Carrier carrier, const EmbedOptions& options, const CostMap::Geometry* geometry = nullptr) {
+    Trace::Span span("stego/readPayload");
+    if (options.encrypt && carrier.size >= 32) {
+        Permutation::Order order(carrier.size, options.key);
+        Carrier keyed = carrier;
+        keyed.order = &order;
+        if (hasKeyedPayload(keyed)) {
+            std::string message = readCarrier(keyed, options, geometry);
+            if (!message.empty() || !hasSequentialPayload(carrier)) return message;
+        }
+    }
+    return readCarrier(carrier, options, geometry);
+}
+
+} // namespace
+
+// Function to write payload bits into carrier samples
+void embedBits(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, const unsigned char* payload,
+               std::size_t firstBit, std::size_t bitCount) {
+    if (bitCount == 0) return;
+    Trace::Span span("stego/embedBits", bitCount / 8);
+    if (layout.matrixBits) {
+        // Header bits at one bit per sample, the data bits in Hamming blocks
+        std::size_t last = firstBit + bitCount;
+        if (firstBit < layout.headerBits) {
+            embedWith<1>(carrier, layout, sampleOffset, payload, firstBit, std::min(last, layout.headerBits));
+        }
+        std::size_t first = std::max(firstBit, layout.headerBits);
+        if (first >= last) return;
+        switch (layout.matrixBits) {
+            case 2: embedMatrix<2>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 3: embedMatrix<3>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 4: embedMatrix<4>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 5: embedMatrix<5>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 6: embedMatrix<6>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 7: embedMatrix<7>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 8: embedMatrix<8>(carrier, layout, sampleOffset, payload, first, last); break;
+        }
+        return;
+    }
+    switch (layout.bitsPerSample) {
+        case 1: embedWith<1>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+        case 2: embedWith<2>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+        case 3: embedWith<3>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+        case 4: embedWith<4>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+    }
+}
+
+// Function to read payload bits back from carrier samples
+void extractBits(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, unsigned char* payload,
+                 std::size_t firstBit, std::size_t bitCount) {
+    if (bitCount == 0) return;
+    Trace::Span span("stego/extractBits", bitCount / 8);
+    if (layout.matrixBits) {
+        std::size_t last = firstBit + bitCount;
+        if (firstBit < layout.headerBits) {
+            extractWith<1>(carrier, layout, sampleOffset, payload, firstBit, std::min(last, layout.headerBits));
+        }
+        std::size_t first = std::max(firstBit, layout.headerBits);
+        if (first >= last) return;
+        switch (layout.matrixBits) {
+            case 2: extractMatrix<2>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 3: extractMatrix<3>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 4: extractMatrix<4>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 5: extractMatrix<5>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 6: extractMatrix<6>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 7: extractMatrix<7>(carrier, layout, sampleOffset, payload, first, last); break;
+            case 8: extractMatrix<8>(carrier, layout, sampleOffset, payload, first, last); break;
+        }
+        return;
+    }
+    switch (layout.bitsPerSample) {
+        case 1: extractWith<1>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+        case 2: extractWith<2>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+        case 3: extractWith<3>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+        case 4: extractWith<4>(carrier, layout, sampleOffset, payload, firstBit, firstBit + bitCount); break;
+    }
+}
+
+// Function to tell if a payload starts at carrier sample 0 in sequential order
+bool hasSequentialPayload(const Carrier& carrier) {
+    if (carrier.size < 32) return true;
+    Carrier sequential = carrier;
+    sequential.order = nullptr;
+    unsigned char start[4] = {};
+    extractBits(sequential, Layout{}, 0, start, 0, 32);
+    return startsWith(start, 4, headerMagic) || startsWith(start, 4, marker);
+}
+
+// Function to tell if a payload header starts at carrier sample 0 in the carrier's keyed order
+bool hasKeyedPayload(const Carrier& carrier) {
+    if (!carrier.order || carrier.size < 32) return false;
+    unsigned char start[4] = {};
+    extractBits(carrier, Layout{}, 0, start, 0, 32);
+    return startsWith(start, 4, headerMagic);
+}
+
+// Function to get the layout from the first extracted bytes
+bool payloadLayout(const unsigned char* bytes, std::size_t available, Layout& layout) {
+    PayloadHeader header;
+    if (!readHeader(bytes, available, header)) return false;
+    layout = layoutOf(header);
+    return true;
+}
+
+// Function to tell the layout a payload built by buildPayload uses
+Layout payloadLayout(const std::vector<unsigned char>& payload) {
+    Layout layout;
+    payloadLayout(payload.data(), payload.size(), layout);
+    return layout;
+}
+
+// Function to build the bytes that get hidden: header + (optionally compressed) message
+std::vector<unsigned char> buildPayload(const std::string& message, const EmbedOptions& options) {
+    Trace::Span span("stego/buildPayload", message.size());
+    const auto* text = reinterpret_cast<const unsigned char*>(message.data());
+    PayloadHeader header;
+    header.messageLength = static_cast<std::uint32_t>(message.size());
+
+    std::vector<unsigned char> data;
+    if (options.compress) {
+        Trace::Span compress("stego/compress", message.size());
+        data = Lz::compress(text, message.size());
+        if (data.size() < message.size()) {
+            header.flags |= Compressed;
+        } else {
+            data.clear(); // incompressible, storing it raw is smaller
+        }
+    }
+    if (!(header.flags & Compressed)) data.assign(text, text + message.size());
+    header.dataLength = static_cast<std::uint32_t>(data.size());
+    if (options.permute) header.flags |= Permuted;
+    if (options.encrypt) {
+        header.flags |= Encrypted;
+        header.size += static_cast<std::uint8_t>(header.nonce.size() + header.tag.size());
+        header.nonce = Crypto::randomNonce();
+    }
+    if (options.bitsPerSample != 1) {
+        header.flags |= MultiBit;
+        header.size += 1;
+        header.bitsPerSample = static_cast<std::uint8_t>(options.bitsPerSample);
+    }
+    if (options.matrixBits) {
+        header.flags |= Matrix;
+        header.size += 1;
+        header.matrixBits = static_cast<std::uint8_t>(options.matrixBits);
+    }
+    if (options.adaptive) {
+        header.flags |= Adaptive;
+        header.size += 1; // the threshold is filled in once the carrier is known
+    }
+
+    if (!options.encrypt) {
+        // Encrypted payloads are already authenticated by their tag
+        header.flags |= Checksummed;
+        header.size += 4;
+    }
+    if (options.fecParity) {
+        header.flags |= Fec;
+        header.size += 5;
+        header.fecParity = static_cast<std::uint8_t>(options.fecParity);
+        header.plainLength = header.dataLength;
+        header.dataLength = static_cast<std::uint32_t>(ReedSolomon::shape(data.size(), options.fecParity).encodedSize());
+    }
+
+    std::vector<unsigned char> payload(header.size + header.dataLength);
+    writeHeader(payload.data(), header);
+    if (header.flags & Checksummed) {
+        // Copied and checksummed block by block, so the data is only walked once
+        Trace::Span checksum("stego/checksum", data.size());
+        constexpr std::size_t block = 64 * 1024;
+        header.checksum = Checksum::crc32c(payload.data(), PayloadHeader::minSize);
+        for (std::size_t at = 0; at < data.size(); at += block) {
+            std::size_t count = std::min(block, data.size() - at);
+            unsigned char* out = payload.data() + header.size + at;
+            std::copy(data.data() + at, data.data() + at + count, out);
+            header.checksum = Checksum::crc32c(out, count, header.checksum);
+        }
+        writeHeader(payload.data(), header);
+    } else {
+        std::copy(data.begin(), data.end(), payload.begin() + header.size);
+    }
+    if (options.encrypt) {
+        // Encrypted after compression (ciphertext does not compress), the fixed header fields are authenticated too
+        Trace::Span seal("stego/seal", data.size());
+        header.tag = Crypto::seal(options.key, header.nonce, payload.data(), PayloadHeader::minSize,
+                                  payload.data() + header.size, data.size());
+        writeHeader(payload.data(), header);
+    }
+    if (header.flags & Fec) {
+        // Error correction goes last, it protects exactly the bytes that end up in the carrier
+        Trace::Span fec("stego/fecEncode", data.size());
+        std::vector<unsigned char> encoded = ReedSolomon::encode(payload.data() + header.size, data.size(), header.fecParity);
+        std::copy(encoded.begin(), encoded.end(), payload.begin() + header.size);
+    }
+    return payload;
+}
+
+// Function to tell how long a payload is from its first bytes, 0 while that is not known yet
+std::size_t payloadSize(const unsigned char* bytes, std::size_t available) {
+    // Could still become a header, wait for more bytes
+    std::size_t prefix = std::min(available, headerMagic.size());
+    if (startsWith(bytes, prefix, headerMagic.substr(0, prefix))) {
+        if (available < PayloadHeader::minSize) return 0;
+        if (bytes[4] < PayloadHeader::minSize) return available; // not a header after all
+        PayloadHeader header;
+        if (!readHeader(bytes, available, header)) return 0; // header fields this version doesn't know yet
+        return header.size + static_cast<std::size_t>(header.dataLength);
+    }
+    for (std::size_t i = 0; i < available; ++i) {
+        if (bytes[i] == '\0') return i + 1; // Old format, stop at the first null character
+    }
+    return 0;
+}
+
+// Function to turn extracted payload bytes back into the message, empty if there is none
+std::string parsePayload(const unsigned char* bytes, std::size_t size, const EmbedOptions& options,
+                         const std::uint32_t* checksum) {
+    Trace::Span span("stego/parsePayload", size);
+    PayloadHeader header;
+    if (readHeader(bytes, size, header)) {
+        if (size - header.size < header.dataLength) return ""; // carrier ended inside the payload
+        const unsigned char* data = bytes + header.size;
+        std::size_t stored = header.dataLength;
+        std::vector<unsigned char> repaired;
+        if (header.flags & Fec) {
+            std::size_t corrected = 0;
+            Trace::Span fec("stego/fecDecode", stored);
+            if (!ReedSolomon::decode(data, stored, header.plainLength, header.fecParity, repaired, &corrected)) {
+                fmt::println("The message is damaged beyond what the error correction can repair.");
+                return "";
+            }
+            if (corrected > 0) fmt::println("Error correction repaired {} damaged bytes.", corrected);
+            data = repaired.data();
+            stored = repaired.size();
+            checksum = nullptr; // the caller's checksum covers the bytes before correction
+        }
+        if (header.flags & Checksummed) {
+            std::uint32_t actual = checksum ? *checksum
+                                            : Checksum::crc32c(data, stored, Checksum::crc32c(bytes, PayloadHeader::minSize));
+            if (actual != header.checksum) {
+                fmt::println("The message is damaged (checksum mismatch).");
+                return "";
+            }
+        }
+        std::vector<unsigned char> decrypted;
+        if (header.flags & Encrypted) {
+            if (!options.encrypt) {
+                fmt::println("The message is encrypted, pass --key-file or --key-env to read it.");
+                return "";
+            }
+            Trace::Span decrypt("stego/open", stored);
+            decrypted.assign(data, data + stored);
+            if (!Crypto::open(options.key, header.nonce, bytes, PayloadHeader::minSize,
+                              decrypted.data(), decrypted.size(), header.tag)) {
+                fmt::println("Wrong key or damaged message.");
+                return "";
+            }
+            data = decrypted.data();
+        }
+        if (header.flags & Compressed) {
+            Trace::Span decompress("stego/decompress", header.messageLength);
+            std::vector<unsigned char> message;
+            if (!Lz::decompress(data, stored, message, header.messageLength) ||
+                message.size() != header.messageLength) {
+                return "";
+            }
+            return std::string(message.begin(), message.end());
+        }
+        if (stored != header.messageLength) return "";
+        return std::string(reinterpret_cast<const char*>(data), stored);
+    }
+
+    std::size_t length = std::find(bytes, bytes + size, '\0') - bytes;
+    std::string extracted(reinterpret_cast<const char*>(bytes), length);
+
+    // Finding marker in extracted returning message i
+    if (extracted.find(marker) == 0) {  // Marker should be at the start of extracted, find returns index of first char of marker
+        return extracted.substr(marker.size()); // If that's correct, return sub string of marker size
+    }
+    return ""; // No valid message found
+}
 
 // Function to encrypt a message into an image file
-bool encryptMessage(const std::string& filename, const std::string& message) {
-    int width, height, channels, maxVal;
+bool encryptMessage(const std::string& filename, const std::string& message, const EmbedOptions& options) {
+    Trace::Span span("stego/encryptMessage");
+    ImageHandler::ImageInfo info;
     std::vector<char> data;
-    if (!ImageHandler::readImage(filename, data, width, height, channels, maxVal)) {
+    if (!ImageHandler::readImage(filename, data, info)) {
         fmt::println("Error reading image for encrypting.");
         return false;
     }
 
-    // Convert marker and message to a binary string,
-    std::string binaryString;
-    // for each character in marker + message, append binaryString with c that is moved i bits to right
-    // masking with one to gett a bool value and at last ternary operator (thanks professor Werner) to append if true -> 1, else -> 0
-    for (char c : marker + message) {
-        for (int i = 7; i >= 0; --i) {
-            binaryString.push_back(((c >> i) & 1) ? '1' : '0');
-        }
-    }
-    binaryString.append(8, '0'); // Append null character to denote end of message
+    std::vector<unsigned char> payload = buildPayload(message, options);
 
     // Check if the message can be encrypted, dosen't get more simple then that
-    if (binaryString.length() > data.size()) {
+    Carrier carrier = Carrier::image(data, info);
+    Layout layout = payloadLayout(payload);
+    if (layout.samplesFor(payload.size() * 8) > carrier.size) {
         fmt::println("Insufficient space in image to encrypt message.");
         return false;
     }
 
-    // Put the binary string into the image data
-    // for loop going through data, data at i = data at i masked with 0xFE = 254
-    // aka data without least significan bit that is then masked with i-th character binaryString
-    // if i-th char is 1 -> mask data with 1, else -> mask with 0
-    for (int i = 0; i < binaryString.length(); ++i) {
-        data[i] = (data[i] & 0xFE) | (binaryString[i] == '1' ? 1 : 0); // Modify only the least significan bit
+    // Put the payload into the image data, in the least significant bit(s) of each sample
+    std::optional<Permutation::Order> order;
+    if (options.permute) carrier.order = &order.emplace(carrier.size, options.key);
+    std::vector<std::uint32_t> positions;
+    if (options.adaptive) {
+        int threshold = -1;
+        positions = adaptivePositions(carrier, geometryOf(info, carrier.size), layout, payload.size(), threshold);
+        if (positions.empty()) {
+            fmt::println("Insufficient space in image to encrypt message.");
+            return false;
+        }
+        PayloadHeader header;
+        readHeader(payload.data(), payload.size(), header);
+        header.threshold = static_cast<std::uint8_t>(threshold);
+        writeHeader(payload.data(), header);
+        carrier.positions = positions.data();
     }
+    embedBits(carrier, layout, 0, payload.data(), 0, payload.size() * 8);
 
-    // Write the modified image data back to the file
-    if (!ImageHandler::writeImage(filename, data, width, height, channels, maxVal)) {
+    // Write the modified image data back to the file, info carries the original header
+    if (!ImageHandler::writeImage(filename, data, info)) {
         fmt::println("Error writing encrypted image.");
         return false;
     }
@@ -52,56 +791,97 @@ bool encryptMessage(const std::string& filename, const std::string& message) {
 }
 
 // Function to extract a message from an image file
-std::string extractMessage(const std::string& filename) {
-    int width, height, channels, maxVal;
+std::string extractMessage(const std::string& filename, const EmbedOptions& options) {
+    Trace::Span span("stego/extractMessage");
+    ImageHandler::ImageInfo info;
     std::vector<char> data;
-    if (!ImageHandler::readImage(filename, data, width, height, channels, maxVal)) {
+    if (!ImageHandler::readImage(filename, data, info)) {
         fmt::println("Failed to read image for message extraction.");
         return "";
     }
 
-    // Extract the binary string from the image data, mask byte with on to get bool value
-    std::string binaryString;
-    for (char byte : data) {
-        binaryString.push_back((byte & 1) ? '1' : '0');
-    }
+    // Gather the least significant bits back into bytes, 8 carrier samples give one byte
+    Carrier carrier = Carrier::image(data, info);
+    CostMap::Geometry geometry = geometryOf(info, carrier.size);
+    return readPayload(carrier, options, &geometry);
+}
 
-    // Convert the binary string back to text
-    // for loop iterating by 8 (number of bits in byte), bitset used to store 8 bits starting at i
-    // then when it finishes converting bits into char that holds 1 byte, it adds character to 'extracted' string
-    std::string extracted;
-    for (int i = 0; i < binaryString.length(); i += 8) {
-        std::bitset<8> bits(binaryString.substr(i, 8));
-        char c = 0;
-        for (int j = 0; j < 8; ++j) {
-            if (bits[j]) {
-                c += (1 << j);
-            }
-        }
-        if (c == '\0') break;  // Stop at the first null character
-        extracted.push_back(c);
+// Function to hide a message directly in pixel memory
+bool embedInView(const ImageHandler::PixelView& view, const std::string& message, const EmbedOptions& options) {
+    if (options.adaptive) {
+        fmt::println("Adaptive embedding works on image files only.");
+        return false;
     }
+    return embedPayloadInView(view, buildPayload(message, options), options);
+}
 
-    // Finding marker in extracted returning message i
-    if (extracted.find(marker) == 0) {  // Marker should be at the start of extracted, find returns index of first char of marker
-        return extracted.substr(marker.size()); // If that's correct, return sub string of marker size
+// Function to hide an already built payload directly in pixel memory
+bool embedPayloadInView(const ImageHandler::PixelView& view, const std::vector<unsigned char>& payload,
+                        const EmbedOptions& options) {
+    Trace::Span span("stego/embedInView");
+    Carrier carrier = Carrier::view(view);
+    Layout layout = payloadLayout(payload);
+    if (layout.samplesFor(payload.size() * 8) > carrier.size) {
+        fmt::println("Insufficient space in frame to encrypt message.");
+        return false;
     }
 
-    return ""; // No valid message found
+    // The payload continues from one row to the next, the bytes between rowBytes and rowStride are skipped
+    std::optional<Permutation::Order> order;
+    if (options.permute) carrier.order = &order.emplace(carrier.size, options.key);
+    embedBits(carrier, layout, 0, payload.data(), 0, payload.size() * 8);
+    return true;
+}
+
+// Function to extract a message directly from pixel memory
+std::string extractFromView(const ImageHandler::PixelView& view, const EmbedOptions& options) {
+    return readPayload(Carrier::view(view), options);
+}
+
+// Function to extract a message from a plain buffer
+std::string extractFromBuffer(char* data, std::size_t size, const EmbedOptions& options, std::size_t sampleBytes) {
+    return readPayload(Carrier::buffer(data, size, sampleBytes), options);
 }
 
 // Function to check if a message can be encrypted in an image file
-bool canEncryptMessage(const std::string& filename, const std::string& message) {
-    int width, height, channels, maxVal;
+bool canEncryptMessage(const std::string& filename, const std::string& message, const EmbedOptions& options) {
+    Trace::Span span("stego/canEncryptMessage");
+    ImageHandler::ImageInfo info;
     std::vector<char> data;
-    if (!ImageHandler::readImage(filename, data, width, height, channels, maxVal)) {
+    if (!ImageHandler::readImage(filename, data, info)) {
         fmt::println("Error reading image for capacity check.");
         return false;
     }
 
-    // Calculate the number of bits needed to encrypt the message
-    int neededBits = (marker.size() + message.size()) * 8 + 8; // 8 extra bits for the null terminator https://en.wikipedia.org/wiki/Null-terminated_string
-    return neededBits <= data.size() * 8;
+    // The header takes one bit per carrier sample, the rest bitsPerSample bits or matrix blocks
+    Carrier carrier = Carrier::image(data, info);
+    EmbedOptions raw = options, compressed = options;
+    raw.compress = false;
+    compressed.compress = true;
+    std::vector<unsigned char> rawPayload = buildPayload(message, raw);
+    std::vector<unsigned char> compressedPayload = buildPayload(message, compressed);
+    Layout layout = payloadLayout(rawPayload);
+    std::size_t rawSamples = layout.samplesFor(rawPayload.size() * 8);
+    std::size_t compressedSamples = payloadLayout(compressedPayload).samplesFor(compressedPayload.size() * 8);
+    if (options.matrixBits) {
+        fmt::println("Capacity: {} bytes after the header with {} bits per {} samples (matrix embedding).",
+                     layout.capacity(carrier.size), options.matrixBits, layout.blockSamples());
+    } else {
+        fmt::println("Capacity: {} bytes after the header at {} bit(s) per sample.",
+                     layout.capacity(carrier.size), options.bitsPerSample);
+    }
+    fmt::println("Payload: {} bytes raw ({} samples), {} bytes compressed ({} samples), image has {} samples.",
+                 rawPayload.size(), rawSamples, compressedPayload.size(), compressedSamples, carrier.size);
+    if (options.adaptive) {
+        const std::vector<unsigned char>& payload = options.compress ? compressedPayload : rawPayload;
+        int threshold = -1;
+        if (adaptivePositions(carrier, geometryOf(info, carrier.size), payloadLayout(payload), payload.size(), threshold).empty()) {
+            return false;
+        }
+        fmt::println("Adaptive: the payload goes to samples with a gradient of at least {} (of 255).", threshold);
+    }
+
+    return (options.compress ? compressedSamples : rawSamples) <= carrier.size;
 }
 
 } // namespace Steganography
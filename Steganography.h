@@ -1,17 +1,184 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
+#include "Crypto.h"
+#include "ImageFormats.h"
+#include "Permutation.h"
 
 namespace Steganography {
 
+    // Options that change how a message is stored, the extractor reads them back from the payload header
+    struct EmbedOptions {
+        bool compress = false; // LZ compress the message first (kept only if it gets smaller)
+        bool encrypt = false;  // ChaCha20-Poly1305 with `key`, also needed to extract such a message
+        bool permute = false;  // scatter the payload over the carrier in a keyed order (needs the key)
+        int bitsPerSample = 1; // 1..4 low bits of every carrier sample hold payload bits
+        int matrixBits = 0;    // p > 0: Hamming matrix embedding, p bits per 2^p - 1 samples with at most one change
+        bool adaptive = false; // put the stored bytes into the most textured carrier bytes (image files only)
+        int fecParity = 0;     // Reed-Solomon parity bytes per 255-byte codeword, 0 = no error correction
+        Crypto::Key key{};
+    };
+
+    // Payload header flags
+    enum PayloadFlags : std::uint8_t {
+        Compressed = 1 << 0,
+        Encrypted = 1 << 1,
+        Permuted = 1 << 2,
+        MultiBit = 1 << 3,
+        Matrix = 1 << 4,
+        Adaptive = 1 << 5,
+        Checksummed = 1 << 6,
+        Fec = 1 << 7, // last free bit, later fields have to be signalled some other way
+    };
+
+    // Header in front of the stored bytes: "STG2", header size, flags, message length, stored length.
+    // The header size byte lets later fields be appended without breaking older payloads.
+    // Optional fields follow in flag order: nonce + tag when Encrypted, bits per sample when MultiBit,
+    // matrix bits when Matrix, cost map threshold when Adaptive, CRC-32C (little endian) when Checksummed,
+    // parity bytes per codeword + data length before encoding (u32) when Fec.
+    // Payloads written before the header existed ("MSG:" + message + '\0') are still extracted.
+    struct PayloadHeader {
+        static constexpr std::size_t minSize = 14;
+        std::uint8_t size = minSize;
+        std::uint8_t flags = 0;
+        std::uint32_t messageLength = 0; // bytes of the original message
+        std::uint32_t dataLength = 0;    // bytes stored after the header
+        Crypto::Nonce nonce{};
+        Crypto::Tag tag{};             // covers the first minSize header bytes and the stored bytes
+        std::uint8_t bitsPerSample = 1;
+        std::uint8_t matrixBits = 0;
+        std::uint8_t threshold = 0;
+        std::uint32_t checksum = 0;    // CRC-32C of the first minSize header bytes and the data before error correction
+        std::uint8_t fecParity = 0;
+        std::uint32_t plainLength = 0; // bytes before error correction, dataLength without Fec
+    };
+
+    // Carrier samples that hold payload bits: `rowSamples` usable samples every `rowStride` bytes
+    // (a plain buffer is a single row). 16-bit samples are two bytes, big endian in every format here, and only
+    // their low byte is ever changed. With an order, bit i goes to sample order(i) instead of sample i,
+    // with positions (adaptive selection) to sample positions[i].
+    struct Carrier {
+        char* data = nullptr;
+        std::size_t size = 0;       // usable samples
+        std::size_t rowSamples = 0;
+        std::size_t rowStride = 0;  // bytes
+        const Permutation::Order* order = nullptr;
+        const std::uint32_t* positions = nullptr;
+        std::size_t sampleBytes = 1;
+
+        // The byte holding the low bits of a sample
+        char* at(std::size_t sample) const {
+            if (sampleBytes == 1 && rowSamples == rowStride) return data + sample;
+            return data + sample / rowSamples * rowStride + (sample % rowSamples + 1) * sampleBytes - 1;
+        }
+
+        static Carrier buffer(char* data, std::size_t size, std::size_t sampleBytes = 1) {
+            return {data, size / sampleBytes, size / sampleBytes, size, nullptr, nullptr, sampleBytes};
+        }
+        static Carrier view(const ImageHandler::PixelView& view) {
+            std::size_t rowSamples = static_cast<std::size_t>(view.width) * view.channels;
+            return {view.data, rowSamples * view.height, rowSamples, view.rowStride, nullptr, nullptr,
+                    static_cast<std::size_t>(view.bytesPerSample)};
+        }
+        // Pixel data of a whole image as readImage returns it
+        static Carrier image(std::vector<char>& data, const ImageHandler::ImageInfo& info) {
+            return buffer(data.data(), data.size(), info.maxVal > 255 ? 2 : 1);
+        }
+    };
+
+    // Which payload bits sit in which carrier sample. The header always takes one bit per sample so it can be
+    // read before anything else is known, the stored bytes after it take bitsPerSample bits per sample, or
+    // matrixBits bits per block of 2^matrixBits - 1 samples with matrix embedding.
+    struct Layout {
+        std::size_t headerBits = SIZE_MAX; // the default reads everything at one bit per sample
+        int bitsPerSample = 1;
+        int matrixBits = 0;
+
+        std::size_t blockSamples() const { return (std::size_t{1} << matrixBits) - 1; }
+
+        std::size_t sampleOf(std::size_t bit) const {
+            if (bit < headerBits) return bit;
+            if (matrixBits) return headerBits + (bit - headerBits) / matrixBits * blockSamples();
+            return headerBits + (bit - headerBits) / bitsPerSample;
+        }
+        // With matrix embedding this is the first bit of the block containing the sample
+        std::size_t firstBitOf(std::size_t sample) const {
+            if (sample <= headerBits) return sample;
+            if (matrixBits) return headerBits + (sample - headerBits) / blockSamples() * matrixBits;
+            return headerBits + (sample - headerBits) * bitsPerSample;
+        }
+        std::size_t samplesFor(std::size_t bits) const {
+            if (bits <= headerBits) return bits;
+            if (matrixBits) return headerBits + (bits - headerBits + matrixBits - 1) / matrixBits * blockSamples();
+            return headerBits + (bits - headerBits + bitsPerSample - 1) / bitsPerSample;
+        }
+        // Payload bytes that fit after the header in `samples` carrier samples
+        std::size_t capacity(std::size_t samples) const {
+            if (samples <= headerBits) return 0;
+            if (matrixBits) return (samples - headerBits) / blockSamples() * matrixBits / 8;
+            return (samples - headerBits) * bitsPerSample / 8;
+        }
+    };
+
+    // Function to tell the layout of a payload made by buildPayload
+    Layout payloadLayout(const std::vector<unsigned char>& payload);
+
+    // Function to get the layout from the first extracted bytes, false until a complete header is there
+    bool payloadLayout(const unsigned char* bytes, std::size_t available, Layout& layout);
+
+    // Function to write payload bits [firstBit, firstBit + bitCount) into the samples the layout gives them.
+    // Carrier sample 0 is global sample `sampleOffset` (frames of a stream continue each other).
+    // Sequential carriers go through the 64-bit kernels specialised per bitsPerSample, keyed ones chunk by chunk on several threads.
+    void embedBits(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, const unsigned char* payload,
+                   std::size_t firstBit, std::size_t bitCount);
+
+    // Function to read them back, payload bytes must be zero where they are filled
+    void extractBits(const Carrier& carrier, const Layout& layout, std::size_t sampleOffset, unsigned char* payload,
+                     std::size_t firstBit, std::size_t bitCount);
+
+    // Function to tell if a payload starts at carrier sample 0 in sequential order (otherwise it may be keyed).
+    // Adaptive payloads count as sequential, only the bytes after their header are selected.
+    bool hasSequentialPayload(const Carrier& carrier);
+
+    // Function to tell if a payload header starts at the first sample of the carrier's keyed order (carrier.order).
+    // Looked at before the sequential order: a --permute payload can leave an older sequential header in place.
+    bool hasKeyedPayload(const Carrier& carrier);
+
     // Function to encrypt a message into an image file
-    bool encryptMessage(const std::string& filename, const std::string& message);
+    bool encryptMessage(const std::string& filename, const std::string& message, const EmbedOptions& options = {});
 
     // Function to extract a message from an image file
-    std::string extractMessage(const std::string& filename);
+    std::string extractMessage(const std::string& filename, const EmbedOptions& options = {});
 
-    // Function to check if a message can be encrypted into an image file
-    bool canEncryptMessage(const std::string& filename, const std::string& message);
+    // Function to check if a message can be encrypted into an image file, prints the raw and compressed sizes
+    bool canEncryptMessage(const std::string& filename, const std::string& message, const EmbedOptions& options = {});
 
-} // namespace Steganography
+    // Function to hide a message directly in pixel memory (no file I/O), rows are walked with rowStride so padding stays untouched
+    bool embedInView(const ImageHandler::PixelView& view, const std::string& message, const EmbedOptions& options = {});
+
+    // Function to hide a payload from buildPayload in pixel memory, for many frames that carry the same message.
+    // Only options.permute and options.key are used here, the rest is already in the payload.
+    bool embedPayloadInView(const ImageHandler::PixelView& view, const std::vector<unsigned char>& payload,
+                            const EmbedOptions& options = {});
 
+    // Function to extract a message directly from pixel memory
+    std::string extractFromView(const ImageHandler::PixelView& view, const EmbedOptions& options = {});
 
+    // Function to extract a message from a plain buffer of carrier samples (a slot, a single row)
+    std::string extractFromBuffer(char* data, std::size_t size, const EmbedOptions& options = {},
+                                  std::size_t sampleBytes = 1);
+
+    // Function to build the bytes that get hidden in a carrier (header + stored message)
+    std::vector<unsigned char> buildPayload(const std::string& message, const EmbedOptions& options = {});
+
+    // Function to tell the total payload length from its first bytes, returns 0 while that is not known yet
+    std::size_t payloadSize(const unsigned char* bytes, std::size_t available);
+
+    // Function to turn extracted payload bytes back into the message, empty if there is no valid message.
+    // A checksummed payload is verified against `checksum` when the caller computed it while extracting.
+    std::string parsePayload(const unsigned char* bytes, std::size_t size, const EmbedOptions& options = {},
+                             const std::uint32_t* checksum = nullptr);
+
+} // namespace Steganography
@@ -0,0 +1,158 @@
+#include "Trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+
+namespace Trace {
+
+namespace detail {
+
+std::atomic<bool> active{false};
+
+std::uint64_t now() {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // namespace detail
+
+namespace {
+
+constexpr std::size_t capacity = std::size_t{1} << 15; // spans per thread, 1 MiB
+
+struct Event {
+    const char* name;
+    std::uint64_t start, end, bytes;
+};
+
+// One thread writes a ring, the file is written from it after the work is done. head counts every span recorded,
+// the last `capacity` of them are still there.
+struct Ring {
+    std::unique_ptr<Event[]> events = std::make_unique_for_overwrite<Event[]>(capacity);
+    std::atomic<std::uint64_t> head{0};
+    bool main = false;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<Ring*> idle; // rings of threads that exited, taken over by the next new thread
+    std::string filename;
+    std::uint64_t origin = 0;
+    std::thread::id mainThread;
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+// The calling thread's ring, claimed on its first span and handed back when the thread exits. Worker threads come
+// and go for every image, reusing their rings keeps the memory to one ring per thread running at the same time.
+struct Local {
+    Ring* ring = nullptr;
+    ~Local() {
+        if (!ring) return;
+        std::lock_guard lock(registry().mutex);
+        registry().idle.push_back(ring);
+    }
+};
+
+thread_local Local local;
+
+Ring* claim() {
+    Registry& r = registry();
+    std::lock_guard lock(r.mutex);
+    bool main = std::this_thread::get_id() == r.mainThread;
+    if (!main && !r.idle.empty()) {
+        Ring* ring = r.idle.back();
+        r.idle.pop_back();
+        return ring;
+    }
+    r.rings.push_back(std::make_unique<Ring>());
+    r.rings.back()->main = main;
+    return r.rings.back().get();
+}
+
+bool writeFile(const std::string& filename) {
+    Registry& r = registry();
+    std::lock_guard lock(r.mutex);
+    std::ofstream file(filename);
+    if (!file) {
+        fmt::print(stderr, "Failed to open {} for writing.\n", filename);
+        return false;
+    }
+    // Complete ("X") events with microsecond times from the start of tracing, one tid per ring
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << R"({"name":"process_name","ph":"M","pid":1,"tid":0,"args":{"name":"Steganography_project"}})";
+    std::uint64_t dropped = 0;
+    for (std::size_t t = 0; t < r.rings.size(); ++t) {
+        const Ring& ring = *r.rings[t];
+        std::uint64_t head = ring.head.load(std::memory_order_acquire);
+        std::uint64_t first = head > capacity ? head - capacity : 0;
+        dropped += first;
+        file << fmt::format(",\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                            t + 1, ring.main ? std::string("main") : fmt::format("worker {}", t));
+        for (std::uint64_t i = first; i < head; ++i) {
+            const Event& event = ring.events[i % capacity];
+            std::string_view name = event.name;
+            file << fmt::format(",\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}",
+                                name, name.substr(0, name.find('/')), t + 1, (event.start - r.origin) / 1e3,
+                                (event.end - event.start) / 1e3);
+            if (event.bytes) file << fmt::format(",\"args\":{{\"bytes\":{}}}", event.bytes);
+            file << '}';
+        }
+    }
+    file << "\n]}\n";
+    if (dropped) fmt::print(stderr, "Trace ring buffers were full, the oldest {} spans were dropped.\n", dropped);
+    return static_cast<bool>(file);
+}
+
+} // namespace
+
+namespace detail {
+
+void record(const char* name, std::uint64_t start, std::uint64_t end, std::uint64_t bytes) {
+    Ring*& ring = local.ring;
+    if (!ring) ring = claim();
+    std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    ring->events[head % capacity] = Event{name, start, end, bytes};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+// Function to start recording into the given file
+bool start(const std::string& filename) {
+    if (filename.empty() || !std::ofstream(filename)) {
+        fmt::print(stderr, "Failed to open {} for writing.\n", filename.empty() ? "the trace file" : filename);
+        return false;
+    }
+    Registry& r = registry();
+    {
+        std::lock_guard lock(r.mutex);
+        r.filename = filename;
+        r.origin = detail::now();
+        r.mainThread = std::this_thread::get_id();
+    }
+    // Registered after the registry exists, so it runs while the registry is still alive
+    static bool registered = std::atexit([] { stop(); }) == 0;
+    (void)registered;
+    detail::active.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+// Function to stop recording and write the file
+bool stop() {
+    if (!detail::active.exchange(false)) return true;
+    return writeFile(registry().filename);
+}
+
+} // namespace Trace
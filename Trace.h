@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Spans over the phases of a run (header parsing, pixel reads, payload building, the LSB loops, writing), saved as a
+// Chrome trace event file for chrome://tracing or ui.perfetto.dev. Switched on with --trace=out.json.
+// Every thread records into its own ring buffer, so recording takes no lock; a full ring drops its oldest spans.
+// While tracing is off a span is one relaxed load and a branch.
+namespace Trace {
+
+    namespace detail {
+        extern std::atomic<bool> active;
+        std::uint64_t now();
+        void record(const char* name, std::uint64_t start, std::uint64_t end, std::uint64_t bytes);
+    } // namespace detail
+
+    // Function to start recording, the file is written by stop() or at exit
+    bool start(const std::string& filename);
+
+    // Function to stop recording and write the file, once the traced work is done
+    bool stop();
+
+    inline bool enabled() { return detail::active.load(std::memory_order_relaxed); }
+
+    // A span from construction to the end of the scope. The name is a string literal, "module/phase" (the module
+    // becomes the category); only the pointer is kept. `bytes` shows up as an argument of the span when set.
+    class Span {
+    public:
+        explicit Span(const char* label, std::uint64_t size = 0)
+            : name(enabled() ? label : nullptr), bytes(size), start(name ? detail::now() : 0) {}
+        ~Span() {
+            if (name) detail::record(name, start, detail::now(), bytes);
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        void setBytes(std::uint64_t size) { bytes = size; }
+
+    private:
+        const char* name;
+        std::uint64_t bytes;
+        std::uint64_t start;
+    };
+
+} // namespace Trace
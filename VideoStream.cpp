@@ -0,0 +1,299 @@
+#include "VideoStream.h"
+#include "Steganography.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+
+namespace VideoStream {
+
+namespace {
+
+// Stream parameters from the "YUV4MPEG2 ..." line
+struct StreamInfo {
+    int width = 0;
+    int height = 0;
+    std::size_t lumaSize = 0;   // bytes of the Y plane, this is the carrier part of a frame
+    std::size_t frameSize = 0;  // Y + U + V (+ alpha) bytes
+};
+
+// Reads one header line (without the '\n'), Y4M header lines are short so anything long is an error
+bool readLine(std::FILE* in, std::string& line) {
+    line.clear();
+    int ch;
+    while ((ch = std::fgetc(in)) != EOF && ch != '\n') {
+        line.push_back(static_cast<char>(ch));
+        if (line.size() > 4096) return false;
+    }
+    return ch == '\n';
+}
+
+bool parseStreamHeader(const std::string& line, StreamInfo& info) {
+    std::istringstream tokens(line);
+    std::string token;
+    tokens >> token;
+    if (token != "YUV4MPEG2") {
+        fmt::print(stderr, "Input is not a YUV4MPEG2 stream.\n");
+        return false;
+    }
+
+    std::string colorspace = "420jpeg"; // default when there is no C parameter
+    while (tokens >> token) {
+        if (token[0] == 'W') info.width = std::atoi(token.c_str() + 1);
+        else if (token[0] == 'H') info.height = std::atoi(token.c_str() + 1);
+        else if (token[0] == 'C') colorspace = token.substr(1);
+    }
+    if (info.width <= 0 || info.height <= 0) {
+        fmt::print(stderr, "Invalid Y4M frame size.\n");
+        return false;
+    }
+
+    std::size_t w = info.width, h = info.height;
+    std::size_t halfW = (w + 1) / 2, halfH = (h + 1) / 2;
+    info.lumaSize = w * h;
+    std::size_t chroma;
+    if (colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" || colorspace == "420") {
+        chroma = 2 * halfW * halfH;
+    } else if (colorspace == "422") {
+        chroma = 2 * halfW * h;
+    } else if (colorspace == "444") {
+        chroma = 2 * w * h;
+    } else if (colorspace == "444alpha") {
+        chroma = 3 * w * h;
+    } else if (colorspace == "411") {
+        chroma = 2 * ((w + 3) / 4) * h;
+    } else if (colorspace == "mono") {
+        chroma = 0;
+    } else {
+        fmt::print(stderr, "Unsupported Y4M colorspace '{}' (only 8-bit formats are supported).\n", colorspace);
+        return false;
+    }
+    info.frameSize = info.lumaSize + chroma;
+    return true;
+}
+
+// Reads the "FRAME..." line and the frame data, false at the end of the stream
+bool readFrame(std::FILE* in, const StreamInfo& info, std::string& header, std::vector<char>& data, bool& error) {
+    error = false;
+    if (!readLine(in, header)) {
+        error = !header.empty();
+        return false;
+    }
+    if (header.compare(0, 5, "FRAME") != 0) {
+        fmt::print(stderr, "Invalid Y4M frame header.\n");
+        error = true;
+        return false;
+    }
+    data.resize(info.frameSize);
+    if (std::fread(data.data(), 1, data.size(), in) != data.size()) {
+        fmt::print(stderr, "Y4M frame is truncated.\n");
+        error = true;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// Function to hide a message in a Y4M stream
+bool encryptStream(std::FILE* in, std::FILE* out, const std::string& message,
+                   const Steganography::EmbedOptions& options, unsigned threads) {
+    // Frames are embedded independently, a Hamming block must not straddle two of them
+    if (options.matrixBits) {
+        fmt::print(stderr, "Matrix embedding is not supported for Y4M streams.\n");
+        return false;
+    }
+    if (options.adaptive) {
+        fmt::print(stderr, "Adaptive embedding is not supported for Y4M streams.\n");
+        return false;
+    }
+    std::string streamHeader;
+    StreamInfo info;
+    if (!readLine(in, streamHeader) || !parseStreamHeader(streamHeader, info)) {
+        return false;
+    }
+    streamHeader.push_back('\n');
+    std::fwrite(streamHeader.data(), 1, streamHeader.size(), out);
+
+    const std::vector<unsigned char> payload = Steganography::buildPayload(message, options);
+    const std::size_t payloadBits = payload.size() * 8;
+    const Steganography::Layout layout = Steganography::payloadLayout(payload);
+    // With --permute every luma plane gets the same keyed order, built once
+    std::optional<Permutation::Order> order;
+    if (options.permute) order.emplace(info.lumaSize, options.key);
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    // Frame i always uses slot i % slotCount, so a slot is only reused after its previous frame was written.
+    // That bounds memory to slotCount frames and keeps the output in input order.
+    const std::size_t slotCount = threads + 2;
+    enum class State { Free, Queued, Done };
+    struct Slot {
+        std::string header;
+        std::vector<char> data;
+        std::size_t index = 0;
+        State state = State::Free;
+    };
+    std::vector<Slot> slots(slotCount);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::queue<std::size_t> work;
+    std::size_t framesRead = 0;
+    bool readerDone = false;
+    bool failed = false;
+
+    // Workers: embed the part of the payload that falls into this frame's luma plane
+    auto worker = [&] {
+        for (;;) {
+            std::size_t slotIndex;
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return !work.empty() || readerDone || failed; });
+                if (work.empty()) return;
+                slotIndex = work.front();
+                work.pop();
+            }
+            Slot& slot = slots[slotIndex];
+            // Frame i holds global samples [i * L, (i + 1) * L), the layout says which bits those are
+            std::size_t firstSample = slot.index * info.lumaSize;
+            std::size_t firstBit = std::min(layout.firstBitOf(firstSample), payloadBits);
+            std::size_t lastBit = std::min(layout.firstBitOf(firstSample + info.lumaSize), payloadBits);
+            if (firstBit < lastBit) {
+                Steganography::Carrier carrier = Steganography::Carrier::buffer(slot.data.data(), info.lumaSize);
+                carrier.order = order ? &*order : nullptr;
+                Steganography::embedBits(carrier, layout, firstSample, payload.data(), firstBit, lastBit - firstBit);
+            }
+            {
+                std::lock_guard lock(mutex);
+                slot.state = State::Done;
+            }
+            changed.notify_all();
+        }
+    };
+
+    // Writer: frames go out strictly in order
+    auto writer = [&] {
+        for (std::size_t next = 0;; ++next) {
+            Slot& slot = slots[next % slotCount];
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] {
+                    return (slot.state == State::Done && slot.index == next) || (readerDone && next >= framesRead) || failed;
+                });
+                if (slot.state != State::Done || slot.index != next) return;
+            }
+            bool ok = std::fwrite(slot.header.data(), 1, slot.header.size(), out) == slot.header.size() &&
+                      std::fwrite(slot.data.data(), 1, slot.data.size(), out) == slot.data.size();
+            {
+                std::lock_guard lock(mutex);
+                slot.state = State::Free;
+                if (!ok) failed = true;
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; ++i) pool.emplace_back(worker);
+    std::thread writerThread(writer);
+
+    // Reader runs on the calling thread
+    bool readError = false;
+    for (std::size_t index = 0;; ++index) {
+        Slot& slot = slots[index % slotCount];
+        {
+            std::unique_lock lock(mutex);
+            changed.wait(lock, [&] { return slot.state == State::Free || failed; });
+            if (failed) break;
+        }
+        if (!readFrame(in, info, slot.header, slot.data, readError)) break;
+        slot.header.push_back('\n');
+        slot.index = index;
+        {
+            std::lock_guard lock(mutex);
+            slot.state = State::Queued;
+            work.push(index % slotCount);
+            framesRead = index + 1;
+        }
+        changed.notify_all();
+    }
+    {
+        std::lock_guard lock(mutex);
+        readerDone = true;
+        if (readError) failed = true;
+    }
+    changed.notify_all();
+    for (auto& thread : pool) thread.join();
+    writerThread.join();
+    std::fflush(out);
+
+    if (failed) {
+        fmt::print(stderr, "Error while processing the Y4M stream.\n");
+        return false;
+    }
+    if (framesRead * info.lumaSize < layout.samplesFor(payloadBits)) {
+        fmt::print(stderr, "Insufficient space in the stream: {} frames hold {} bits, the message needs {}.\n",
+                   framesRead, layout.firstBitOf(framesRead * info.lumaSize), payloadBits);
+        return false;
+    }
+    return true;
+}
+
+// Function to extract a message from a Y4M stream
+std::string extractStream(std::FILE* in, const Steganography::EmbedOptions& options) {
+    std::string line;
+    StreamInfo info;
+    if (!readLine(in, line) || !parseStreamHeader(line, info)) {
+        return "";
+    }
+
+    std::vector<unsigned char> bytes;
+    std::vector<char> frame;
+    std::size_t bits = 0; // payload bits read so far
+    bool error = false;
+    std::optional<Permutation::Order> order;
+    Steganography::Layout layout; // one bit per sample until the header is in
+    bool layoutKnown = false;
+    for (std::size_t frameIndex = 0; readFrame(in, info, line, frame, error); ++frameIndex) {
+        Steganography::Carrier carrier = Steganography::Carrier::buffer(frame.data(), info.lumaSize);
+        // With a key a header in the keyed order of the first frame decides, even over an older sequential one
+        if (frameIndex == 0 && options.encrypt) {
+            carrier.order = &order.emplace(info.lumaSize, options.key);
+            if (!Steganography::hasKeyedPayload(carrier)) order.reset();
+        }
+        carrier.order = order ? &*order : nullptr;
+
+        std::size_t firstSample = frameIndex * info.lumaSize;
+        std::size_t end = layout.firstBitOf(firstSample + info.lumaSize);
+        bytes.resize((end + 7) / 8, 0);
+        Steganography::extractBits(carrier, layout, firstSample, bytes.data(), bits, end - bits);
+        bits = end;
+
+        if (!layoutKnown && Steganography::payloadLayout(bytes.data(), bits / 8, layout)) {
+            layoutKnown = true;
+            // This frame's samples after the header were read one bit each, read them again with the real layout
+            if (bits > layout.headerBits) {
+                std::fill(bytes.begin() + layout.headerBits / 8, bytes.end(), 0);
+                end = layout.firstBitOf(firstSample + info.lumaSize);
+                bytes.resize((end + 7) / 8, 0);
+                Steganography::extractBits(carrier, layout, firstSample, bytes.data(), layout.headerBits, end - layout.headerBits);
+                bits = end;
+            }
+        }
+
+        // Stop reading as soon as the whole payload is in
+        std::size_t complete = bits / 8;
+        std::size_t size = Steganography::payloadSize(bytes.data(), complete);
+        if (size > 0 && size <= complete) {
+            return Steganography::parsePayload(bytes.data(), size, options);
+        }
+    }
+    return Steganography::parsePayload(bytes.data(), bits / 8, options);
+}
+
+} // namespace VideoStream
@@ -0,0 +1,19 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include "Steganography.h"
+
+// YUV4MPEG2 (Y4M) streaming carrier, https://wiki.multimedia.cx/index.php/YUV4MPEG2
+// The payload is spread over the luma (Y) planes of consecutive frames, one bit per luma byte,
+// so the carrier is "all luma planes one after another". Chroma planes and frame headers pass through untouched.
+namespace VideoStream {
+
+    // Function to hide a message in a Y4M stream, frames are embedded by `threads` workers (0 = one per core)
+    // while the output keeps the input frame order. At most threads + 2 frames are held in memory.
+    bool encryptStream(std::FILE* in, std::FILE* out, const std::string& message,
+                       const Steganography::EmbedOptions& options = {}, unsigned threads = 0);
+
+    // Function to extract a message from a Y4M stream, reading only as many frames as the payload needs
+    std::string extractStream(std::FILE* in, const Steganography::EmbedOptions& options = {});
+
+} // namespace VideoStream
@@ -1,7 +1,26 @@
 #include <filesystem>
+#include "Analysis.h"
+#include "BitPlanes.h"
+#include "Crypto.h"
 #include "ImageHandler.h"
 #include "Steganography.h"
+#include "SharedFrames.h"
+#include "Planner.h"
+#include "Probe.h"
+#include "Quality.h"
+#include "Sharding.h"
+#include "Slots.h"
+#include "Trace.h"
+#include "VideoStream.h"
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
 #include <fmt/core.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 // The video has different .exe name then this, becouse I read about name requiraments later. Code it the same
 
@@ -10,33 +29,211 @@ namespace fs = std::filesystem;
 // Function to print help information for the user
 void printHelp() {
     fmt::println("Usage:");
-    fmt::println("-i, -info    [file]           Display information about the file (BMP and PPM only).");
-    fmt::println("-e, -encrypt [file] [message] Encrypt a message into the file (BMP and PPM only).");
-    fmt::println("-d, -decrypt [file]           Extract a message from the file (BMP and PPM only).");
-    fmt::println("-c, -check   [file] [message] Check if a message can be encrypted (BMP and PPM only).");
+    fmt::println("-i, -info    [file]           Display information about the file.");
+    fmt::println("-e, -encrypt [file] [message] Encrypt a message into the file.");
+    fmt::println("-d, -decrypt [file]           Extract a message from the file.");
+    fmt::println("-c, -check   [file] [message] Check if a message can be encrypted.");
+    fmt::println("-a, -analyze [file] [windows] Look for signs of LSB embedding (chi-square, sample pairs, RS).");
+    fmt::println("-compare [file] [file]        Measure the distortion between two images (MSE, PSNR, max error, SSIM).");
+    fmt::println("-bp, -bitplanes [file] [output] [bits] Write bit-planes (bit list like 0 or 0,1, LSB by default) as PGM/PPM.");
+    fmt::println("-p, -probe   [file|directory] Tell quickly if images carry a message, from their first bytes only.");
+    fmt::println("-plan [carriers] [messages] [manifest] [min|spread] Plan which carriers take which message files.");
+    fmt::println("-batch [manifest]             Hide the message files as the manifest from -plan says.");
+    fmt::println("-ta, -toc-add [file] [name] [message] Add a named message to the file's slot directory.");
+    fmt::println("-tg, -toc-get [file] [name]   Extract the named message from the slot directory.");
+    fmt::println("-tl, -toc-list [file]         List the slots of the file.");
+    fmt::println("-ve, -video-encrypt [message] Encrypt a message into a Y4M stream, stdin -> stdout.");
+    fmt::println("-vd, -video-decrypt           Extract a message from a Y4M stream on stdin.");
+    fmt::println("-se, -shm-encrypt [ring] [message] Encrypt a message into every frame of a shared memory ring.");
+    fmt::println("-sd, -shm-decrypt [ring]      Extract messages from the frames of a shared memory ring.");
+    fmt::println("-xe, -shard-encrypt [k] [message] [files...] Split a message into k-of-n shards, one per file.");
+    fmt::println("-xd, -shard-decrypt [files...] Rebuild a sharded message from any k of its files.");
     fmt::println("-h, -help                     Show help information.");
+    fmt::println("Options:");
+    fmt::println("--compress                    Compress the message before hiding it (used only when it gets smaller).");
+    fmt::println("--key-file=[file]             Encrypt (or decrypt) the message with the key in the file (32 bytes or 64 hex digits).");
+    fmt::println("--key-env[=NAME]              Same with the key in an environment variable, STEGO_KEY by default.");
+    fmt::println("--bits-per-sample=[1-4]       Hide 1 to 4 bits in every carrier byte (more capacity, more visible).");
+    fmt::println("--matrix=[2-8]                Matrix embedding: p bits per 2^p-1 carrier bytes, at most one byte changed.");
+    fmt::println("--fec=[2-128]                 Add Reed-Solomon parity bytes (per 255 bytes) that repair up to half as many damaged bytes.");
+    fmt::println("--adaptive                    Put the message into the most textured parts of the image (image files only).");
+    fmt::println("--permute                     Scatter the message over the whole carrier in an order derived from the key.");
+    fmt::println("--trace=[file]                Record how long every phase takes into a Chrome trace file (chrome://tracing, ui.perfetto.dev).");
+    fmt::println("Supported formats: BMP, PPM (P6/P3), PGM (P5/P2), PAM (P7), QOI and PNG, detected from the file contents.");
     fmt::println("IMPORTANT: IF THERE IS A SPACE IN FILE PATH, PUT IT IN QUOTES \"\"");
 }
 
+// Function to parse a whole argument as a decimal number, false on anything else (also trailing characters)
+bool parseNumber(const std::string& text, int& value) {
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+// Function to split "--option" flags from the other arguments, false on an unknown option
+bool parseOptions(int argc, char *argv[], std::vector<std::string>& args, Steganography::EmbedOptions& options) {
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i == 0 || arg.rfind("--", 0) != 0) {
+            args.push_back(arg);
+        } else if (arg == "--compress") {
+            options.compress = true;
+        } else if (arg.rfind("--bits-per-sample=", 0) == 0) {
+            if (!parseNumber(arg.substr(18), options.bitsPerSample) || options.bitsPerSample < 1 ||
+                options.bitsPerSample > 4) {
+                fmt::println("--bits-per-sample must be 1, 2, 3 or 4.");
+                return false;
+            }
+        } else if (arg.rfind("--matrix=", 0) == 0) {
+            if (!parseNumber(arg.substr(9), options.matrixBits) || options.matrixBits < 2 || options.matrixBits > 8) {
+                fmt::println("--matrix must be between 2 and 8.");
+                return false;
+            }
+        } else if (arg.rfind("--fec=", 0) == 0) {
+            if (!parseNumber(arg.substr(6), options.fecParity) || options.fecParity < 2 || options.fecParity > 128 ||
+                options.fecParity % 2 != 0) {
+                fmt::println("--fec must be an even number of parity bytes from 2 to 128.");
+                return false;
+            }
+        } else if (arg == "--adaptive") {
+            options.adaptive = true;
+        } else if (arg == "--permute") {
+            options.permute = true;
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            // Written when the program exits
+            if (!Trace::start(arg.substr(8))) return false;
+        } else if (arg.rfind("--key-file=", 0) == 0) {
+            if (!Crypto::readKeyFile(arg.substr(11), options.key)) return false;
+            options.encrypt = true;
+        } else if (arg == "--key-env" || arg.rfind("--key-env=", 0) == 0) {
+            if (!Crypto::readKeyEnv(arg.size() > 10 ? arg.substr(10) : "STEGO_KEY", options.key)) return false;
+            options.encrypt = true;
+        } else {
+            fmt::println("Unknown option '{}'.", arg);
+            return false;
+        }
+    }
+    if (options.permute && !options.encrypt) {
+        fmt::println("--permute needs a key (--key-file or --key-env).");
+        return false;
+    }
+    if (options.matrixBits && options.bitsPerSample != 1) {
+        fmt::println("--matrix works on one bit per sample, it cannot be combined with --bits-per-sample.");
+        return false;
+    }
+    if (options.adaptive && (options.permute || options.bitsPerSample != 1)) {
+        fmt::println("--adaptive chooses its own carrier bytes and changes only their lowest bit, it cannot be combined with --permute or --bits-per-sample.");
+        return false;
+    }
+    return true;
+}
+
 // Main function to handle command-line arguments and execute corresponding actions
 // argc -> number of strings in argv, argv -> strings themself
 int main(int argc, char *argv[]) {
+    // Options can go anywhere, the commands below only see the remaining arguments
+    std::vector<std::string> args;
+    Steganography::EmbedOptions options;
+    if (!parseOptions(argc, argv, args, options)) {
+        printHelp();
+        return 1;
+    }
+    argc = static_cast<int>(args.size());
+
     if (argc < 2) {
         // If no arguments are provided, print help information
         printHelp();
         return 1;
     }
 
-    std::string command = argv[1];
+    std::string command = args[1];
     if (command == "-h" || command == "-help") {
         // If the help command is provided, print help information
         printHelp();
         return 0;
+    } else if ((command == "-ve" || command == "-video-encrypt") && argc == 3) {
+        // Video frames go to stdout, so every message has to go to stderr
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        if (VideoStream::encryptStream(stdin, stdout, args[2], options)) {
+            fmt::print(stderr, "Message successfully encrypted.\n");
+        } else {
+            fmt::print(stderr, "Failed to encrypt message.\n");
+            return 1;
+        }
+    } else if ((command == "-vd" || command == "-video-decrypt") && argc == 2) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        std::string message = VideoStream::extractStream(stdin, options);
+        fmt::println("Extracted message: '{}'", message);
+    } else if ((command == "-se" || command == "-shm-encrypt") && argc == 4) {
+        // Frames are changed in place inside the producer's shared memory, no file is involved
+        long frames = SharedFrames::encryptRing(args[2], args[3], options);
+        if (frames < 0) {
+            fmt::println("Failed to encrypt message.");
+            return 1;
+        }
+        fmt::println("Message encrypted into {} frames.", frames);
+    } else if ((command == "-sd" || command == "-shm-decrypt") && argc == 3) {
+        long frames = SharedFrames::extractRing(args[2], options);
+        if (frames < 0) return 1;
+        fmt::println("Read {} frames.", frames);
+    } else if ((command == "-p" || command == "-probe") && argc == 3) {
+        // A directory is scanned recursively, every image gets one line
+        if (fs::is_directory(args[2])) return Probe::probeDirectory(args[2]) < 0 ? 1 : 0;
+        Probe::Result result;
+        if (!Probe::probeFile(args[2], result)) {
+            fmt::println("Unsupported file format. Only BMP, PPM, PGM, PAM, QOI and PNG files are supported.");
+            return 1;
+        }
+        fmt::println("{}", Probe::describe(result));
+    } else if ((command == "-bp" || command == "-bitplanes") && (argc == 4 || argc == 5)) {
+        std::uint16_t mask;
+        if (!BitPlanes::parseBits(argc == 5 ? args[4] : "0", mask)) {
+            fmt::println("Bits are a comma separated list of 0 to 15, 0 being the LSB.");
+            return 1;
+        }
+        if (!BitPlanes::exportPlanes(args[2], args[3], mask)) return 1;
+    } else if (command == "-compare" && argc == 4) {
+        if (!Quality::compareFiles(args[2], args[3])) return 1;
+    } else if (command == "-plan" && (argc == 5 || argc == 6)) {
+        // Pass the same options to -batch, the planned slot sizes depend on them
+        std::string objective = argc == 6 ? args[5] : "min";
+        if (objective != "min" && objective != "spread") {
+            fmt::println("The objective is 'min' (fewest carriers) or 'spread' (most headroom).");
+            return 1;
+        }
+        if (!Planner::plan(args[2], args[3], args[4],
+                           objective == "min" ? Planner::Objective::MinCarriers : Planner::Objective::Spread, options)) {
+            return 1;
+        }
+    } else if (command == "-batch" && argc == 3) {
+        if (Planner::runManifest(args[2], options) < 0) return 1;
+    } else if ((command == "-xe" || command == "-shard-encrypt") && argc >= 5) {
+        // Every file gets one shard, written on parallel threads
+        int k = 0;
+        if (!parseNumber(args[2], k)) {
+            fmt::println("The shard threshold k must be a whole number, got '{}'.", args[2]);
+            return 1;
+        }
+        std::vector<std::string> files(args.begin() + 4, args.end());
+        int written = Sharding::encryptShards(files, args[3], k, options);
+        if (written < k) {
+            fmt::println("Failed to encrypt message.");
+            return 1;
+        }
+        fmt::println("Message successfully encrypted.");
+    } else if ((command == "-xd" || command == "-shard-decrypt") && argc >= 3) {
+        std::vector<std::string> files(args.begin() + 2, args.end());
+        std::string message = Sharding::extractShards(files, options);
+        fmt::println("Extracted message: '{}'", message);
     } else if (argc >= 3) {
-        std::string filename = argv[2];
-        // Checking if the file exists and is either a BMP or PPM file
-        if (!fs::exists(filename) || (!filename.ends_with(".bmp") && !filename.ends_with(".ppm"))) {
-            fmt::println("Unsupported file format. Only .bmp and .ppm files are supported.");
+        std::string filename = args[2];
+        // Checking if the file exists and its magic bytes match a supported format
+        if (!fs::exists(filename) || ImageHandler::detectFormat(filename) == ImageHandler::ImageFormat::Unknown) {
+            fmt::println("Unsupported file format. Only BMP, PPM, PGM, PAM, QOI and PNG files are supported.");
             return 1;
         }
         // Process the command and execute the corresponding function
@@ -45,8 +242,8 @@ int main(int argc, char *argv[]) {
             ImageHandler::printFileInfo(filename);
         } else if ((command == "-e" || command == "-encrypt") && argc == 4) {
             // Encrypt a message into the file
-            std::string message = argv[3];
-            if (Steganography::encryptMessage(filename, message)) {
+            std::string message = args[3];
+            if (Steganography::encryptMessage(filename, message, options)) {
                 fmt::println("Message successfully encrypted.");
             } else {
                 fmt::println("Failed to encrypt message.");
@@ -54,19 +251,51 @@ int main(int argc, char *argv[]) {
         } else if ((command == "-d" || command == "-decrypt") && argc == 3) {
             // Extract a message from the file
             try {
-                std::string message = Steganography::extractMessage(filename);
-                fmt::println("Extracted message: '{}'", message);
+                std::string message = Steganography::extractMessage(filename, options);
+                if (Sharding::isShard(message)) {
+                    fmt::println("The file holds one shard of a sharded message, use -xd with the other files of the set.");
+                } else if (message.empty() && Slots::hasDirectory(filename)) {
+                    fmt::println("The file holds a slot directory, use -tl to list the slots and -tg to read one.");
+                } else {
+                    fmt::println("Extracted message: '{}'", message);
+                }
             } catch (const std::exception &e) {
                 fmt::println("Error: {}", e.what());
             }
         } else if ((command == "-c" || command == "-check") && argc == 4) {
             // Check if a message can be encrypted" in the file
-            std::string message = argv[3];
-            if (Steganography::canEncryptMessage(filename, message)) {
+            std::string message = args[3];
+            if (Steganography::canEncryptMessage(filename, message, options)) {
                 fmt::println("The message can be encrypted.");
             } else {
                 fmt::println("The message cannot be encrypted due to size constraints.");
             }
+        } else if ((command == "-a" || command == "-analyze") && (argc == 3 || argc == 4)) {
+            // Optional number of row bands to report on their own
+            int windows = 0;
+            if (argc == 4 && (!parseNumber(args[3], windows) || windows < 0)) {
+                fmt::println("The window count must be a whole number, got '{}'.", args[3]);
+                return 1;
+            }
+            if (!Analysis::analyzeFile(filename, windows)) return 1;
+        } else if ((command == "-ta" || command == "-toc-add") && argc == 5) {
+            // Only the new slot and its directory entry are written, earlier slots stay untouched
+            if (Slots::addSlot(filename, args[3], args[4], options)) {
+                fmt::println("Message successfully added to slot '{}'.", args[3]);
+            } else {
+                fmt::println("Failed to add message.");
+            }
+        } else if ((command == "-tg" || command == "-toc-get") && argc == 4) {
+            std::string message = Slots::readSlot(filename, args[3], options);
+            fmt::println("Extracted message: '{}'", message);
+        } else if ((command == "-tl" || command == "-toc-list") && argc == 3) {
+            std::vector<Slots::Entry> entries;
+            if (Slots::listSlots(filename, entries)) {
+                for (const auto& entry : entries) {
+                    fmt::println("{:<16} samples {}..{}", entry.name, entry.first, entry.first + entry.samples);
+                }
+                fmt::println("{} slot(s).", entries.size());
+            }
         } else {
             // If the command is invalid, print help information
             fmt::println("Invalid usage.");